@@ -0,0 +1,126 @@
+/**
+ * Per-cell activity accumulators, see activity.h.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "activity.h"
+#include "helpers.h"
+#include "util.h"
+
+/**
+ * Allocates zeroed accumulators for an m by n grid. Returns false if they
+ * cannot be allocated.
+ */
+bool activity_init(struct activity* act, size_t m, size_t n) {
+    act->m = m;
+    act->n = n;
+    act->alive = (uint16_t*)calloc(m * n, sizeof(uint16_t));
+    act->flips = (uint16_t*)calloc(m * n, sizeof(uint16_t));
+    act->last_change = (uint32_t*)calloc(m * n, sizeof(uint32_t));
+    if (!act->alive || !act->flips || !act->last_change) { activity_free(act); return false; }
+    return true;
+}
+
+/**
+ * Frees the accumulators.
+ */
+void activity_free(struct activity* act) {
+    free(act->alive);
+    free(act->flips);
+    free(act->last_change);
+    act->alive = act->flips = NULL;
+    act->last_change = NULL;
+}
+
+/**
+ * Adds count cells of a new generation, starting at cell i, to the
+ * accumulators given the cells of the previous generation.
+ */
+static void __accumulate(const uint8_t* prev, const uint8_t* next, size_t i, size_t count,
+                         struct activity* act, uint32_t generation) {
+    size_t end = i + count;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi8(1);
+    const __m128i gen = _mm_set1_epi32((int)generation);
+    for (; i + 16 <= end; i += 16) {
+        __m128i p = _mm_loadu_si128((const __m128i*)(prev + i));
+        __m128i c = _mm_loadu_si128((const __m128i*)(next + i));
+        __m128i same = _mm_cmpeq_epi8(p, c);
+        __m128i flip = _mm_andnot_si128(same, one);
+        __m128i live = _mm_and_si128(c, one);
+
+        // saturating 16-bit adds of the 8-bit 0/1 values, low and high halves
+        __m128i* alive = (__m128i*)(act->alive + i);
+        __m128i* flips = (__m128i*)(act->flips + i);
+        _mm_storeu_si128(alive, _mm_adds_epu16(_mm_loadu_si128(alive), _mm_unpacklo_epi8(live, zero)));
+        _mm_storeu_si128(alive + 1, _mm_adds_epu16(_mm_loadu_si128(alive + 1), _mm_unpackhi_epi8(live, zero)));
+        _mm_storeu_si128(flips, _mm_adds_epu16(_mm_loadu_si128(flips), _mm_unpacklo_epi8(flip, zero)));
+        _mm_storeu_si128(flips + 1, _mm_adds_epu16(_mm_loadu_si128(flips + 1), _mm_unpackhi_epi8(flip, zero)));
+
+        // widen the changed mask (all ones where the cell flipped) to 32 bits and blend in the generation
+        __m128i changed = _mm_cmpeq_epi8(flip, one);
+        __m128i lo = _mm_unpacklo_epi8(changed, changed), hi = _mm_unpackhi_epi8(changed, changed);
+        __m128i masks[4] = {
+            _mm_unpacklo_epi16(lo, lo), _mm_unpackhi_epi16(lo, lo),
+            _mm_unpacklo_epi16(hi, hi), _mm_unpackhi_epi16(hi, hi),
+        };
+        __m128i* last = (__m128i*)(act->last_change + i);
+        for (int k = 0; k < 4; k++) {
+            __m128i old = _mm_loadu_si128(last + k);
+            _mm_storeu_si128(last + k, _mm_or_si128(_mm_andnot_si128(masks[k], old), _mm_and_si128(masks[k], gen)));
+        }
+    }
+#endif
+    for (; i < end; i++) {
+        act->alive[i] += next[i] && act->alive[i] != UINT16_MAX;
+        if (prev[i] != next[i]) {
+            act->flips[i] += act->flips[i] != UINT16_MAX;
+            act->last_change[i] = generation;
+        }
+    }
+}
+
+/**
+ * Same as update() for all cells of the rows first_row to last_row
+ * (exclusive), and adds the new generation of those rows to the
+ * accumulators right after each row is computed.
+ */
+void update_rows_activity(const uint8_t* grid, uint8_t* grid_next, size_t first_row,
+                          size_t last_row, size_t n, struct activity* act,
+                          uint32_t generation) {
+    for (size_t row = first_row; row < last_row; row++) {
+        size_t first = row * n, last = first + n;
+        for (size_t i = first; i < last; i++) {
+            update(grid, grid_next, i, act->m, n);
+        }
+        // the row is still in cache
+        __accumulate(grid, grid_next, first, n, act, generation);
+    }
+}
+
+/**
+ * Saves the accumulators next to an output file as <output>.alive.npy,
+ * <output>.flips.npy and <output>.last_change.npy. This will return false
+ * if any of them cannot be written.
+ */
+bool activity_to_npy(const struct activity* act, const char* output_file) {
+    size_t shape[2] = {act->m, act->n};
+    char* alive = sibling_path(output_file, ".alive.npy");
+    char* flips = sibling_path(output_file, ".flips.npy");
+    char* last_change = sibling_path(output_file, ".last_change.npy");
+    bool ok = array_to_npy_path(alive, act->alive, "<u2", sizeof(uint16_t), shape, 2) &&
+              array_to_npy_path(flips, act->flips, "<u2", sizeof(uint16_t), shape, 2) &&
+              array_to_npy_path(last_change, act->last_change, "<u4", sizeof(uint32_t), shape, 2);
+    free(alive);
+    free(flips);
+    free(last_change);
+    return ok;
+}
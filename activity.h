@@ -0,0 +1,56 @@
+/**
+ * Per-cell activity accumulators, updated in the same pass as the
+ * generation itself so a run can be analyzed without its full history:
+ *   - the number of generations a cell was alive
+ *   - the number of times a cell changed state
+ *   - the last generation a cell changed state (0 if it never did)
+ * The counts saturate at 65535.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct activity {
+    size_t m, n;
+    uint16_t* alive;
+    uint16_t* flips;
+    uint32_t* last_change;
+};
+
+/**
+ * Allocates zeroed accumulators for an m by n grid. Returns false if they
+ * cannot be allocated.
+ */
+bool activity_init(struct activity* act, size_t m, size_t n);
+
+/**
+ * Frees the accumulators.
+ */
+void activity_free(struct activity* act);
+
+/**
+ * Same as update() for all cells of the rows first_row to last_row
+ * (exclusive), and adds the new generation of those rows to the
+ * accumulators right after each row is computed.
+ */
+void update_rows_activity(const uint8_t* grid, uint8_t* grid_next, size_t first_row,
+                          size_t last_row, size_t n, struct activity* act,
+                          uint32_t generation);
+
+/**
+ * Saves the accumulators next to an output file as <output>.alive.npy,
+ * <output>.flips.npy and <output>.last_change.npy. This will return false
+ * if any of them cannot be written.
+ */
+bool activity_to_npy(const struct activity* act, const char* output_file);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,108 @@
+/**
+ * Background writer for NPY files so the generation loop never waits on I/O.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "async_writer.h"
+#include "util.h"
+
+struct __write_job {
+    char* path;
+    uint8_t* grid;
+    size_t m, n, p;
+    struct __write_job* next;
+};
+
+static pthread_mutex_t __lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t __ready = PTHREAD_COND_INITIALIZER;
+static struct __write_job* __head = NULL, * __tail = NULL;
+static pthread_t __writer_thread;
+static bool __running = false, __stopping = false, __failed = false;
+static size_t __backlog = 0;
+
+static void* __writer(void* arg) {
+    pthread_mutex_lock(&__lock);
+    for (;;) {
+        while (!__head && !__stopping) { pthread_cond_wait(&__ready, &__lock); }
+        if (!__head) { break; }
+        struct __write_job* job = __head;
+        __head = job->next;
+        if (!__head) { __tail = NULL; }
+        pthread_mutex_unlock(&__lock);
+
+        bool ok = grid_to_npy_path(job->path, job->grid, job->m, job->n, job->p);
+        if (!ok) { perror(job->path); }
+        size_t bytes = job->m * job->n * job->p;
+        free(job->path);
+        free(job->grid);
+        free(job);
+
+        pthread_mutex_lock(&__lock);
+        __backlog -= bytes;
+        __failed |= !ok;
+    }
+    pthread_mutex_unlock(&__lock);
+    return NULL;
+}
+
+/**
+ * Queues an m by n by p grid to be written to a NPY file at the given path
+ * by the writer thread, which is started on first use. The writer takes
+ * ownership of the grid and frees it with free() once it is written. Both
+ * the path and grid must be allocated with malloc().
+ */
+void async_write_npy(char* path, uint8_t* grid, size_t m, size_t n, size_t p) {
+    struct __write_job* job = (struct __write_job*)malloc(sizeof(struct __write_job));
+    job->path = path;
+    job->grid = grid;
+    job->m = m; job->n = n; job->p = p;
+    job->next = NULL;
+
+    pthread_mutex_lock(&__lock);
+    if (!__running) {
+        __stopping = false;
+        __running = pthread_create(&__writer_thread, NULL, __writer, NULL) == 0;
+    }
+    if (!__running) {
+        // no thread to hand it to, so write it right away
+        pthread_mutex_unlock(&__lock);
+        if (!grid_to_npy_path(path, grid, m, n, p)) { perror(path); __failed = true; }
+        free(path); free(grid); free(job);
+        return;
+    }
+    if (__tail) { __tail->next = job; } else { __head = job; }
+    __tail = job;
+    __backlog += m * n * p;
+    pthread_cond_signal(&__ready);
+    pthread_mutex_unlock(&__lock);
+}
+
+/**
+ * Get the number of bytes queued but not yet written.
+ */
+size_t async_writer_backlog() {
+    pthread_mutex_lock(&__lock);
+    size_t backlog = __backlog;
+    pthread_mutex_unlock(&__lock);
+    return backlog;
+}
+
+/**
+ * Waits for all queued writes to finish and stops the writer thread.
+ * Returns false if any of the writes failed.
+ */
+bool async_writer_finish() {
+    pthread_mutex_lock(&__lock);
+    bool running = __running;
+    __stopping = true;
+    pthread_cond_signal(&__ready);
+    pthread_mutex_unlock(&__lock);
+    if (running) { pthread_join(__writer_thread, NULL); }
+    __running = false;
+    return !__failed;
+}
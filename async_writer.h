@@ -0,0 +1,36 @@
+/**
+ * Background writer for NPY files so the generation loop never waits on I/O.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Queues an m by n by p grid to be written to a NPY file at the given path
+ * by the writer thread, which is started on first use. The writer takes
+ * ownership of the grid and frees it with free() once it is written. Both
+ * the path and grid must be allocated with malloc().
+ */
+void async_write_npy(char* path, uint8_t* grid, size_t m, size_t n, size_t p);
+
+/**
+ * Get the number of bytes queued but not yet written.
+ */
+size_t async_writer_backlog();
+
+/**
+ * Waits for all queued writes to finish and stops the writer thread.
+ * Returns false if any of the writes failed.
+ */
+bool async_writer_finish();
+
+#ifdef __cplusplus
+}
+#endif
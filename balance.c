@@ -0,0 +1,114 @@
+/**
+ * Dynamic load balancing, see balance.h.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "balance.h"
+
+#define BALANCE_SMOOTHING 0.5 // weight of the last interval in the cost of a row
+
+/**
+ * Splits m rows into equal partitions and checks them every interval
+ * generations. Returns false if it cannot be allocated.
+ */
+bool balancer_init(struct load_balancer* b, size_t m, size_t parts, size_t interval, double threshold) {
+    memset(b, 0, sizeof(*b));
+    b->m = m;
+    b->parts = parts ? parts : 1;
+    b->interval = interval ? interval : 1;
+    b->threshold = threshold;
+    b->imbalance = 1;
+    b->bounds = (size_t*)malloc((b->parts + 1) * sizeof(size_t));
+    b->busy = (double*)calloc(b->parts, sizeof(double));
+    b->row_cost = (double*)calloc(m ? m : 1, sizeof(double));
+    if (!b->bounds || !b->busy || !b->row_cost) { balancer_free(b); return false; }
+    for (size_t k = 0; k <= b->parts; k++) { b->bounds[k] = k * m / b->parts; }
+    return true;
+}
+
+/**
+ * Get the CPU time of the calling thread in seconds, which leaves out the
+ * time it was not running.
+ */
+double balancer_clock() {
+    struct timespec t;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+/**
+ * Moves the boundaries so every partition has the same cost, given the
+ * time each partition took.
+ */
+static void __rebalance(struct load_balancer* b) {
+    // Rows take the cost of their partition, averaged with what they had
+    bool first = b->rebalances == 0;
+    double total = 0;
+    for (size_t k = 0; k < b->parts; k++) {
+        size_t rows = b->bounds[k + 1] - b->bounds[k];
+        double cost = rows ? b->busy[k] / rows : 0;
+        for (size_t i = b->bounds[k]; i < b->bounds[k + 1]; i++) {
+            b->row_cost[i] = first ? cost : (1 - BALANCE_SMOOTHING) * b->row_cost[i] + BALANCE_SMOOTHING * cost;
+            total += b->row_cost[i];
+        }
+    }
+
+    // Cut where the running cost crosses each share, leaving at least a row per partition
+    double sum = 0;
+    size_t k = 1, moved = 0;
+    for (size_t i = 0; i < b->m && k < b->parts; i++) {
+        sum += b->row_cost[i];
+        if (sum >= total * k / b->parts || b->m - (i + 1) <= b->parts - k) {
+            moved += i + 1 > b->bounds[k] ? i + 1 - b->bounds[k] : b->bounds[k] - (i + 1);
+            b->bounds[k++] = i + 1;
+        }
+    }
+    b->rows_moved += moved;
+    b->rebalances++;
+}
+
+/**
+ * Ends a generation, checking the imbalance at the end of an interval.
+ * Returns true if the boundaries were moved.
+ */
+bool balancer_end_generation(struct load_balancer* b) {
+    if (++b->generations < b->interval) { return false; }
+    double max = 0, sum = 0;
+    for (size_t k = 0; k < b->parts; k++) {
+        sum += b->busy[k];
+        if (b->busy[k] > max) { max = b->busy[k]; }
+    }
+    b->imbalance = sum > 0 ? max * b->parts / sum : 1;
+    b->imbalance_sum += b->imbalance;
+    b->checks++;
+    bool moved = b->parts > 1 && b->m >= b->parts && b->imbalance > 1 + b->threshold;
+    if (moved) { __rebalance(b); }
+    memset(b->busy, 0, b->parts * sizeof(double));
+    b->generations = 0;
+    return moved;
+}
+
+/**
+ * Prints the imbalance and the rows moved.
+ */
+void balancer_print_stats(const struct load_balancer* b) {
+    printf("Balance: %zu partitions, imbalance %.2f last and %.2f on average, %zu rebalances moved %zu rows\n",
+           b->parts, b->imbalance, b->checks ? b->imbalance_sum / b->checks : 1.0, b->rebalances, b->rows_moved);
+}
+
+/**
+ * Frees a balancer.
+ */
+void balancer_free(struct load_balancer* b) {
+    free(b->bounds);
+    free(b->busy);
+    free(b->row_cost);
+    b->bounds = NULL;
+    b->busy = b->row_cost = NULL;
+}
@@ -0,0 +1,76 @@
+/**
+ * Dynamic load balancing of the rows of a grid over threads.
+ *
+ * Each thread computes a partition of consecutive rows and records how long
+ * it took. Every interval generations the imbalance (the slowest partition
+ * over the mean) is checked, and when it is above the threshold the rows
+ * are given a cost from the time of the partition they were in, smoothed
+ * over the checks, and the boundaries are moved so every partition gets the
+ * same cost. Below the threshold the boundaries stay, so noise in the
+ * timings does not move rows back and forth.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BALANCE_THRESHOLD 0.10 // default imbalance over which rows are moved
+
+struct load_balancer {
+    size_t m;              // rows
+    size_t parts;          // partitions, one per thread
+    size_t* bounds;        // partition k has rows bounds[k] to bounds[k+1]
+    double* busy;          // seconds each partition computed since the last check
+    double* row_cost;      // smoothed seconds per row
+    size_t interval, generations;
+    double threshold;
+    size_t checks, rebalances, rows_moved;
+    double imbalance;      // at the last check
+    double imbalance_sum;  // over all checks
+};
+
+/**
+ * Splits m rows into equal partitions and checks them every interval
+ * generations. Returns false if it cannot be allocated.
+ */
+bool balancer_init(struct load_balancer* balancer, size_t m, size_t parts, size_t interval, double threshold);
+
+/**
+ * Get the CPU time of the calling thread in seconds, which leaves out the
+ * time it was not running.
+ */
+double balancer_clock();
+
+/**
+ * Records the time a partition took in a generation. Every thread records
+ * its own partition.
+ */
+static inline void balancer_record(struct load_balancer* balancer, size_t part, double seconds) {
+    balancer->busy[part] += seconds;
+}
+
+/**
+ * Ends a generation, checking the imbalance at the end of an interval.
+ * Returns true if the boundaries were moved.
+ */
+bool balancer_end_generation(struct load_balancer* balancer);
+
+/**
+ * Prints the imbalance and the rows moved.
+ */
+void balancer_print_stats(const struct load_balancer* balancer);
+
+/**
+ * Frees a balancer.
+ */
+void balancer_free(struct load_balancer* balancer);
+
+#ifdef __cplusplus
+}
+#endif
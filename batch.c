@@ -0,0 +1,335 @@
+/**
+ * A pipeline for running many boards, see batch.h.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "batch.h"
+#include "life.h"
+#include "lz.h"
+#include "util.h"
+
+#define BATCH_DEFAULT_DEPTH 2
+#define NPY_HEADER_SIZE 128 // as written by npy_write_header()
+
+/**
+ * A board going through the pipeline.
+ */
+struct __item {
+    struct batch_job* job;
+    uint8_t* grid; // from grid_alloc()
+    size_t m, n;
+    uint8_t* encoded; // the NPY header, or the whole compressed file
+    size_t encoded_size;
+    bool compressed;
+    bool failed; // the job failed, so the board drops out of the pipeline
+};
+
+/**
+ * A bounded queue of boards between two stages.
+ */
+struct __queue {
+    struct __item** items;
+    size_t capacity, head, count;
+    bool closed; // no more boards are coming
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty, not_full;
+};
+
+static bool __queue_init(struct __queue* q, size_t capacity) {
+    q->items = (struct __item**)malloc(capacity * sizeof(struct __item*));
+    q->capacity = capacity;
+    q->head = q->count = 0;
+    q->closed = false;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    return q->items != NULL;
+}
+
+static void __queue_destroy(struct __queue* q) {
+    free(q->items);
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+}
+
+static void __queue_push(struct __queue* q, struct __item* item) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == q->capacity) { pthread_cond_wait(&q->not_full, &q->lock); }
+    q->items[(q->head + q->count++) % q->capacity] = item;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/**
+ * Takes the next board, waiting for one. Returns NULL once the queue is
+ * closed and empty.
+ */
+static struct __item* __queue_pop(struct __queue* q) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && !q->closed) { pthread_cond_wait(&q->not_empty, &q->lock); }
+    struct __item* item = NULL;
+    if (q->count) {
+        item = q->items[q->head];
+        q->head = (q->head + 1) % q->capacity;
+        q->count--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return item;
+}
+
+static void __queue_close(struct __queue* q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = true;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+struct __batch {
+    struct batch_job* jobs;
+    size_t count, next_job;
+    size_t sim_threads;
+    struct __queue queues[BATCH_STAGES - 1]; // queues[s] goes from stage s to stage s+1
+    size_t running[BATCH_STAGES];            // threads of each stage still running
+    struct batch_stage_stats* stats;
+    pthread_mutex_t lock;
+};
+
+static void __item_free(struct __item* item) {
+    if (item->grid) { grid_free(item->grid, item->m * item->n); }
+    free(item->encoded);
+    free(item);
+}
+
+/**
+ * Marks the job of a board as failed, with errno or EINVAL if the failure
+ * did not set it (like a file too short to have a header).
+ */
+static bool __fail(struct __item* item) {
+    item->failed = true;
+    item->job->ok = false;
+    item->job->error = errno ? errno : EINVAL;
+    return false;
+}
+
+/**
+ * Loads the next board into memory of its own, so the file is read here and
+ * not by the simulation, and the input file is never changed. Returns NULL
+ * once there are no more jobs.
+ */
+static struct __item* __read(struct __batch* b) {
+    struct batch_job* job;
+    struct __item* item = NULL;
+    while (!item) {
+        pthread_mutex_lock(&b->lock);
+        job = b->next_job < b->count ? &b->jobs[b->next_job++] : NULL;
+        pthread_mutex_unlock(&b->lock);
+        if (!job) { return NULL; }
+        // a job without memory for its board fails, the others still run
+        item = (struct __item*)calloc(1, sizeof(struct __item));
+        if (!item) { job->error = ENOMEM; }
+    }
+    item->job = job;
+    errno = 0;
+    uint8_t* grid = grid_load_path(job->input_file, &item->m, &item->n);
+    if (!grid) { __fail(item); return item; }
+    size_t size = item->m * item->n;
+    item->grid = grid_alloc(size);
+    if (item->grid) { memcpy(item->grid, grid, size); } else { __fail(item); }
+    size_t addr = ((size_t)grid) & ~(sysconf(_SC_PAGE_SIZE)-1);
+    munmap((void*)addr, (size_t)grid - addr + size);
+    return item;
+}
+
+static bool __simulate(struct __batch* b, struct __item* item) {
+    size_t reached = life_run(item->grid, item->m, item->n, item->job->iterations, b->sim_threads, NULL);
+    if (reached == (size_t)-1) { return __fail(item); }
+    item->job->generations = reached;
+    return true;
+}
+
+static bool __encode(struct __item* item) {
+    const char* path = item->job->output_file;
+    size_t len = strlen(path);
+    item->compressed = len > 3 && strcmp(path + len - 3, ".lz") == 0;
+    if (item->compressed) {
+        item->encoded = lz_encode_grid(item->grid, item->m, item->n, &item->encoded_size);
+        if (!item->encoded) { return __fail(item); }
+        // the board is not needed anymore, the writer only has the file
+        grid_free(item->grid, item->m * item->n);
+        item->grid = NULL;
+        return true;
+    }
+    // fmemopen() ends what was written with a null byte, which needs a byte of its own
+    item->encoded = (uint8_t*)malloc(NPY_HEADER_SIZE + 1);
+    FILE* f = item->encoded ? fmemopen(item->encoded, NPY_HEADER_SIZE + 1, "wb") : NULL;
+    bool ok = f && grid_to_npy_header(f, 1, item->m, item->n);
+    if (f) { item->encoded_size = ftell(f); ok = fclose(f) == 0 && ok; }
+    return ok || __fail(item);
+}
+
+static bool __write(struct __item* item) {
+    FILE* f = fopen(item->job->output_file, "wb");
+    if (!f) { return __fail(item); }
+    size_t size = item->m * item->n;
+    bool ok = fwrite(item->encoded, 1, item->encoded_size, f) == item->encoded_size &&
+              (item->compressed || fwrite(item->grid, 1, size, f) == size);
+    ok = fclose(f) == 0 && ok;
+    if (!ok) { return __fail(item); }
+    item->job->ok = true;
+    return true;
+}
+
+static inline double __seconds(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return get_time_diff((struct timespec*)start, &now);
+}
+
+struct __stage {
+    struct __batch* batch;
+    enum batch_stage id;
+};
+
+/**
+ * Runs one thread of a stage: takes boards from the previous queue (or
+ * reads them), works on them and passes them on. Boards that failed drop out.
+ */
+static void* __stage_thread(void* arg) {
+    struct __stage* stage = (struct __stage*)arg;
+    struct __batch* b = stage->batch;
+    enum batch_stage id = stage->id;
+    struct __queue* in = id > BATCH_READ ? &b->queues[id - 1] : NULL;
+    struct __queue* out = id < BATCH_WRITE ? &b->queues[id] : NULL;
+    struct batch_stage_stats local = {0};
+    struct timespec t;
+    for (;;) {
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        struct __item* item = in ? __queue_pop(in) : __read(b);
+        if (!item) { break; }
+        bool ok = !item->failed;
+        if (in) {
+            local.starved += __seconds(&t);
+            clock_gettime(CLOCK_MONOTONIC, &t);
+            if (ok) {
+                ok = id == BATCH_SIMULATE ? __simulate(b, item) :
+                     id == BATCH_ENCODE ? __encode(item) : __write(item);
+            }
+        }
+        local.busy += __seconds(&t);
+        local.boards++;
+        if (ok && out) {
+            clock_gettime(CLOCK_MONOTONIC, &t);
+            __queue_push(out, item);
+            local.blocked += __seconds(&t);
+        } else {
+            __item_free(item);
+        }
+    }
+
+    pthread_mutex_lock(&b->lock);
+    struct batch_stage_stats* stats = &b->stats[id];
+    stats->boards += local.boards;
+    stats->busy += local.busy;
+    stats->starved += local.starved;
+    stats->blocked += local.blocked;
+    bool last = --b->running[id] == 0;
+    pthread_mutex_unlock(&b->lock);
+    if (last && out) { __queue_close(out); }
+    return NULL;
+}
+
+/**
+ * Runs the jobs through the pipeline and fills in their results, the
+ * stats of each stage and the total time in seconds. Returns false if any
+ * job failed or the stages cannot be started.
+ */
+bool batch_run(struct batch_job* jobs, size_t count, const struct batch_options* options,
+               struct batch_stage_stats* stats, double* time) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < count; i++) {
+        jobs[i].ok = false;
+        jobs[i].error = 0;
+        jobs[i].generations = 0;
+    }
+    memset(stats, 0, BATCH_STAGES * sizeof(struct batch_stage_stats));
+
+    struct __batch b = {0};
+    b.jobs = jobs;
+    b.count = count;
+    b.sim_threads = options->sim_threads;
+    b.stats = stats;
+    pthread_mutex_init(&b.lock, NULL);
+    size_t depth = options->depth ? options->depth : BATCH_DEFAULT_DEPTH;
+    bool ok = true;
+    for (size_t s = 0; s < BATCH_STAGES - 1; s++) { ok = __queue_init(&b.queues[s], depth) && ok; }
+
+    // One thread per stage except for the encoders
+    stats[BATCH_READ].threads = stats[BATCH_SIMULATE].threads = stats[BATCH_WRITE].threads = 1;
+    stats[BATCH_ENCODE].threads = options->encode_threads ? options->encode_threads : 1;
+    size_t total = 0;
+    for (size_t s = 0; s < BATCH_STAGES; s++) { total += stats[s].threads; }
+    pthread_t* threads = (pthread_t*)malloc(total * sizeof(pthread_t));
+    struct __stage* stages = (struct __stage*)malloc(total * sizeof(struct __stage));
+    size_t started = 0;
+    ok = ok && threads && stages;
+    for (size_t s = 0, k = 0; s < BATCH_STAGES && ok; s++) {
+        b.running[s] = stats[s].threads;
+        for (size_t i = 0; i < stats[s].threads; i++, k++) {
+            stages[k].batch = &b;
+            stages[k].id = (enum batch_stage)s;
+        }
+    }
+    // Starting from the writer, so if a thread cannot be created the reader
+    // has not started and closing the queues stops the stages that did
+    for (; started < total && ok; started++) {
+        ok = pthread_create(&threads[started], NULL, __stage_thread, &stages[total - 1 - started]) == 0;
+        if (!ok) { break; }
+    }
+    if (!ok) {
+        for (size_t s = 0; s < BATCH_STAGES - 1; s++) { __queue_close(&b.queues[s]); }
+    }
+    for (size_t i = 0; i < started; i++) { pthread_join(threads[i], NULL); }
+
+    for (size_t i = 0; i < count; i++) { ok = ok && jobs[i].ok; }
+    free(threads);
+    free(stages);
+    for (size_t s = 0; s < BATCH_STAGES - 1; s++) { __queue_destroy(&b.queues[s]); }
+    pthread_mutex_destroy(&b.lock);
+    *time = __seconds(&start);
+    return ok;
+}
+
+/**
+ * Prints the utilization of each stage.
+ */
+void batch_print_stats(const struct batch_stage_stats* stats, double time) {
+    static const char* names[BATCH_STAGES] = { "read", "simulate", "encode", "write" };
+    size_t limit = 0;
+    for (size_t s = 0; s < BATCH_STAGES; s++) {
+        const struct batch_stage_stats* st = &stats[s];
+        double wall = time * st->threads;
+        printf("%-8s threads %zu, boards %zu, busy %5.1f%%, starved %5.1f%%, blocked %5.1f%%\n",
+            names[s], st->threads, st->boards,
+            wall > 0 ? 100 * st->busy / wall : 0, wall > 0 ? 100 * st->starved / wall : 0,
+            wall > 0 ? 100 * st->blocked / wall : 0);
+        if (st->busy / st->threads > stats[limit].busy / stats[limit].threads) { limit = s; }
+    }
+    double sequential = 0;
+    for (size_t s = 0; s < BATCH_STAGES; s++) { sequential += stats[s].busy; }
+    printf("Limited by: %s, overlap saved ", names[limit]);
+    print_time(sequential > time ? sequential - time : 0);
+    printf(" of running the stages in turn\n");
+}
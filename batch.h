@@ -0,0 +1,75 @@
+/**
+ * A pipeline for running many boards, so reading, simulating, encoding and
+ * writing overlap instead of taking turns:
+ *
+ *     read      loads the next boards ahead of time (all of their pages)
+ *     simulate  steps a board on the worker threads of life_run()
+ *     encode    makes the output: a NPY header, or a compressed file for
+ *               outputs ending in .lz (see lz.h)
+ *     write     writes the outputs
+ *
+ * Stages hand boards over through bounded queues, so at most a few boards
+ * are in memory at once and a slow stage holds the others back. Each stage
+ * measures the time it is busy, starved (waiting for a board) and blocked
+ * (waiting for room in the next queue), so the limiting stage shows up as
+ * the one that is busy all the time.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A board to run. The results are filled in by batch_run().
+ */
+struct batch_job {
+    const char* input_file;
+    const char* output_file;
+    size_t iterations;
+
+    bool ok;            // the output was written
+    int error;          // errno of the failure otherwise
+    size_t generations; // generations reached
+};
+
+enum batch_stage { BATCH_READ, BATCH_SIMULATE, BATCH_ENCODE, BATCH_WRITE, BATCH_STAGES };
+
+/**
+ * Times of a stage, in seconds summed over its threads.
+ */
+struct batch_stage_stats {
+    size_t threads;
+    size_t boards;
+    double busy;    // working on a board
+    double starved; // waiting for a board from the previous stage
+    double blocked; // waiting for room in the queue to the next stage
+};
+
+struct batch_options {
+    size_t depth;          // boards each queue holds, 0 for 2
+    size_t sim_threads;    // threads of each simulation, 0 uses the CPU quota
+    size_t encode_threads; // 0 for 1
+};
+
+/**
+ * Runs the jobs through the pipeline and fills in their results, the
+ * stats of each stage and the total time in seconds. Returns false if any
+ * job failed or the stages cannot be started.
+ */
+bool batch_run(struct batch_job* jobs, size_t count, const struct batch_options* options,
+               struct batch_stage_stats* stats, double* time);
+
+/**
+ * Prints the utilization of each stage.
+ */
+void batch_print_stats(const struct batch_stage_stats* stats, double time);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,69 @@
+/**
+ * Run budgets: stop a simulation at the last generation boundary that fits
+ * a wall-clock deadline, an amount of CPU time, or a number of cell updates,
+ * instead of after a fixed number of iterations.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "budget.h"
+#include "util.h"
+
+/**
+ * Parses a duration like "200ms", "1.5s", "250us" or "2" (seconds) into
+ * seconds. Returns false if it is not a positive duration.
+ */
+bool parse_duration(const char* str, double* seconds) {
+    char* unit;
+    double val = strtod(str, &unit);
+    if (unit == str || val <= 0) { return false; }
+    if (*unit == 0 || strcmp(unit, "s") == 0) { *seconds = val; }
+    else if (strcmp(unit, "ms") == 0) { *seconds = val / 1000.0; }
+    else if (strcmp(unit, "us") == 0) { *seconds = val / 1000000.0; }
+    else if (strcmp(unit, "ns") == 0) { *seconds = val / 1000000000.0; }
+    else if (strcmp(unit, "m") == 0) { *seconds = val * 60.0; }
+    else { return false; }
+    return true;
+}
+
+static clockid_t __budget_clock(const struct run_budget* budget) {
+    return budget->kind == BUDGET_CPU ? CLOCK_PROCESS_CPUTIME_ID : CLOCK_MONOTONIC;
+}
+
+/**
+ * Sets up a budget of the given kind. BUDGET_NONE ignores the limit.
+ */
+void budget_init(struct run_budget* budget, enum budget_kind kind, double limit) {
+    budget->kind = kind;
+    budget->limit = limit;
+    memset(&budget->start, 0, sizeof(budget->start));
+}
+
+/**
+ * Starts the clock of a wall-clock or CPU time budget. Call this right
+ * before the first generation.
+ */
+void budget_start(struct run_budget* budget) {
+    clock_gettime(__budget_clock(budget), &budget->start);
+}
+
+/**
+ * Checks at a generation boundary, after the given number of generations of
+ * an m*n = grid_size grid, whether the next generation would exceed the
+ * budget. Time budgets assume the next generation takes as long as the
+ * average one so far.
+ */
+bool budget_exhausted(const struct run_budget* budget, size_t generations, size_t grid_size) {
+    if (budget->kind == BUDGET_NONE) { return false; }
+    if (budget->kind == BUDGET_CELLS) { return (generations + 1) * (double)grid_size > budget->limit; }
+    struct timespec now;
+    clock_gettime(__budget_clock(budget), &now);
+    double elapsed = get_time_diff((struct timespec*)&budget->start, &now);
+    double per_generation = generations ? elapsed / generations : 0.0;
+    return elapsed + per_generation > budget->limit;
+}
@@ -0,0 +1,57 @@
+/**
+ * Run budgets: stop a simulation at the last generation boundary that fits
+ * a wall-clock deadline, an amount of CPU time, or a number of cell updates,
+ * instead of after a fixed number of iterations.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum budget_kind {
+    BUDGET_NONE,  // only the iteration count limits the run
+    BUDGET_WALL,  // seconds of wall-clock time
+    BUDGET_CPU,   // seconds of CPU time of all threads of the process
+    BUDGET_CELLS, // cell updates
+};
+
+struct run_budget {
+    enum budget_kind kind;
+    double limit;
+    struct timespec start; // set by budget_start()
+};
+
+/**
+ * Parses a duration like "200ms", "1.5s", "250us" or "2" (seconds) into
+ * seconds. Returns false if it is not a positive duration.
+ */
+bool parse_duration(const char* str, double* seconds);
+
+/**
+ * Sets up a budget of the given kind. BUDGET_NONE ignores the limit.
+ */
+void budget_init(struct run_budget* budget, enum budget_kind kind, double limit);
+
+/**
+ * Starts the clock of a wall-clock or CPU time budget. Call this right
+ * before the first generation.
+ */
+void budget_start(struct run_budget* budget);
+
+/**
+ * Checks at a generation boundary, after the given number of generations of
+ * an m*n = grid_size grid, whether the next generation would exceed the
+ * budget. Time budgets assume the next generation takes as long as the
+ * average one so far.
+ */
+bool budget_exhausted(const struct run_budget* budget, size_t generations, size_t grid_size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,319 @@
+/**
+ * Content-addressed cache of simulation results, see cache.h.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "cache.h"
+#include "util.h"
+
+#define CACHE_BUCKETS 1024
+
+struct __cache_entry {
+    struct cache_key key;
+    size_t generations;
+    uint8_t* result;
+    struct __cache_entry* bucket_next;        // chain of entries with the same bucket
+    struct __cache_entry* lru_prev, * lru_next; // most recently used first
+};
+
+struct result_cache {
+    char* dir;
+    size_t memory_limit, memory_used;
+    struct __cache_entry* buckets[CACHE_BUCKETS];
+    struct __cache_entry* lru_head, * lru_tail;
+    struct cache_stats stats;
+};
+
+////////// Hashing //////////
+
+static inline uint64_t __rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static inline uint64_t __fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdull;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ull;
+    k ^= k >> 33;
+    return k;
+}
+
+/**
+ * Computes the 128-bit MurmurHash3 (x64 variant) of some data.
+ */
+void hash128(const void* data, size_t len, uint64_t seed, uint64_t out[2]) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    const uint64_t c1 = 0x87c37b91114253d5ull, c2 = 0x4cf5ad432745937full;
+    uint64_t h1 = seed, h2 = seed;
+
+    // body, 16 bytes at a time
+    size_t n_blocks = len / 16;
+    for (size_t i = 0; i < n_blocks; i++) {
+        uint64_t k1, k2;
+        memcpy(&k1, bytes + i*16, 8); // assumes running on little-endian
+        memcpy(&k2, bytes + i*16 + 8, 8);
+        k1 *= c1; k1 = __rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = __rotl64(h1, 27); h1 += h2; h1 = h1*5 + 0x52dce729;
+        k2 *= c2; k2 = __rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = __rotl64(h2, 31); h2 += h1; h2 = h2*5 + 0x38495ab5;
+    }
+
+    // tail, the last 0 to 15 bytes
+    const uint8_t* tail = bytes + n_blocks*16;
+    uint64_t k1 = 0, k2 = 0;
+    size_t rest = len & 15;
+    for (size_t i = rest; i > 8; i--) { k2 ^= (uint64_t)tail[i-1] << ((i-9)*8); }
+    for (size_t i = rest < 8 ? rest : 8; i > 0; i--) { k1 ^= (uint64_t)tail[i-1] << ((i-1)*8); }
+    if (rest > 8) { k2 *= c2; k2 = __rotl64(k2, 33); k2 *= c1; h2 ^= k2; }
+    if (rest > 0) { k1 *= c1; k1 = __rotl64(k1, 31); k1 *= c2; h1 ^= k1; }
+
+    // finalization
+    h1 ^= len; h2 ^= len;
+    h1 += h2; h2 += h1;
+    h1 = __fmix64(h1); h2 = __fmix64(h2);
+    h1 += h2; h2 += h1;
+    out[0] = h1;
+    out[1] = h2;
+}
+
+/**
+ * Computes the key of an m by n board run with the given rule.
+ */
+void cache_key(struct cache_key* key, const uint8_t* board, size_t m, size_t n, const char* rule) {
+    // the shape and rule seed the hash so equal bytes of another shape differ
+    uint64_t params[2];
+    hash128(rule, strlen(rule), m * 0x9e3779b97f4a7c15ull ^ n, params);
+    hash128(board, m * n, params[0] ^ params[1], key->hash);
+    key->m = m;
+    key->n = n;
+}
+
+////////// Memory tier //////////
+
+static inline bool __key_equal(const struct cache_key* a, const struct cache_key* b) {
+    return a->hash[0] == b->hash[0] && a->hash[1] == b->hash[1] && a->m == b->m && a->n == b->n;
+}
+
+static inline struct __cache_entry** __bucket(struct result_cache* cache, const struct cache_key* key) {
+    return &cache->buckets[key->hash[0] % CACHE_BUCKETS];
+}
+
+static void __lru_unlink(struct result_cache* cache, struct __cache_entry* e) {
+    if (e->lru_prev) { e->lru_prev->lru_next = e->lru_next; } else { cache->lru_head = e->lru_next; }
+    if (e->lru_next) { e->lru_next->lru_prev = e->lru_prev; } else { cache->lru_tail = e->lru_prev; }
+    e->lru_prev = e->lru_next = NULL;
+}
+
+static void __lru_push_front(struct result_cache* cache, struct __cache_entry* e) {
+    e->lru_prev = NULL;
+    e->lru_next = cache->lru_head;
+    if (cache->lru_head) { cache->lru_head->lru_prev = e; } else { cache->lru_tail = e; }
+    cache->lru_head = e;
+}
+
+static void __remove_entry(struct result_cache* cache, struct __cache_entry* e) {
+    struct __cache_entry** link = __bucket(cache, &e->key);
+    while (*link != e) { link = &(*link)->bucket_next; }
+    *link = e->bucket_next;
+    __lru_unlink(cache, e);
+    cache->memory_used -= e->key.m * e->key.n;
+    free(e->result);
+    free(e);
+}
+
+/**
+ * Finds the entry with the most generations up to the given count.
+ */
+static struct __cache_entry* __memory_find(struct result_cache* cache,
+                                           const struct cache_key* key, size_t generations) {
+    struct __cache_entry* best = NULL;
+    for (struct __cache_entry* e = *__bucket(cache, key); e; e = e->bucket_next) {
+        if (__key_equal(&e->key, key) && e->generations <= generations &&
+            (!best || e->generations > best->generations)) {
+            best = e;
+        }
+    }
+    return best;
+}
+
+static void __memory_insert(struct result_cache* cache, const struct cache_key* key,
+                            size_t generations, const uint8_t* result) {
+    size_t size = key->m * key->n;
+    if (size > cache->memory_limit) { return; }
+    struct __cache_entry* e = __memory_find(cache, key, generations);
+    if (e && e->generations == generations) {
+        __lru_unlink(cache, e);
+        __lru_push_front(cache, e);
+        return;
+    }
+    while (cache->memory_used + size > cache->memory_limit && cache->lru_tail) {
+        __remove_entry(cache, cache->lru_tail);
+        cache->stats.evictions++;
+    }
+    e = (struct __cache_entry*)calloc(1, sizeof(struct __cache_entry));
+    if (!e) { return; }
+    e->result = (uint8_t*)malloc(size);
+    if (!e->result) { free(e); return; }
+    memcpy(e->result, result, size);
+    e->key = *key;
+    e->generations = generations;
+    struct __cache_entry** bucket = __bucket(cache, key);
+    e->bucket_next = *bucket;
+    *bucket = e;
+    __lru_push_front(cache, e);
+    cache->memory_used += size;
+}
+
+////////// Disk tier //////////
+
+/**
+ * Get the directory holding the results of one key.
+ */
+static void __key_dir(const struct result_cache* cache, const struct cache_key* key,
+                      char* path, size_t size) {
+    snprintf(path, size, "%s/%016llx%016llx-%zux%zu", cache->dir,
+             (unsigned long long)key->hash[0], (unsigned long long)key->hash[1], key->m, key->n);
+}
+
+/**
+ * Finds the stored result with the most generations up to the given count
+ * and copies it into out. Returns its generations or 0 if there is none.
+ */
+static size_t __disk_load(struct result_cache* cache, const struct cache_key* key,
+                          size_t generations, uint8_t* out) {
+    char dir_path[1024], path[1100];
+    __key_dir(cache, key, dir_path, sizeof(dir_path));
+    DIR* dir = opendir(dir_path);
+    if (!dir) { return 0; }
+    size_t best = 0, gens;
+    struct dirent* ent;
+    while ((ent = readdir(dir))) {
+        int len = 0; // skips the temporary files of writes in progress
+        if (sscanf(ent->d_name, "%zu.npy%n", &gens, &len) == 1 && len && !ent->d_name[len] &&
+            gens <= generations && gens > best) {
+            best = gens;
+        }
+    }
+    closedir(dir);
+    if (!best) { return 0; }
+
+    snprintf(path, sizeof(path), "%s/%zu.npy", dir_path, best);
+    size_t m, n;
+    uint8_t* grid = grid_from_npy_path(path, &m, &n);
+    if (!grid) { return 0; }
+    bool ok = m == key->m && n == key->n;
+    if (ok) { memcpy(out, grid, m * n); }
+    size_t addr = ((size_t)grid) & ~(sysconf(_SC_PAGE_SIZE)-1);
+    munmap((void*)addr, (size_t)grid - addr + m*n);
+    return ok ? best : 0;
+}
+
+static bool __disk_store(struct result_cache* cache, const struct cache_key* key,
+                         size_t generations, const uint8_t* result) {
+    char dir_path[1024], path[1100], tmp[1100];
+    __key_dir(cache, key, dir_path, sizeof(dir_path));
+    if (mkdir(dir_path, 0755) != 0 && errno != EEXIST) { return false; }
+    snprintf(path, sizeof(path), "%s/%zu.npy", dir_path, generations);
+    snprintf(tmp, sizeof(tmp), "%s/%zu.npy.%ld.tmp", dir_path, generations, (long)getpid());
+    // write then rename so concurrent runs never see a partial result
+    if (!grid_to_npy_path(tmp, result, 1, key->m, key->n)) { unlink(tmp); return false; }
+    return rename(tmp, path) == 0;
+}
+
+////////// Cache //////////
+
+/**
+ * Creates a cache holding at most memory_limit bytes of results in memory.
+ * If dir is not NULL results are also kept in that directory, which is
+ * created if needed. Returns NULL if the directory cannot be created.
+ */
+struct result_cache* cache_open(const char* dir, size_t memory_limit) {
+    if (dir && mkdir(dir, 0755) != 0 && errno != EEXIST) { return NULL; }
+    struct result_cache* cache = (struct result_cache*)calloc(1, sizeof(struct result_cache));
+    if (!cache) { return NULL; }
+    cache->dir = dir ? strdup(dir) : NULL;
+    cache->memory_limit = memory_limit;
+    return cache;
+}
+
+/**
+ * Frees the cache. The disk tier is kept.
+ */
+void cache_close(struct result_cache* cache) {
+    if (!cache) { return; }
+    while (cache->lru_head) { __remove_entry(cache, cache->lru_head); }
+    free(cache->dir);
+    free(cache);
+}
+
+/**
+ * Looks up the result with the most generations, up to the given count, for
+ * the key. The m by n result is copied into out. Returns the generations of
+ * the result or 0 if there is none.
+ */
+size_t cache_lookup(struct result_cache* cache, const struct cache_key* key,
+                    size_t generations, uint8_t* out) {
+    size_t found = 0;
+    struct __cache_entry* e = __memory_find(cache, key, generations);
+    if (e) {
+        found = e->generations;
+        memcpy(out, e->result, key->m * key->n);
+        __lru_unlink(cache, e);
+        __lru_push_front(cache, e);
+    }
+    // the disk may hold a longer run than memory
+    if (cache->dir && found < generations) {
+        size_t on_disk = __disk_load(cache, key, generations, out);
+        if (on_disk > found) {
+            // out may now be partly overwritten by a shorter run, so use the disk result
+            found = on_disk;
+            cache->stats.disk_reads++;
+            __memory_insert(cache, key, found, out);
+        } else if (on_disk) {
+            memcpy(out, e->result, key->m * key->n);
+        }
+    }
+    if (found == generations) { cache->stats.hits++; }
+    else if (found) { cache->stats.prefix_hits++; }
+    else { cache->stats.misses++; }
+    return found;
+}
+
+/**
+ * Adds the result of running the board of the key for the given generations.
+ * Returns false if it could not be written to the disk tier.
+ */
+bool cache_store(struct result_cache* cache, const struct cache_key* key,
+                 size_t generations, const uint8_t* result) {
+    if (generations == 0) { return true; } // the board itself
+    cache->stats.stores++;
+    __memory_insert(cache, key, generations, result);
+    return !cache->dir || __disk_store(cache, key, generations, result);
+}
+
+/**
+ * Get the hit and miss counts of the cache.
+ */
+void cache_get_stats(const struct result_cache* cache, struct cache_stats* stats) {
+    *stats = cache->stats;
+}
+
+/**
+ * Prints the hit and miss counts of the cache.
+ */
+void cache_print_stats(const struct result_cache* cache) {
+    const struct cache_stats* s = &cache->stats;
+    printf("Cache: %zu hits, %zu prefix hits, %zu misses, %zu from disk, %zu stores, %zu evictions, ",
+           s->hits, s->prefix_hits, s->misses, s->disk_reads, s->stores, s->evictions);
+    print_bytes(cache->memory_used);
+    printf(" in memory\n");
+}
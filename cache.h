@@ -0,0 +1,96 @@
+/**
+ * Content-addressed cache of simulation results. A result is keyed by a
+ * 128-bit hash of the starting board together with its shape and the rule,
+ * and stored per number of generations. A lookup returns the result with the
+ * most generations that does not exceed the requested count, so a cached
+ * 500-generation result seeds a 1000-generation run.
+ *
+ * There are two tiers: an in-memory LRU limited by bytes, and an optional
+ * directory on disk with one NPY file per result.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The only rule implemented by the engines, it is part of every key
+#define CACHE_RULE_CONWAY "B3/S23"
+
+// Memory tier size used by the game_of_life_* executables
+#define CACHE_DEFAULT_MEMORY_LIMIT ((size_t)256 << 20)
+
+/**
+ * Identifies a starting board, its shape and the rule it is run with.
+ */
+struct cache_key {
+    uint64_t hash[2];
+    size_t m, n;
+};
+
+struct cache_stats {
+    size_t hits;         // lookups answered with exactly the requested generations
+    size_t prefix_hits;  // lookups answered with fewer generations
+    size_t misses;       // lookups without any usable result
+    size_t disk_reads;   // results that came from the disk tier
+    size_t stores;       // results added
+    size_t evictions;    // results dropped from memory to stay in the limit
+};
+
+struct result_cache;
+
+/**
+ * Computes the 128-bit MurmurHash3 (x64 variant) of some data.
+ */
+void hash128(const void* data, size_t len, uint64_t seed, uint64_t out[2]);
+
+/**
+ * Computes the key of an m by n board run with the given rule.
+ */
+void cache_key(struct cache_key* key, const uint8_t* board, size_t m, size_t n, const char* rule);
+
+/**
+ * Creates a cache holding at most memory_limit bytes of results in memory.
+ * If dir is not NULL results are also kept in that directory, which is
+ * created if needed. Returns NULL if the directory cannot be created.
+ */
+struct result_cache* cache_open(const char* dir, size_t memory_limit);
+
+/**
+ * Frees the cache. The disk tier is kept.
+ */
+void cache_close(struct result_cache* cache);
+
+/**
+ * Looks up the result with the most generations, up to the given count, for
+ * the key. The m by n result is copied into out. Returns the generations of
+ * the result or 0 if there is none.
+ */
+size_t cache_lookup(struct result_cache* cache, const struct cache_key* key,
+                    size_t generations, uint8_t* out);
+
+/**
+ * Adds the result of running the board of the key for the given generations.
+ * Returns false if it could not be written to the disk tier.
+ */
+bool cache_store(struct result_cache* cache, const struct cache_key* key,
+                 size_t generations, const uint8_t* result);
+
+/**
+ * Get the hit and miss counts of the cache.
+ */
+void cache_get_stats(const struct result_cache* cache, struct cache_stats* stats);
+
+/**
+ * Prints the hit and miss counts of the cache.
+ */
+void cache_print_stats(const struct result_cache* cache);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,275 @@
+/**
+ * Cost model of a run, see cost_model.h.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cost_model.h"
+#include "governor.h"
+#include "helpers.h"
+#include "util.h"
+
+#define COST_MODEL_FILE ".gol_cost_model"
+#define COST_SAMPLE_ROWS 64
+#define COST_CALIBRATE_SIZE 256           // side of the board the dense engine is timed on
+#define COST_CALIBRATE_TIME 0.02          // seconds to time it for
+#define COST_CALIBRATE_WRITE (16 << 20)   // bytes written to time the output
+#define COST_LEARNING_RATE 0.3            // weight of a new run in the coefficients
+#define COST_MIN_OBSERVED_TIME 0.001      // runs shorter than this are all noise
+
+/**
+ * Get the path the model is kept at.
+ */
+const char* cost_model_path() {
+    static char path[4096];
+    const char* env = getenv("GOL_COST_MODEL");
+    if (env && *env) { return env; }
+    const char* home = getenv("HOME");
+    snprintf(path, sizeof(path), "%s/%s", home && *home ? home : ".", COST_MODEL_FILE);
+    return path;
+}
+
+/**
+ * Get whether runs should calibrate and correct the model, which is opted
+ * into with $GOL_COST_LEARN.
+ */
+bool cost_model_learning() {
+    const char* env = getenv("GOL_COST_LEARN");
+    return env && *env && strcmp(env, "0") != 0;
+}
+
+static void __defaults(struct cost_model* model) {
+    memset(model, 0, sizeof(*model));
+    model->cell_ns = 2.0;
+    model->boundary_ns = 10.0;
+    model->parallel_efficiency = 0.8;
+    model->write_rate = 1e9;
+    model->memory_overhead = 2 << 20;
+}
+
+/**
+ * Loads the model, or sets default coefficients. Returns false if there is
+ * no model file yet (or it cannot be read), so it should be calibrated.
+ */
+bool cost_model_load(struct cost_model* model, const char* path) {
+    __defaults(model);
+    FILE* f = fopen(path, "r");
+    if (!f) { return false; }
+    char name[64];
+    double value;
+    while (fscanf(f, "%63s %lf", name, &value) == 2) {
+        if (strcmp(name, "cell_ns") == 0) { model->cell_ns = value; }
+        else if (strcmp(name, "boundary_ns") == 0) { model->boundary_ns = value; }
+        else if (strcmp(name, "parallel_efficiency") == 0) { model->parallel_efficiency = value; }
+        else if (strcmp(name, "write_rate") == 0) { model->write_rate = value; }
+        else if (strcmp(name, "memory_overhead") == 0) { model->memory_overhead = value; }
+        else if (strcmp(name, "cell_samples") == 0) { model->cell_samples = (size_t)value; }
+        else if (strcmp(name, "boundary_samples") == 0) { model->boundary_samples = (size_t)value; }
+        else if (strcmp(name, "parallel_samples") == 0) { model->parallel_samples = (size_t)value; }
+        else if (strcmp(name, "observed") == 0) { model->observed = (size_t)value; }
+        else if (strcmp(name, "time_error") == 0) { model->time_error = value; }
+        else if (strcmp(name, "memory_error") == 0) { model->memory_error = value; }
+    }
+    fclose(f);
+    return true;
+}
+
+/**
+ * Saves the model. It is written to a temporary file that replaces the old
+ * one, so concurrent runs never load a partial model. Returns false if it
+ * cannot be written.
+ */
+bool cost_model_save(const struct cost_model* model, const char* path) {
+    char tmp[4200];
+    snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+    FILE* f = fopen(tmp, "w");
+    if (!f) { return false; }
+    fprintf(f, "cell_ns %.6g\nboundary_ns %.6g\nparallel_efficiency %.4f\nwrite_rate %.6g\n"
+               "memory_overhead %.0f\ncell_samples %zu\nboundary_samples %zu\nparallel_samples %zu\n"
+               "observed %zu\ntime_error %.4f\nmemory_error %.4f\n",
+            model->cell_ns, model->boundary_ns, model->parallel_efficiency, model->write_rate,
+            model->memory_overhead, model->cell_samples, model->boundary_samples, model->parallel_samples,
+            model->observed, model->time_error, model->memory_error);
+    bool ok = !ferror(f);
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0) { unlink(tmp); return false; }
+    return true;
+}
+
+static double __now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+/**
+ * Measures the dense engine and the write rate of this machine, which takes
+ * a few tens of milliseconds. The other coefficients are left to the runs.
+ */
+void cost_model_calibrate(struct cost_model* model) {
+    // A half-full board stepped with update() like game_of_life_serial does
+    size_t size = COST_CALIBRATE_SIZE * COST_CALIBRATE_SIZE;
+    uint8_t* grid = (uint8_t*)malloc(size);
+    uint8_t* grid_next = (uint8_t*)malloc(size);
+    if (grid && grid_next) {
+        uint32_t x = 2463534242u;
+        for (size_t i = 0; i < size; i++) { x ^= x << 13; x ^= x >> 17; x ^= x << 5; grid[i] = x & 1; }
+        size_t generations = 0;
+        double start = __now(), elapsed;
+        do {
+            for (size_t i = 0; i < size; i++) { update(grid, grid_next, i, COST_CALIBRATE_SIZE, COST_CALIBRATE_SIZE); }
+            swap(&grid, &grid_next);
+            generations++;
+        } while ((elapsed = __now() - start) < COST_CALIBRATE_TIME);
+        model->cell_ns = elapsed * 1e9 / (generations * (double)size);
+        model->cell_samples = 1;
+    }
+    free(grid);
+    free(grid_next);
+
+    // Writing to a temporary file, which mostly measures the page cache like a real output does
+    FILE* f = tmpfile();
+    uint8_t* data = (uint8_t*)calloc(1, COST_CALIBRATE_WRITE);
+    if (f && data) {
+        double start = __now();
+        if (fwrite(data, 1, COST_CALIBRATE_WRITE, f) == COST_CALIBRATE_WRITE && fflush(f) == 0) {
+            double elapsed = __now() - start;
+            if (elapsed > 0) { model->write_rate = COST_CALIBRATE_WRITE / elapsed; }
+        }
+    }
+    if (f) { fclose(f); }
+    free(data);
+}
+
+/**
+ * Get the fraction of live cells of a sample of up to 64 rows of a grid.
+ */
+double cost_density_sample(const uint8_t* grid, size_t m, size_t n) {
+    size_t rows = m < COST_SAMPLE_ROWS ? m : COST_SAMPLE_ROWS, alive = 0;
+    if (!rows || !n) { return 0; }
+    for (size_t k = 0; k < rows; k++) {
+        const uint8_t* row = grid + (k * m / rows) * n;
+        for (size_t j = 0; j < n; j++) { alive += row[j] != 0; }
+    }
+    return alive / (double)(rows * n);
+}
+
+/**
+ * Predicts a run of an m by n grid with the given density for the given
+ * number of generations, that writes output_bytes and keeps history_frames
+ * generations in memory (0 if nothing is buffered).
+ */
+void cost_estimate(const struct cost_model* model, struct cost_estimate* e,
+                   enum cost_engine engine, size_t m, size_t n, double density,
+                   size_t generations, size_t num_threads, size_t output_bytes,
+                   size_t history_frames) {
+    e->engine = engine;
+    e->num_threads = num_threads ? num_threads : 1;
+    e->density = density;
+    if (engine == COST_ENGINE_RLE) {
+        // a random row of density d has about n*d*(1-d) runs, each has 2 boundaries
+        double boundaries = m * (1 + 2 * n * density * (1 - density));
+        e->work = boundaries * generations;
+        e->simulate_time = e->work * model->boundary_ns * 1e-9;
+        e->num_threads = 1;
+        // the mapped input, the dense output and two grids of runs
+        e->grid_memory = 2 * m * n + (size_t)(2 * boundaries * sizeof(uint32_t)) + 2 * m * 3 * sizeof(size_t);
+    } else {
+        e->work = (double)m * n * generations;
+        double speedup = 1 + model->parallel_efficiency * (e->num_threads - 1);
+        e->simulate_time = e->work * model->cell_ns * 1e-9 / speedup;
+        e->grid_memory = predict_memory(m, n, history_frames);
+    }
+    e->write_time = output_bytes / model->write_rate;
+    e->time = e->simulate_time + e->write_time;
+    e->peak_memory = e->grid_memory + (size_t)model->memory_overhead;
+}
+
+/**
+ * Adds a measurement to a coefficient: the first few are averaged so a
+ * default is replaced right away, later ones move it by the learning rate.
+ */
+static inline double __blend(double old, double observed, size_t* samples) {
+    double rate = 1.0 / (*samples + 1);
+    if (rate < COST_LEARNING_RATE) { rate = COST_LEARNING_RATE; }
+    (*samples)++;
+    return (1 - rate) * old + rate * observed;
+}
+
+/**
+ * Corrects the model with a real run that was predicted by the estimate
+ * (made for the generations it actually ran), its simulation time in
+ * seconds and its peak resident memory. Only plain runs of the engine
+ * should be observed, work the model does not know about (like replay,
+ * spaceship removal, compression or streaming) skews its coefficients.
+ */
+void cost_model_observe(struct cost_model* model, const struct cost_estimate* e,
+                        double simulate_time, size_t peak_memory) {
+    if (simulate_time < COST_MIN_OBSERVED_TIME || e->work <= 0) { return; }
+    double time_error = fabs(e->simulate_time - simulate_time) / simulate_time;
+    double memory_error = peak_memory ? fabs((double)e->peak_memory - peak_memory) / peak_memory : 0;
+    model->time_error = (model->time_error * model->observed + time_error) / (model->observed + 1);
+    model->memory_error = (model->memory_error * model->observed + memory_error) / (model->observed + 1);
+    model->observed++;
+
+    // A serial run corrects the coefficient of its engine, a parallel one how well threads scale
+    double per_unit = simulate_time * 1e9 / e->work;
+    if (e->engine == COST_ENGINE_RLE) {
+        model->boundary_ns = __blend(model->boundary_ns, per_unit, &model->boundary_samples);
+    } else if (e->num_threads == 1) {
+        model->cell_ns = __blend(model->cell_ns, per_unit, &model->cell_samples);
+    } else {
+        double efficiency = (model->cell_ns / per_unit - 1) / (e->num_threads - 1);
+        if (efficiency < 0.05) { efficiency = 0.05; }
+        if (efficiency > 1) { efficiency = 1; }
+        model->parallel_efficiency = __blend(model->parallel_efficiency, efficiency, &model->parallel_samples);
+    }
+    if (peak_memory > e->grid_memory) {
+        size_t samples = model->observed; // a measurement of every run
+        model->memory_overhead = __blend(model->memory_overhead, (double)(peak_memory - e->grid_memory), &samples);
+    }
+}
+
+/**
+ * Prints an estimate and how accurate the model has been.
+ */
+void print_cost_estimate(const struct cost_model* model, const struct cost_estimate* e) {
+    printf("Estimate: %s engine, %zu threads, density %.3f: ",
+           e->engine == COST_ENGINE_RLE ? "rle" : "dense", e->num_threads, e->density);
+    print_time(e->time);
+    printf(" (simulate ");
+    print_time(e->simulate_time);
+    printf(", write ");
+    print_time(e->write_time);
+    printf("), peak memory ");
+    print_bytes(e->peak_memory);
+    printf("\n");
+    if (model->observed) {
+        printf("Model: corrected by %zu runs, mean error %.1f%% in time and %.1f%% in memory\n",
+               model->observed, 100 * model->time_error, 100 * model->memory_error);
+    } else {
+        printf("Model: calibrated only, no runs observed yet\n");
+    }
+}
+
+/**
+ * Prints a prediction next to what the run took.
+ */
+void print_cost_observation(const struct cost_estimate* e, double simulate_time, size_t peak_memory) {
+    printf("Predicted ");
+    print_time(e->simulate_time);
+    printf(" and ");
+    print_bytes(e->peak_memory);
+    printf(", took ");
+    print_time(simulate_time);
+    printf(" and ");
+    print_bytes(peak_memory);
+    printf("\n");
+}
@@ -0,0 +1,123 @@
+/**
+ * Cost model of a run, for knowing how long a job takes and how much memory
+ * it needs before launching it.
+ *
+ * Time is predicted from per-machine throughput coefficients: nanoseconds
+ * per cell of a generation for the dense engine, per run boundary for the
+ * run-length engine (estimated from the density of the board), the gain of
+ * each extra thread and the write rate of the output. The coefficients start
+ * from a short calibration on the machine and are corrected after real runs,
+ * which also keeps the mean prediction error. They are kept in a small text
+ * file, $GOL_COST_MODEL or ~/.gol_cost_model. Plain runs only read it, the
+ * model is calibrated and saved by a dry run, or by any run while
+ * $GOL_COST_LEARN is set (to anything but 0).
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum cost_engine { COST_ENGINE_DENSE, COST_ENGINE_RLE };
+
+struct cost_model {
+    double cell_ns;             // dense engine on one thread, per cell per generation
+    double boundary_ns;         // run-length engine, per run boundary per generation
+    double parallel_efficiency; // speedup of each thread after the first
+    double write_rate;          // output bytes per second
+    double memory_overhead;     // bytes of the process besides the grids
+    size_t cell_samples, boundary_samples, parallel_samples; // measurements behind each coefficient
+    size_t observed;            // real runs the model was corrected with
+    double time_error;          // mean relative error of the observed runs
+    double memory_error;
+};
+
+/**
+ * A prediction for a run.
+ */
+struct cost_estimate {
+    enum cost_engine engine;
+    size_t num_threads;
+    double density;
+    double work;            // cells or run boundaries times generations
+    double simulate_time;   // seconds
+    double write_time;
+    double time;
+    size_t grid_memory;     // bytes of grids and history
+    size_t peak_memory;     // including the overhead of the process
+};
+
+/**
+ * Get the path the model is kept at.
+ */
+const char* cost_model_path();
+
+/**
+ * Get whether runs should calibrate and correct the model, which is opted
+ * into with $GOL_COST_LEARN.
+ */
+bool cost_model_learning();
+
+/**
+ * Loads the model, or sets default coefficients. Returns false if there is
+ * no model file yet (or it cannot be read), so it should be calibrated.
+ */
+bool cost_model_load(struct cost_model* model, const char* path);
+
+/**
+ * Saves the model. It is written to a temporary file that replaces the old
+ * one, so concurrent runs never load a partial model. Returns false if it
+ * cannot be written.
+ */
+bool cost_model_save(const struct cost_model* model, const char* path);
+
+/**
+ * Measures the dense engine and the write rate of this machine, which takes
+ * a few tens of milliseconds. The other coefficients are left to the runs.
+ */
+void cost_model_calibrate(struct cost_model* model);
+
+/**
+ * Get the fraction of live cells of a sample of up to 64 rows of a grid.
+ */
+double cost_density_sample(const uint8_t* grid, size_t m, size_t n);
+
+/**
+ * Predicts a run of an m by n grid with the given density for the given
+ * number of generations, that writes output_bytes and keeps history_frames
+ * generations in memory (0 if nothing is buffered).
+ */
+void cost_estimate(const struct cost_model* model, struct cost_estimate* estimate,
+                   enum cost_engine engine, size_t m, size_t n, double density,
+                   size_t generations, size_t num_threads, size_t output_bytes,
+                   size_t history_frames);
+
+/**
+ * Corrects the model with a real run that was predicted by the estimate
+ * (made for the generations it actually ran), its simulation time in
+ * seconds and its peak resident memory. Only plain runs of the engine
+ * should be observed, work the model does not know about (like replay,
+ * spaceship removal, compression or streaming) skews its coefficients.
+ */
+void cost_model_observe(struct cost_model* model, const struct cost_estimate* estimate,
+                        double simulate_time, size_t peak_memory);
+
+/**
+ * Prints an estimate and how accurate the model has been.
+ */
+void print_cost_estimate(const struct cost_model* model, const struct cost_estimate* estimate);
+
+/**
+ * Prints a prediction next to what the run took.
+ */
+void print_cost_observation(const struct cost_estimate* estimate, double simulate_time,
+                            size_t peak_memory);
+
+#ifdef __cplusplus
+}
+#endif
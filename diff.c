@@ -0,0 +1,370 @@
+/**
+ * Comparing boards and histories, see diff.h.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "matrix_io_helpers.h"
+#include "diff.h"
+#include "lz.h"
+#include "util.h"
+
+// Fewer bytes than this per thread are not worth another thread
+#define DIFF_CHUNK_MIN (4 << 20)
+
+/**
+ * Opens a NPY or compressed file. A NPY file whose rows are bit-packed needs
+ * the number of columns it was packed from in packed_cols, otherwise it is
+ * 0. Returns false if the file cannot be read or is not 1 to 3 dimensional
+ * uint8 or bool data in C order.
+ */
+bool diff_open(struct diff_input* input, const char* path, size_t packed_cols) {
+    memset(input, 0, sizeof(*input));
+    input->path = path;
+    if (is_lz_path(path)) {
+        // compressed frames are decompressed to bytes by each thread on its own
+        struct lz_file lz;
+        if (!lz_open(&lz, path)) { return false; }
+        input->frames = lz.frames;
+        input->m = lz.m;
+        input->n = lz.n;
+        input->compressed = true;
+        lz_close(&lz);
+        return true;
+    }
+
+    FILE* file = fopen(path, "rb");
+    if (!file) { return false; }
+    size_t dims[3], n_dims, offset;
+    struct __npy_dtype dtype;
+    if (!__npy_read_array_header(file, dims, &n_dims, &offset, &dtype)) { fclose(file); return false; }
+    if (dtype.kind != 'u' && dtype.kind != 'b') { dtype.itemsize = 0; }
+    if (dtype.itemsize != 1 || dtype.fortran_order || n_dims < 1) {
+        fclose(file);
+        errno = EINVAL;
+        return false;
+    }
+    // a row, a board, or a history
+    size_t frames = n_dims == 3 ? dims[0] : 1;
+    size_t m = n_dims == 3 ? dims[1] : n_dims == 2 ? dims[0] : 1;
+    input->row_bytes = dims[n_dims - 1];
+    input->frames = frames;
+    input->m = m;
+    input->n = input->row_bytes;
+    if (packed_cols) {
+        if ((packed_cols + 7) / 8 != input->row_bytes) { fclose(file); errno = EINVAL; return false; }
+        input->packed = true;
+        input->n = packed_cols;
+    }
+
+    struct stat st;
+    size_t size = offset + frames * m * input->row_bytes;
+    if (fstat(fileno(file), &st) != 0 || (size_t)st.st_size < size) {
+        fclose(file);
+        errno = EINVAL;
+        return false;
+    }
+    void* x = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(file), 0);
+    fclose(file);
+    if (x == MAP_FAILED) { return false; }
+    madvise(x, size, MADV_SEQUENTIAL);
+    input->map = x;
+    input->map_size = size;
+    input->data = (const uint8_t*)x + offset;
+    return true;
+}
+
+/**
+ * Closes a file opened with diff_open().
+ */
+void diff_close(struct diff_input* input) {
+    if (input->map) { munmap(input->map, input->map_size); }
+    input->map = NULL;
+    input->data = NULL;
+}
+
+/**
+ * Packs a row of 0/1 cells like numpy.packbits(): 8 cells per byte with the
+ * first cell in the highest bit, the last byte padded with 0s.
+ */
+static void __pack_row(const uint8_t* row, size_t n, uint8_t* packed) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t x;
+        memcpy(&x, row + i, 8);
+        x = __builtin_bswap64(x) & 0x0101010101010101ull; // the first cell goes to the top byte
+        packed[i / 8] = (uint8_t)((x * 0x0102040810204080ull) >> 56);
+    }
+    if (i < n) {
+        uint8_t b = 0;
+        for (size_t k = 0; i + k < n; k++) { b |= (row[i + k] & 1) << (7 - k); }
+        packed[i / 8] = b;
+    }
+}
+
+/**
+ * Where one side of a comparison gets its rows from, per thread.
+ */
+struct __source {
+    const struct diff_input* input;
+    struct lz_file lz;   // own handle on a compressed file
+    bool opened;
+    uint8_t* frame;      // the decompressed frame
+    size_t current;      // the frame in it
+    uint8_t* row;        // a packed row
+};
+
+static bool __source_init(struct __source* s, const struct diff_input* input, bool pack) {
+    memset(s, 0, sizeof(*s));
+    s->input = input;
+    s->current = SIZE_MAX;
+    if (input->compressed) {
+        if (!lz_open(&s->lz, input->path)) { return false; }
+        s->opened = true;
+        s->frame = (uint8_t*)malloc(input->m * input->n);
+        if (!s->frame) { return false; }
+    }
+    if (pack && !input->packed) {
+        s->row = (uint8_t*)malloc((input->n + 7) / 8);
+        if (!s->row) { return false; }
+    }
+    return true;
+}
+
+static void __source_free(struct __source* s) {
+    if (s->opened) { lz_close(&s->lz); }
+    free(s->frame);
+    free(s->row);
+}
+
+/**
+ * Gets a row of a frame, packed if the comparison is on bits. Returns NULL if
+ * a compressed frame cannot be read.
+ */
+static const uint8_t* __source_row(struct __source* s, size_t frame, size_t row) {
+    const struct diff_input* in = s->input;
+    const uint8_t* data;
+    if (in->compressed) {
+        if (s->current != frame) {
+            if (!lz_read_frame(&s->lz, frame, s->frame)) { return NULL; }
+            s->current = frame;
+        }
+        data = s->frame + row * in->n;
+    } else {
+        data = in->data + (frame * in->m + row) * in->row_bytes;
+    }
+    if (s->row) { __pack_row(data, in->n, s->row); return s->row; }
+    return data;
+}
+
+/**
+ * The rows compared by a thread, as a range of rows of all frames.
+ */
+struct __worker {
+    const struct diff_input* a, * b;
+    bool packed;
+    size_t first, last;
+    size_t block, heat_n;
+    uint64_t* heatmap;          // of this thread
+    uint64_t* frame_mismatches; // shared, added to atomically
+    uint64_t first_index;       // cell index of the first mismatch over all frames
+    bool ok;
+};
+
+static inline void __mismatch(struct __worker* w, size_t frame, size_t row, size_t col) {
+    w->heatmap[(row / w->block) * w->heat_n + col / w->block]++;
+    uint64_t index = (frame * w->a->m + row) * (uint64_t)w->a->n + col;
+    if (index < w->first_index) { w->first_index = index; }
+}
+
+/**
+ * Compares a row of bytes, returning the number of mismatches.
+ */
+static uint64_t __diff_bytes(struct __worker* w, const uint8_t* a, const uint8_t* b,
+                             size_t frame, size_t row) {
+    size_t n = w->a->n, i = 0;
+    uint64_t count = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= n; i += 16) {
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i)),
+                                    _mm_loadu_si128((const __m128i*)(b + i)));
+        unsigned mask = _mm_movemask_epi8(eq) ^ 0xffff;
+        if (!mask) { continue; }
+        count += __builtin_popcount(mask);
+        for (; mask; mask &= mask - 1) { __mismatch(w, frame, row, i + __builtin_ctz(mask)); }
+    }
+#else
+    for (; i + 8 <= n; i += 8) {
+        uint64_t x, y;
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        if (x == y) { continue; }
+        for (size_t k = 0; k < 8; k++) {
+            if (a[i + k] != b[i + k]) { count++; __mismatch(w, frame, row, i + k); }
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        if (a[i] != b[i]) { count++; __mismatch(w, frame, row, i); }
+    }
+    return count;
+}
+
+/**
+ * Compares a row of bits, returning the number of mismatches.
+ */
+static uint64_t __diff_bits(struct __worker* w, const uint8_t* a, const uint8_t* b,
+                            size_t frame, size_t row) {
+    size_t n = w->a->n, bytes = (n + 7) / 8, i = 0;
+    uint64_t count = 0;
+    for (; i + 8 <= bytes; i += 8) {
+        uint64_t x, y;
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        if (x == y) { continue; }
+        for (size_t k = i; k < i + 8; k++) {
+            uint8_t d = a[k] ^ b[k];
+            if (k == bytes - 1 && n % 8) { d &= 0xff << (8 - n % 8); } // padding
+            count += __builtin_popcount(d);
+            for (; d; d &= d - 1) { __mismatch(w, frame, row, k*8 + 7 - __builtin_ctz(d)); }
+        }
+    }
+    for (; i < bytes; i++) {
+        uint8_t d = a[i] ^ b[i];
+        if (i == bytes - 1 && n % 8) { d &= 0xff << (8 - n % 8); }
+        count += __builtin_popcount(d);
+        for (; d; d &= d - 1) { __mismatch(w, frame, row, i*8 + 7 - __builtin_ctz(d)); }
+    }
+    return count;
+}
+
+static void* __compare(void* arg) {
+    struct __worker* w = (struct __worker*)arg;
+    struct __source sa, sb;
+    w->ok = __source_init(&sa, w->a, w->packed) && __source_init(&sb, w->b, w->packed);
+    size_t m = w->a->m, frame = w->first / m;
+    uint64_t frame_count = 0;
+    for (size_t r = w->first; r < w->last && w->ok; r++) {
+        if (r / m != frame) {
+            if (frame_count) { __atomic_fetch_add(&w->frame_mismatches[frame], frame_count, __ATOMIC_RELAXED); }
+            frame = r / m;
+            frame_count = 0;
+        }
+        const uint8_t* ra = __source_row(&sa, frame, r % m);
+        const uint8_t* rb = ra ? __source_row(&sb, frame, r % m) : NULL;
+        if (!rb) { w->ok = false; break; }
+        frame_count += w->packed ? __diff_bits(w, ra, rb, frame, r % m) : __diff_bytes(w, ra, rb, frame, r % m);
+    }
+    if (frame_count) { __atomic_fetch_add(&w->frame_mismatches[frame], frame_count, __ATOMIC_RELAXED); }
+    __source_free(&sa);
+    __source_free(&sb);
+    return NULL;
+}
+
+/**
+ * Compares the frames two inputs have in common with the given number of
+ * threads (0 uses all cores), counting mismatches in the heatmap per block
+ * by block cells. The inputs must have the same rows and columns. Returns
+ * false if the inputs do not match in shape or cannot be read.
+ */
+bool diff_compare(const struct diff_input* a, const struct diff_input* b, size_t block,
+                  size_t num_threads, struct diff_result* result) {
+    memset(result, 0, sizeof(*result));
+    if (a->m != b->m || a->n != b->n || !a->m || !a->n || block == 0) { errno = EINVAL; return false; }
+    size_t frames = a->frames < b->frames ? a->frames : b->frames, m = a->m, n = a->n;
+    result->frames = frames;
+    result->block = block;
+    result->heat_m = (m + block - 1) / block;
+    result->heat_n = (n + block - 1) / block;
+    size_t heat_size = result->heat_m * result->heat_n;
+
+    // Split the rows of all frames evenly, in whole frames if any are compressed
+    size_t rows = frames * m;
+    if (num_threads == 0) { num_threads = get_num_cores_affinity(); }
+    size_t max_threads = rows * n / DIFF_CHUNK_MIN + 1;
+    if (a->compressed || b->compressed) { max_threads = frames; }
+    if (num_threads > max_threads) { num_threads = max_threads; }
+    if (num_threads == 0) { num_threads = 1; }
+    size_t unit = a->compressed || b->compressed ? m : 1;
+    size_t units = rows / unit;
+
+    struct __worker* workers = (struct __worker*)calloc(num_threads, sizeof(struct __worker));
+    pthread_t* threads = (pthread_t*)malloc(num_threads * sizeof(pthread_t));
+    bool* started = (bool*)calloc(num_threads, sizeof(bool));
+    uint64_t* frame_mismatches = (uint64_t*)calloc(frames + 1, sizeof(uint64_t));
+    result->heatmap = (uint64_t*)calloc(heat_size, sizeof(uint64_t));
+    bool ok = workers && threads && started && frame_mismatches && result->heatmap;
+    for (size_t t = 0; t < num_threads && ok; t++) {
+        struct __worker* w = &workers[t];
+        w->a = a;
+        w->b = b;
+        w->packed = a->packed || b->packed;
+        w->first = units * t / num_threads * unit;
+        w->last = units * (t + 1) / num_threads * unit;
+        w->block = block;
+        w->heat_n = result->heat_n;
+        w->heatmap = t == 0 ? result->heatmap : (uint64_t*)calloc(heat_size, sizeof(uint64_t));
+        w->frame_mismatches = frame_mismatches;
+        w->first_index = UINT64_MAX;
+        ok = w->heatmap != NULL;
+    }
+
+    // The first range is compared on this thread
+    for (size_t t = 1; t < num_threads && ok; t++) {
+        started[t] = pthread_create(&threads[t], NULL, __compare, &workers[t]) == 0;
+    }
+    if (ok) { __compare(&workers[0]); }
+    uint64_t first_index = UINT64_MAX;
+    for (size_t t = 0; t < num_threads && workers; t++) {
+        struct __worker* w = &workers[t];
+        if (ok && t > 0) {
+            if (started[t]) { pthread_join(threads[t], NULL); }
+            else { __compare(w); } // no thread for it
+        }
+        if (ok) {
+            ok = w->ok;
+            if (w->first_index < first_index) { first_index = w->first_index; }
+            for (size_t i = 0; t > 0 && i < heat_size; i++) { result->heatmap[i] += w->heatmap[i]; }
+        }
+        if (t > 0) { free(w->heatmap); }
+    }
+
+    for (size_t f = 0; f < frames && ok; f++) {
+        if (!frame_mismatches[f]) { continue; }
+        result->mismatches += frame_mismatches[f];
+        result->differing_frames++;
+        result->last_frame = f;
+    }
+    if (first_index != UINT64_MAX) {
+        result->first_frame = first_index / ((uint64_t)m * n);
+        result->first_row = first_index / n % m;
+        result->first_col = first_index % n;
+    }
+    free(workers);
+    free(threads);
+    free(started);
+    free(frame_mismatches);
+    if (!ok) { diff_result_free(result); }
+    return ok;
+}
+
+/**
+ * Frees the heatmap of a result.
+ */
+void diff_result_free(struct diff_result* result) {
+    free(result->heatmap);
+    result->heatmap = NULL;
+}
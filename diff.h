@@ -0,0 +1,81 @@
+/**
+ * Comparing boards and histories, for checking a new engine or a
+ * distributed run against a known good one without loading either.
+ *
+ * NPY files are memory-mapped and compared in place, a range of rows per
+ * thread, so a comparison is limited by memory (or disk) bandwidth. Cells
+ * can be bytes (uint8 or bool NPY files), bits (uint8 NPY files packed
+ * along rows like numpy.packbits(axis=-1) does, the first cell in the
+ * highest bit) or compressed files (see lz.h), and files of different
+ * formats can be compared with each other.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A board or history opened for comparing. A board is a history of one
+ * frame.
+ */
+struct diff_input {
+    const char* path;
+    size_t frames, m, n;
+    bool packed;         // one bit per cell
+    bool compressed;     // a compressed file, read a frame at a time
+    size_t row_bytes;    // bytes of a row of the mapped data
+    const uint8_t* data; // the first frame of a mapped file
+    void* map;
+    size_t map_size;
+};
+
+/**
+ * Opens a NPY or compressed file. A NPY file whose rows are bit-packed needs
+ * the number of columns it was packed from in packed_cols, otherwise it is
+ * 0. Returns false if the file cannot be read or is not 1 to 3 dimensional
+ * uint8 or bool data in C order.
+ */
+bool diff_open(struct diff_input* input, const char* path, size_t packed_cols);
+
+/**
+ * Closes a file opened with diff_open().
+ */
+void diff_close(struct diff_input* input);
+
+/**
+ * Where two histories differ.
+ */
+struct diff_result {
+    size_t frames;              // frames compared
+    uint64_t mismatches;        // cells that differ, over all frames
+    size_t differing_frames;    // frames with at least one mismatch
+    size_t first_frame, first_row, first_col; // the first mismatch, if any
+    size_t last_frame;          // the last frame with a mismatch
+    size_t block;               // cells per side of a heatmap block
+    size_t heat_m, heat_n;      // blocks per column and row of the heatmap
+    uint64_t* heatmap;          // mismatches per block, over all frames
+};
+
+/**
+ * Compares the frames two inputs have in common with the given number of
+ * threads (0 uses all cores), counting mismatches in the heatmap per block
+ * by block cells. The inputs must have the same rows and columns. Returns
+ * false if the inputs do not match in shape or cannot be read.
+ */
+bool diff_compare(const struct diff_input* a, const struct diff_input* b, size_t block,
+                  size_t num_threads, struct diff_result* result);
+
+/**
+ * Frees the heatmap of a result.
+ */
+void diff_result_free(struct diff_result* result);
+
+#ifdef __cplusplus
+}
+#endif
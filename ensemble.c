@@ -0,0 +1,360 @@
+/**
+ * Damage-spreading ensembles, see ensemble.h.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "ensemble.h"
+#include "helpers.h"
+
+#define ENSEMBLE_NONE SIZE_MAX
+
+/**
+ * The tiles a member differs from the base in.
+ */
+struct __damage {
+    size_t count, capacity;
+    size_t* tiles;  // index of each tile
+    size_t* cells;  // cells of each tile that differ from the base
+    uint8_t* data;  // tile*tile cells of each tile, rows a tile apart
+};
+
+/**
+ * Working memory of a thread.
+ */
+struct __scratch {
+    size_t* slot;       // position of each tile in the damage of the member, ENSEMBLE_NONE if it is the base
+    uint8_t* seen;      // tiles that are already candidates
+    size_t* candidates; // damaged tiles and their neighbours
+    uint8_t* patch;     // a tile with a cell of halo around it
+};
+
+struct ensemble {
+    size_t m, n, tile;
+    size_t tiles_m, tiles_n, n_tiles;
+    size_t n_members, num_threads;
+    uint8_t* base, * base_next;
+    struct __damage* damage, * damage_next; // of each member
+    struct __scratch* scratch;              // of each thread
+    struct ensemble_stats stats;
+};
+
+static inline size_t __min(size_t a, size_t b) { return a < b ? a : b; }
+
+/**
+ * Makes room for count more tiles. Returns false if it cannot be allocated.
+ */
+static bool __reserve(struct __damage* d, size_t count, size_t tile_size) {
+    if (d->count + count <= d->capacity) { return true; }
+    size_t capacity = d->capacity ? d->capacity : 4;
+    while (capacity < d->count + count) { capacity *= 2; }
+    size_t* tiles = (size_t*)realloc(d->tiles, capacity * sizeof(size_t));
+    if (tiles) { d->tiles = tiles; }
+    size_t* cells = (size_t*)realloc(d->cells, capacity * sizeof(size_t));
+    if (cells) { d->cells = cells; }
+    uint8_t* data = (uint8_t*)realloc(d->data, capacity * tile_size);
+    if (data) { d->data = data; }
+    if (!tiles || !cells || !data) { errno = ENOMEM; return false; }
+    d->capacity = capacity;
+    return true;
+}
+
+/**
+ * Creates an ensemble of the given number of members of an m by n base grid
+ * (which is copied), split into tile by tile blocks. Generations are computed
+ * with num_threads threads when built with OpenMP. Returns NULL and sets
+ * errno if the grid is empty or it cannot be allocated.
+ */
+struct ensemble* ensemble_create(const uint8_t* grid, size_t m, size_t n, size_t tile,
+                                 size_t members, size_t num_threads) {
+    if (!m || !n || !tile) { errno = EINVAL; return NULL; }
+    struct ensemble* e = (struct ensemble*)calloc(1, sizeof(struct ensemble));
+    if (!e) { return NULL; }
+    e->m = m;
+    e->n = n;
+    e->tile = tile;
+    e->tiles_m = (m + tile - 1) / tile;
+    e->tiles_n = (n + tile - 1) / tile;
+    e->n_tiles = e->tiles_m * e->tiles_n;
+    e->n_members = members;
+    e->num_threads = num_threads ? num_threads : 1;
+
+    bool ok = (e->base = (uint8_t*)malloc(m * n)) && (e->base_next = (uint8_t*)malloc(m * n)) &&
+              (e->damage = (struct __damage*)calloc(members ? members : 1, sizeof(struct __damage))) &&
+              (e->damage_next = (struct __damage*)calloc(members ? members : 1, sizeof(struct __damage))) &&
+              (e->scratch = (struct __scratch*)calloc(e->num_threads, sizeof(struct __scratch)));
+    for (size_t k = 0; ok && k < e->num_threads; k++) {
+        struct __scratch* s = &e->scratch[k];
+        ok = (s->slot = (size_t*)malloc(e->n_tiles * sizeof(size_t))) &&
+             (s->seen = (uint8_t*)calloc(e->n_tiles, 1)) &&
+             (s->candidates = (size_t*)malloc(e->n_tiles * sizeof(size_t))) &&
+             (s->patch = (uint8_t*)malloc((tile + 2) * (tile + 2)));
+        for (size_t t = 0; ok && t < e->n_tiles; t++) { s->slot[t] = ENSEMBLE_NONE; }
+    }
+    if (!ok) { ensemble_free(e); errno = ENOMEM; return NULL; }
+
+    // Cells are 0 or 1 so neighbours can be added up
+    for (size_t i = 0; i < m * n; i++) { e->base[i] = grid[i] != 0; }
+    return e;
+}
+
+/**
+ * Counts the cells of a tile of a member that differ from a grid.
+ */
+static size_t __diff_tile(const struct ensemble* e, const uint8_t* data, size_t t, const uint8_t* grid) {
+    size_t T = e->tile, r0 = (t / e->tiles_n) * T, c0 = (t % e->tiles_n) * T;
+    size_t th = __min(T, e->m - r0), tw = __min(T, e->n - c0), cells = 0;
+    for (size_t i = 0; i < th; i++) {
+        const uint8_t* a = data + i * T, * b = grid + (r0 + i) * e->n + c0;
+        for (size_t j = 0; j < tw; j++) { cells += a[j] != b[j]; }
+    }
+    return cells;
+}
+
+/**
+ * Flips a cell of a member, before the first generation. Returns false if
+ * the cell is outside of the grid or it cannot be allocated.
+ */
+bool ensemble_flip(struct ensemble* e, size_t member, size_t row, size_t col) {
+    if (member >= e->n_members || row >= e->m || col >= e->n) { errno = EINVAL; return false; }
+    struct __damage* d = &e->damage[member];
+    size_t T = e->tile, t = (row / T) * e->tiles_n + col / T, k = 0;
+    while (k < d->count && d->tiles[k] != t) { k++; }
+    if (k == d->count) {
+        // a tile that was the base so far starts as a copy of it
+        if (!__reserve(d, 1, T * T)) { return false; }
+        size_t r0 = (row / T) * T, c0 = (col / T) * T, tw = __min(T, e->n - c0);
+        for (size_t i = 0; i < __min(T, e->m - r0); i++) {
+            memcpy(d->data + k * T * T + i * T, e->base + (r0 + i) * e->n + c0, tw);
+        }
+        d->tiles[k] = t;
+        d->count++;
+    }
+    uint8_t* cell = d->data + k * T * T + (row % T) * T + col % T;
+    *cell = !*cell;
+    d->cells[k] = __diff_tile(e, d->data + k * T * T, t, e->base);
+    if (!d->cells[k]) {
+        // flipped back, the tile is the base again
+        if (--d->count != k) {
+            d->tiles[k] = d->tiles[d->count];
+            d->cells[k] = d->cells[d->count];
+            memcpy(d->data + k * T * T, d->data + d->count * T * T, T * T);
+        }
+    }
+    return true;
+}
+
+/**
+ * Copies len cells of row r of a member from column c0, which are all in
+ * one tile.
+ */
+static inline void __copy_row(const struct ensemble* e, const struct __damage* d, const size_t* slot,
+                              size_t r, size_t c0, size_t len, uint8_t* dst) {
+    size_t T = e->tile, k = slot[(r / T) * e->tiles_n + c0 / T];
+    const uint8_t* src = k == ENSEMBLE_NONE ? e->base + r * e->n + c0 : d->data + k * T * T + (r % T) * T + c0 % T;
+    memcpy(dst, src, len);
+}
+
+/**
+ * Computes the next generation of a tile of a member into out, and returns
+ * the number of its cells that differ from the next generation of the base.
+ */
+static size_t __step_tile(const struct ensemble* e, const struct __damage* d, struct __scratch* s,
+                          size_t t, uint8_t* out) {
+    size_t T = e->tile, w = T + 2, r0 = (t / e->tiles_n) * T, c0 = (t % e->tiles_n) * T;
+    size_t th = __min(T, e->m - r0), tw = __min(T, e->n - c0);
+
+    // The tile and its halo, cells outside of the grid are dead
+    uint8_t* patch = s->patch;
+    memset(patch, 0, w * w);
+    for (size_t pr = 0; pr < th + 2; pr++) {
+        if ((pr == 0 && r0 == 0) || r0 + pr - 1 >= e->m) { continue; }
+        size_t r = r0 + pr - 1;
+        uint8_t* dst = patch + pr * w;
+        if (c0 > 0) { __copy_row(e, d, s->slot, r, c0 - 1, 1, dst); }
+        __copy_row(e, d, s->slot, r, c0, tw, dst + 1);
+        if (c0 + tw < e->n) { __copy_row(e, d, s->slot, r, c0 + tw, 1, dst + 1 + tw); }
+    }
+
+    size_t cells = 0;
+    for (size_t i = 0; i < th; i++) {
+        const uint8_t* base = e->base_next + (r0 + i) * e->n + c0;
+        for (size_t j = 0; j < tw; j++) {
+            const uint8_t* p = patch + (i + 1) * w + j + 1;
+            int count = p[-w - 1] + p[-w] + p[-w + 1] + p[-1] + p[1] + p[w - 1] + p[w] + p[w + 1];
+            uint8_t alive = count == 3 || (*p && count == 2);
+            out[i * T + j] = alive;
+            cells += alive != base[j];
+        }
+    }
+    return cells;
+}
+
+/**
+ * Computes the next generation of a member: its damaged tiles and their
+ * neighbours are recomputed, the ones that differ from the base are kept.
+ */
+static bool __step_member(const struct ensemble* e, const struct __damage* d, struct __damage* next,
+                          struct __scratch* s, size_t* updates) {
+    size_t T = e->tile, n_candidates = 0;
+    next->count = 0;
+    for (size_t k = 0; k < d->count; k++) { s->slot[d->tiles[k]] = k; }
+    for (size_t k = 0; k < d->count; k++) {
+        size_t ti = d->tiles[k] / e->tiles_n, tj = d->tiles[k] % e->tiles_n;
+        for (size_t i = ti ? ti - 1 : 0; i <= ti + 1 && i < e->tiles_m; i++) {
+            for (size_t j = tj ? tj - 1 : 0; j <= tj + 1 && j < e->tiles_n; j++) {
+                size_t u = i * e->tiles_n + j;
+                if (!s->seen[u]) { s->seen[u] = 1; s->candidates[n_candidates++] = u; }
+            }
+        }
+    }
+
+    bool ok = __reserve(next, n_candidates, T * T);
+    for (size_t c = 0; ok && c < n_candidates; c++) {
+        size_t t = s->candidates[c];
+        size_t cells = __step_tile(e, d, s, t, next->data + next->count * T * T);
+        if (cells) {
+            next->tiles[next->count] = t;
+            next->cells[next->count++] = cells;
+        }
+    }
+
+    for (size_t k = 0; k < d->count; k++) { s->slot[d->tiles[k]] = ENSEMBLE_NONE; }
+    for (size_t c = 0; c < n_candidates; c++) { s->seen[s->candidates[c]] = 0; }
+    *updates += n_candidates;
+    return ok;
+}
+
+/**
+ * Computes the next generation of the base and of every member. Returns
+ * false if the damage cannot be allocated.
+ */
+bool ensemble_step(struct ensemble* e) {
+    int num_threads = (int)e->num_threads;
+    size_t size = e->m * e->n;
+    #ifdef _OPENMP
+    #pragma omp parallel for num_threads(num_threads) if(num_threads > 1)
+    #endif
+    for (size_t i = 0; i < size; i++) { update(e->base, e->base_next, i, e->m, e->n); }
+
+    // Members have very different damage, so threads take them one at a time
+    size_t updates = 0, failed = 0;
+    #ifdef _OPENMP
+    #pragma omp parallel for num_threads(num_threads) if(num_threads > 1) schedule(dynamic) reduction(+:updates, failed)
+    #endif
+    for (size_t k = 0; k < e->n_members; k++) {
+        #ifdef _OPENMP
+        struct __scratch* s = &e->scratch[omp_get_thread_num()];
+        #else
+        struct __scratch* s = &e->scratch[0];
+        #endif
+        failed += !__step_member(e, &e->damage[k], &e->damage_next[k], s, &updates);
+    }
+    (void)num_threads;
+
+    struct __damage* damage = e->damage;
+    e->damage = e->damage_next;
+    e->damage_next = damage;
+    swap(&e->base, &e->base_next);
+
+    size_t tiles = 0;
+    for (size_t k = 0; k < e->n_members; k++) { tiles += e->damage[k].count; }
+    e->stats.generations++;
+    e->stats.tile_updates += updates;
+    e->stats.dense_updates += e->n_members * e->n_tiles;
+    if (tiles > e->stats.peak_tiles) { e->stats.peak_tiles = tiles; }
+    if (failed) { errno = ENOMEM; }
+    return !failed;
+}
+
+/**
+ * Get the number of cells a member differs from the base by.
+ */
+size_t ensemble_damage(const struct ensemble* e, size_t member) {
+    const struct __damage* d = &e->damage[member];
+    size_t cells = 0;
+    for (size_t k = 0; k < d->count; k++) { cells += d->cells[k]; }
+    return cells;
+}
+
+/**
+ * Get the number of tiles a member differs from the base in.
+ */
+size_t ensemble_damage_tiles(const struct ensemble* e, size_t member) {
+    return e->damage[member].count;
+}
+
+/**
+ * Get the current generation of the base.
+ */
+const uint8_t* ensemble_base(const struct ensemble* e) {
+    return e->base;
+}
+
+/**
+ * Writes the current generation of a member as a whole m by n grid.
+ */
+void ensemble_member_grid(const struct ensemble* e, size_t member, uint8_t* out) {
+    const struct __damage* d = &e->damage[member];
+    size_t T = e->tile;
+    memcpy(out, e->base, e->m * e->n);
+    for (size_t k = 0; k < d->count; k++) {
+        size_t r0 = (d->tiles[k] / e->tiles_n) * T, c0 = (d->tiles[k] % e->tiles_n) * T;
+        size_t th = __min(T, e->m - r0), tw = __min(T, e->n - c0);
+        for (size_t i = 0; i < th; i++) { memcpy(out + (r0 + i) * e->n + c0, d->data + k * T * T + i * T, tw); }
+    }
+}
+
+/**
+ * Get the work done so far.
+ */
+void ensemble_get_stats(const struct ensemble* e, struct ensemble_stats* stats) {
+    *stats = e->stats;
+}
+
+/**
+ * Prints the work done compared to simulating every member in full.
+ */
+void ensemble_print_stats(const struct ensemble* e) {
+    const struct ensemble_stats* s = &e->stats;
+    printf("Ensemble: %zu members, %zu generations, %zu of %zu member tiles recomputed",
+           e->n_members, s->generations, s->tile_updates, s->dense_updates);
+    if (s->tile_updates) { printf(" (%.1fx less work)", s->dense_updates / (double)s->tile_updates); }
+    printf(", at most %zu damaged tiles of %zux%zu cells\n", s->peak_tiles, e->tile, e->tile);
+}
+
+/**
+ * Frees an ensemble.
+ */
+void ensemble_free(struct ensemble* e) {
+    if (!e) { return; }
+    for (size_t k = 0; k < e->n_members; k++) {
+        struct __damage* lists[2] = { e->damage ? &e->damage[k] : NULL, e->damage_next ? &e->damage_next[k] : NULL };
+        for (int l = 0; l < 2; l++) {
+            if (!lists[l]) { continue; }
+            free(lists[l]->tiles);
+            free(lists[l]->cells);
+            free(lists[l]->data);
+        }
+    }
+    for (size_t k = 0; e->scratch && k < e->num_threads; k++) {
+        free(e->scratch[k].slot);
+        free(e->scratch[k].seen);
+        free(e->scratch[k].candidates);
+        free(e->scratch[k].patch);
+    }
+    free(e->scratch);
+    free(e->damage);
+    free(e->damage_next);
+    free(e->base);
+    free(e->base_next);
+    free(e);
+}
@@ -0,0 +1,94 @@
+/**
+ * Damage-spreading ensembles: many copies of a board that differ from it by
+ * a few flipped cells, run together with the unperturbed base board.
+ *
+ * The base board is simulated once per generation. Each member only keeps
+ * the tiles where it differs from the base (its damage). A generation of a
+ * member recomputes those tiles and their neighbours from the member's cells
+ * where it is damaged and the base elsewhere, and keeps the tiles that still
+ * differ from the next base generation. Every other tile of a member equals
+ * the base, so a member costs about the size of its damage instead of the
+ * board, and a member whose damage heals costs nothing.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct ensemble;
+
+/**
+ * Work done by an ensemble.
+ */
+struct ensemble_stats {
+    size_t generations;
+    size_t tile_updates;    // tiles recomputed for the members
+    size_t dense_updates;   // tiles a full simulation of every member would have computed
+    size_t peak_tiles;      // most damaged tiles kept at once
+};
+
+/**
+ * Creates an ensemble of the given number of members of an m by n base grid
+ * (which is copied), split into tile by tile blocks. Generations are computed
+ * with num_threads threads when built with OpenMP. Returns NULL and sets
+ * errno if the grid is empty or it cannot be allocated.
+ */
+struct ensemble* ensemble_create(const uint8_t* grid, size_t m, size_t n, size_t tile,
+                                 size_t members, size_t num_threads);
+
+/**
+ * Flips a cell of a member, before the first generation. Returns false if
+ * the cell is outside of the grid or it cannot be allocated.
+ */
+bool ensemble_flip(struct ensemble* ensemble, size_t member, size_t row, size_t col);
+
+/**
+ * Computes the next generation of the base and of every member. Returns
+ * false if the damage cannot be allocated.
+ */
+bool ensemble_step(struct ensemble* ensemble);
+
+/**
+ * Get the number of cells a member differs from the base by.
+ */
+size_t ensemble_damage(const struct ensemble* ensemble, size_t member);
+
+/**
+ * Get the number of tiles a member differs from the base in.
+ */
+size_t ensemble_damage_tiles(const struct ensemble* ensemble, size_t member);
+
+/**
+ * Get the current generation of the base.
+ */
+const uint8_t* ensemble_base(const struct ensemble* ensemble);
+
+/**
+ * Writes the current generation of a member as a whole m by n grid.
+ */
+void ensemble_member_grid(const struct ensemble* ensemble, size_t member, uint8_t* out);
+
+/**
+ * Get the work done so far.
+ */
+void ensemble_get_stats(const struct ensemble* ensemble, struct ensemble_stats* stats);
+
+/**
+ * Prints the work done compared to simulating every member in full.
+ */
+void ensemble_print_stats(const struct ensemble* ensemble);
+
+/**
+ * Frees an ensemble.
+ */
+void ensemble_free(struct ensemble* ensemble);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,235 @@
+/**
+ * A ring of frames in a named POSIX shared-memory segment, see frame_ring.h.
+ */
+
+#if defined(linux)
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#if defined(linux)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "frame_ring.h"
+
+#define RING_HEADER_SIZE 128 // the shared header, rounded up to whole cache lines
+#define SLOT_HEADER_SIZE 64  // keeps the lock of a slot on its own cache line
+
+/**
+ * The header of a slot. The lock is 2*seq+1 while frame seq is written to
+ * the slot and 2*seq+2 once it is complete.
+ */
+struct __slot {
+    uint64_t lock;
+    uint64_t generation;
+};
+
+static inline struct __slot* __slot(const struct gol_frame_ring* ring, uint64_t seq) {
+    size_t offset = RING_HEADER_SIZE + (seq % ring->n_slots) * ring->slot_stride;
+    return (struct __slot*)((char*)ring + offset);
+}
+
+static inline const uint8_t* __slot_grid(const struct gol_frame_ring* ring, uint64_t seq) {
+    return (const uint8_t*)__slot(ring, seq) + SLOT_HEADER_SIZE;
+}
+
+#if defined(linux)
+static void __futex_wake(uint32_t* word) {
+    syscall(SYS_futex, word, FUTEX_WAKE, 0x7fffffff, NULL, NULL, 0);
+}
+static void __futex_wait(const uint32_t* word, uint32_t value, double timeout) {
+    struct timespec t = { (time_t)timeout, (long)((timeout - (time_t)timeout) * 1e9) };
+    syscall(SYS_futex, word, FUTEX_WAIT, value, &t, NULL, 0);
+}
+#else
+// other systems poll instead
+static void __futex_wake(uint32_t* word) { }
+static void __futex_wait(const uint32_t* word, uint32_t value, double timeout) {
+    struct timespec t = { 0, timeout < 0.0001 ? (long)(timeout * 1e9) : 100000 };
+    nanosleep(&t, NULL);
+}
+#endif
+
+/**
+ * Get the name of the shared-memory segment of the given process.
+ */
+void frame_ring_shm_name(pid_t pid, char* name, size_t size) {
+    snprintf(name, size, "/gol-frames-%ld", (long)pid);
+}
+
+/**
+ * Creates and maps the frame ring of this process for an m by n grid with
+ * the given number of slots. Returns NULL if it cannot be created.
+ */
+struct gol_frame_ring* frame_ring_create(size_t m, size_t n, size_t n_slots) {
+    if (n_slots < 2) { n_slots = 2; }
+    size_t stride = (SLOT_HEADER_SIZE + m * n + 63) & ~(size_t)63;
+    size_t size = RING_HEADER_SIZE + n_slots * stride;
+
+    char name[64];
+    frame_ring_shm_name(getpid(), name, sizeof(name));
+    int fd = shm_open(name, O_CREAT|O_RDWR|O_TRUNC, 0644);
+    if (fd < 0) { return NULL; }
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    struct gol_frame_ring* ring = (struct gol_frame_ring*)mmap(NULL, size,
+        PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED) { shm_unlink(name); return NULL; }
+
+    ring->version = GOL_FRAME_RING_VERSION;
+    ring->pid = getpid();
+    ring->rows = m;
+    ring->cols = n;
+    ring->n_slots = n_slots;
+    ring->slot_stride = stride;
+    ring->size = size;
+    // readers check the magic last so they never see a half-initialized ring
+    __atomic_store_n(&ring->magic, GOL_FRAME_RING_MAGIC, __ATOMIC_RELEASE);
+    return ring;
+}
+
+/**
+ * Publishes a grid as the frame of a generation, overwriting the oldest one.
+ */
+void frame_ring_publish(struct gol_frame_ring* ring, size_t generation, const uint8_t* grid) {
+    uint64_t seq = __atomic_load_n(&ring->published, __ATOMIC_RELAXED);
+    struct __slot* slot = __slot(ring, seq);
+
+    // readers of the old frame see the odd lock before any of the frame changes
+    __atomic_store_n(&slot->lock, 2*seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->generation = generation;
+    memcpy((uint8_t*)__slot_grid(ring, seq), grid, ring->rows * ring->cols);
+    __atomic_store_n(&slot->lock, 2*seq + 2, __ATOMIC_RELEASE);
+
+    __atomic_store_n(&ring->published, seq + 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&ring->wake, 1, __ATOMIC_RELEASE);
+    __futex_wake(&ring->wake);
+}
+
+/**
+ * Marks the run as over and wakes up the readers waiting for frames.
+ */
+void frame_ring_finish(struct gol_frame_ring* ring) {
+    __atomic_store_n(&ring->finished, 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&ring->wake, 1, __ATOMIC_RELEASE);
+    __futex_wake(&ring->wake);
+}
+
+/**
+ * Unmaps and removes the frame ring of this process. Readers that are
+ * attached keep their mapping.
+ */
+void frame_ring_destroy(struct gol_frame_ring* ring) {
+    if (!ring) { return; }
+    char name[64];
+    frame_ring_shm_name(getpid(), name, sizeof(name));
+    munmap(ring, ring->size);
+    shm_unlink(name);
+}
+
+/**
+ * Maps the frame ring of another process read-only. Returns NULL if it
+ * does not exist or is not a frame ring.
+ */
+const struct gol_frame_ring* frame_ring_attach(pid_t pid) {
+    char name[64];
+    frame_ring_shm_name(pid, name, sizeof(name));
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) { return NULL; }
+
+    // map the header to find the size of the whole ring
+    const struct gol_frame_ring* header = (const struct gol_frame_ring*)mmap(NULL,
+        sizeof(struct gol_frame_ring), PROT_READ, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED) { close(fd); return NULL; }
+    bool ok = __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) == GOL_FRAME_RING_MAGIC &&
+              header->version == GOL_FRAME_RING_VERSION;
+    size_t size = header->size;
+    munmap((void*)header, sizeof(struct gol_frame_ring));
+    if (!ok) { close(fd); errno = EINVAL; return NULL; }
+
+    void* x = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    return x == MAP_FAILED ? NULL : (const struct gol_frame_ring*)x;
+}
+
+/**
+ * Unmaps a ring mapped with frame_ring_attach().
+ */
+void frame_ring_detach(const struct gol_frame_ring* ring) {
+    if (ring) { munmap((void*)ring, ring->size); }
+}
+
+/**
+ * Gets frame seq if the slot still holds it.
+ */
+static bool __get(const struct gol_frame_ring* ring, uint64_t seq, struct frame_view* view) {
+    const struct __slot* slot = __slot(ring, seq);
+    if (__atomic_load_n(&slot->lock, __ATOMIC_ACQUIRE) != 2*seq + 2) { return false; }
+    view->grid = __slot_grid(ring, seq);
+    view->seq = seq;
+    view->generation = slot->generation;
+    return frame_ring_valid(ring, view);
+}
+
+/**
+ * Gets the latest published frame. Returns false if there is none yet.
+ */
+bool frame_ring_latest(const struct gol_frame_ring* ring, struct frame_view* view) {
+    for (;;) {
+        uint64_t published = __atomic_load_n(&ring->published, __ATOMIC_ACQUIRE);
+        if (!published) { return false; }
+        if (__get(ring, published - 1, view)) { return true; }
+        // the ring went all the way around meanwhile, try the new latest frame
+    }
+}
+
+/**
+ * Waits up to timeout seconds for the frame with the given sequence number
+ * (usually the last one read plus one). A reader that fell more than the
+ * ring behind gets the latest frame instead, view->seq tells how many it
+ * missed. Returns false on timeout or if the run finished without it.
+ */
+bool frame_ring_wait(const struct gol_frame_ring* ring, uint64_t seq, double timeout,
+                     struct frame_view* view) {
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (;;) {
+        uint32_t wake = __atomic_load_n(&ring->wake, __ATOMIC_ACQUIRE);
+        uint64_t published = __atomic_load_n(&ring->published, __ATOMIC_ACQUIRE);
+        if (seq < published) {
+            // half a ring of margin so the frame is not overwritten right away
+            if (published - seq <= ring->n_slots / 2 && __get(ring, seq, view)) { return true; }
+            return frame_ring_latest(ring, view);
+        }
+        if (__atomic_load_n(&ring->finished, __ATOMIC_ACQUIRE)) { return false; }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double left = timeout - (now.tv_sec - start.tv_sec) - (now.tv_nsec - start.tv_nsec) / 1e9;
+        if (left <= 0) { return false; }
+        __futex_wait(&ring->wake, wake, left);
+    }
+}
+
+/**
+ * Checks that a frame was not overwritten since it was gotten. Call it after
+ * using the frame, if it fails whatever was read from it has to be dropped.
+ */
+bool frame_ring_valid(const struct gol_frame_ring* ring, const struct frame_view* view) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&__slot(ring, view->seq)->lock, __ATOMIC_RELAXED) == 2*view->seq + 2;
+}
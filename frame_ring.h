@@ -0,0 +1,116 @@
+/**
+ * A ring of frames in a named POSIX shared-memory segment, for handing the
+ * generations of a run to other processes (visualizers, analytics) as they
+ * are produced.
+ *
+ * The engine publishes into the next slot without ever waiting on readers,
+ * so a slow reader misses frames instead of stalling the run. Each slot is a
+ * seqlock: readers use the frame in place and then check it was not
+ * overwritten meanwhile, so reading a frame is no copies and no syscalls.
+ * Only waiting for a frame that is not published yet sleeps in the kernel.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GOL_FRAME_RING_MAGIC 0x474e4952454d4147ull // "GAMERING"
+#define GOL_FRAME_RING_VERSION 1
+#define GOL_FRAME_RING_SLOTS 8
+
+/**
+ * The shared header, followed by the slots. The counters are updated with
+ * atomics, the rest does not change after the ring is created.
+ */
+struct gol_frame_ring {
+    uint64_t magic;
+    uint64_t version;
+    uint64_t pid;
+    uint64_t rows, cols;
+    uint64_t n_slots;
+    uint64_t slot_stride; // bytes from one slot to the next
+    uint64_t size;        // bytes of the whole segment
+
+    uint64_t published;   // frames published so far, the next sequence number
+    uint64_t finished;    // set when the run is over
+    uint32_t wake;        // changes with every frame, readers sleep on it
+};
+
+/**
+ * A frame of the ring. The grid points into shared memory and stays valid
+ * as long as frame_ring_valid() says so.
+ */
+struct frame_view {
+    const uint8_t* grid;
+    uint64_t seq;        // sequence number in the ring, counting from 0
+    uint64_t generation; // generation of the run
+};
+
+/**
+ * Get the name of the shared-memory segment of the given process.
+ */
+void frame_ring_shm_name(pid_t pid, char* name, size_t size);
+
+/**
+ * Creates and maps the frame ring of this process for an m by n grid with
+ * the given number of slots. Returns NULL if it cannot be created.
+ */
+struct gol_frame_ring* frame_ring_create(size_t m, size_t n, size_t n_slots);
+
+/**
+ * Publishes a grid as the frame of a generation, overwriting the oldest one.
+ */
+void frame_ring_publish(struct gol_frame_ring* ring, size_t generation, const uint8_t* grid);
+
+/**
+ * Marks the run as over and wakes up the readers waiting for frames.
+ */
+void frame_ring_finish(struct gol_frame_ring* ring);
+
+/**
+ * Unmaps and removes the frame ring of this process. Readers that are
+ * attached keep their mapping.
+ */
+void frame_ring_destroy(struct gol_frame_ring* ring);
+
+/**
+ * Maps the frame ring of another process read-only. Returns NULL if it
+ * does not exist or is not a frame ring.
+ */
+const struct gol_frame_ring* frame_ring_attach(pid_t pid);
+
+/**
+ * Unmaps a ring mapped with frame_ring_attach().
+ */
+void frame_ring_detach(const struct gol_frame_ring* ring);
+
+/**
+ * Gets the latest published frame. Returns false if there is none yet.
+ */
+bool frame_ring_latest(const struct gol_frame_ring* ring, struct frame_view* view);
+
+/**
+ * Waits up to timeout seconds for the frame with the given sequence number
+ * (usually the last one read plus one). A reader that fell more than the
+ * ring behind gets the latest frame instead, view->seq tells how many it
+ * missed. Returns false on timeout or if the run finished without it.
+ */
+bool frame_ring_wait(const struct gol_frame_ring* ring, uint64_t seq, double timeout,
+                     struct frame_view* view);
+
+/**
+ * Checks that a frame was not overwritten since it was gotten. Call it after
+ * using the frame, if it fails whatever was read from it has to be dropped.
+ */
+bool frame_ring_valid(const struct gol_frame_ring* ring, const struct frame_view* view);
+
+#ifdef __cplusplus
+}
+#endif
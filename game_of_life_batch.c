@@ -0,0 +1,77 @@
+/**
+ * Conway's Game of Life for a batch of boards
+ *
+ * Runs every board of a job file through a pipeline that reads the next
+ * boards, simulates, encodes and writes at the same time, see batch.h. Each
+ * line of the job file is
+ *     num-of-iterations input-file output-file
+ * and the last generation of each board is saved to its output file,
+ * compressed if the output file ends in .lz. Compile with:
+ *     gcc -Wall -O3 -fopenmp -march=native game_of_life_batch.c batch.c life.c scheduler.c helpers.c budget.c util.c governor.c rle.c lz.c text_io.c -o game_of_life_batch -lpthread
+ * And run with:
+ * 	   ./game_of_life_batch [-d queue-depth] [-e encode-threads] job-file [num-threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "util.h"
+
+int main(int argc, char* const argv[]) {
+	// parse the options
+	struct batch_options options = {0};
+	int opt;
+	while ((opt = getopt(argc, argv, "d:e:")) != -1) {
+		switch (opt) {
+			case 'd': options.depth = atol(optarg); break;
+			case 'e': options.encode_threads = atol(optarg); break;
+			default: return 1;
+		}
+	}
+	argc -= optind - 1;
+	argv += optind - 1;
+	if (argc < 2 || argc > 3) { printf("Wrong number of arguments!\n"); return 1; }
+	options.sim_threads = argc > 2 ? atoi(argv[2]) : 0;
+
+	// Read the job file
+	FILE* jobs_file = fopen(argv[1], "r");
+	if (!jobs_file) { perror(argv[1]); return 1; }
+	char input_file[256], output_file[256], line[1024];
+	size_t iterations, n_jobs = 0;
+	struct batch_job* jobs = NULL;
+	while (fgets(line, sizeof(line), jobs_file)) {
+		if (line[0] == '#' || line[strspn(line, " \t\r\n")] == 0) { continue; }
+		if (sscanf(line, "%zu %255s %255s", &iterations, input_file, output_file) != 3) {
+			fprintf(stderr, "Invalid job: %s", line);
+			continue;
+		}
+		jobs = (struct batch_job*)realloc(jobs, (n_jobs+1)*sizeof(struct batch_job));
+		jobs[n_jobs].input_file = strdup(input_file);
+		jobs[n_jobs].output_file = strdup(output_file);
+		jobs[n_jobs++].iterations = iterations;
+	}
+	fclose(jobs_file);
+
+	// Run them all
+	struct batch_stage_stats stats[BATCH_STAGES];
+	double time;
+	bool ok = batch_run(jobs, n_jobs, &options, stats, &time);
+	for (size_t i = 0; i < n_jobs; i++) {
+		if (!jobs[i].ok) { fprintf(stderr, "%s: %s\n", jobs[i].input_file, strerror(jobs[i].error)); }
+	}
+	printf("Time: %g secs, %.3g boards/sec\n", time, time > 0 ? n_jobs / time : 0.0);
+	batch_print_stats(stats, time);
+
+	// Cleanup
+	for (size_t i = 0; i < n_jobs; i++) {
+		free((char*)jobs[i].input_file);
+		free((char*)jobs[i].output_file);
+	}
+	free(jobs);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+/**
+ * Conway's Game of Life for damage-spreading ensembles
+ *
+ * Runs a board together with copies of it that each have a few random cells
+ * flipped, simulating the base board once and only the tiles where each copy
+ * differs from it, see ensemble.h. The number of cells each member differs
+ * from the base by at every generation is saved to the output file as an
+ * (members, generations) uint64 array. Compile with:
+ *     gcc -Wall -O3 -fopenmp -march=native game_of_life_ensemble.c ensemble.c helpers.c util.c lz.c text_io.c -o game_of_life_ensemble
+ * And run with:
+ * 	   ./game_of_life_ensemble [-k members] [-r flips] [-R row,col,rows,cols] [-T tile] [-S seed] [-F] num-of-iterations input-file output-file [num-threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "ensemble.h"
+#include "util.h"
+#include "lz.h"
+
+int main(int argc, char* const argv[]) {
+	// Parse options, they come before the positional arguments
+	//   -k members  number of perturbed copies of the board (100)
+	//   -r flips    cells flipped in each copy (1)
+	//   -R row,col,rows,cols  only flip cells in that rectangle
+	//   -T tile     side of the tiles the damage is kept in (32)
+	//   -S seed     seed of the flipped cells (1)
+	//   -F          also save the last generation of every copy to <output>.members.npy
+	size_t members = 100, flips = 1, tile = 32, row = 0, col = 0, rows = 0, cols = 0;
+	uint32_t seed = 1;
+	bool save_members = false;
+	int opt;
+	while ((opt = getopt(argc, argv, "k:r:R:T:S:F")) != -1) {
+		switch (opt) {
+			case 'k': members = atol(optarg); break;
+			case 'r': flips = atol(optarg); break;
+			case 'T': tile = atol(optarg); break;
+			case 'S': seed = (uint32_t)atol(optarg); break;
+			case 'F': save_members = true; break;
+			case 'R':
+				if (sscanf(optarg, "%zu,%zu,%zu,%zu", &row, &col, &rows, &cols) != 4) { fprintf(stderr, "Invalid region: %s\n", optarg); return 1; }
+				break;
+			default: return 1;
+		}
+	}
+	argc -= optind - 1;
+	argv += optind - 1;
+	if (argc < 4 || argc > 5) { printf("Wrong number of arguments!\n"); return 1; }
+	if (!members || !tile) { fprintf(stderr, "Must specify a positive number of members and tile size\n"); return 1; }
+	size_t iterations = atol(argv[1]);
+	const char* input_file = argv[2];
+	const char* output_file = argv[3];
+	int num_threads = argc > 4 ? atoi(argv[4]) : 1;
+	if (num_threads <= 0) { fprintf(stderr, "Must specify a positive number of threads\n"); return 1; }
+
+	size_t m, n;
+	uint8_t* grid = grid_load_path(input_file, &m, &n);
+	if (!grid) { perror("grid_from_npy_path(grid)"); return 1; }
+	if (row >= m || col >= n) { fprintf(stderr, "Region outside of the %zux%zu grid\n", m, n); return 1; }
+	if (!rows || row + rows > m) { rows = m - row; }
+	if (!cols || col + cols > n) { cols = n - col; }
+
+	struct ensemble* e = ensemble_create(grid, m, n, tile, members, num_threads);
+	if (!e) { perror("ensemble_create"); return 1; }
+
+	// Flip random cells of the region in every member
+	uint32_t x = seed ? seed : 1;
+	for (size_t k = 0; k < members; k++) {
+		for (size_t f = 0; f < flips; f++) {
+			x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+			size_t i = row + x % rows;
+			x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+			size_t j = col + x % cols;
+			if (!ensemble_flip(e, k, i, j)) { perror("ensemble_flip"); return 1; }
+		}
+	}
+
+	// Begin timing
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// The damage of every member at every generation
+	uint64_t* damage = (uint64_t*)malloc(members*(iterations+1)*sizeof(uint64_t));
+	if (!damage) { perror("malloc"); return 1; }
+	for (size_t step = 0; ; step++) {
+		for (size_t k = 0; k < members; k++) { damage[k*(iterations+1)+step] = ensemble_damage(e, k); }
+		if (step == iterations) { break; }
+		if (!ensemble_step(e)) { perror("ensemble_step"); return 1; }
+	}
+
+	// End timing
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double time = end.tv_sec-start.tv_sec+(end.tv_nsec-start.tv_nsec)/1000000000.0;
+	printf("Time: %g secs\n", time);
+	ensemble_print_stats(e);
+	size_t healed = 0;
+	for (size_t k = 0; k < members; k++) { healed += damage[k*(iterations+1)+iterations] == 0; }
+	printf("Healed: %zu of %zu members\n", healed, members);
+
+	// Save the damage, and the members if asked for
+	size_t shape[2] = {members, iterations+1};
+	if (!array_to_npy_path(output_file, damage, "<u8", sizeof(uint64_t), shape, 2)) { perror(output_file); return 1; }
+	if (save_members) {
+		char* path = sibling_path(output_file, ".members.npy");
+		uint8_t* grids = path ? (uint8_t*)malloc(members*m*n) : NULL;
+		if (!grids) { perror("malloc"); return 1; }
+		for (size_t k = 0; k < members; k++) { ensemble_member_grid(e, k, grids + k*m*n); }
+		if (!grid_to_npy_path(path, grids, members, m, n)) { perror(path); return 1; }
+		free(grids);
+		free(path);
+	}
+
+	// Cleanup
+	free(damage);
+	ensemble_free(e);
+	size_t addr = ((size_t)grid) & ~(sysconf(_SC_PAGE_SIZE)-1);
+	munmap((void*)addr, m*n);
+	return 0;
+}
@@ -0,0 +1,101 @@
+/**
+ * Conway's Game of Life for many jobs at once
+ *
+ * Runs all the jobs of a job file concurrently on one shared pool of worker
+ * threads, see scheduler.h. Each line of the job file is
+ *     tenant weight num-of-iterations input-file output-file
+ * and the last generation of each job is saved to its output file. A tenant
+ * is created the first time its name is seen, with the weight of that line.
+ * Inputs are only loaded once their job fits the memory budget.
+ * Compile with:
+ *     gcc -Wall -O3 -march=native game_of_life_jobs.c scheduler.c helpers.c util.c governor.c lz.c text_io.c -o game_of_life_jobs -lpthread
+ * And run with:
+ * 	   ./game_of_life_jobs job-file [num-threads [memory-budget-MiB]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "helpers.h"
+#include "util.h"
+#include "scheduler.h"
+
+#define MAX_TENANTS 64
+
+struct job {
+	struct sched_job* sched_job;
+	char input_file[256], output_file[256];
+};
+
+int main(int argc, char* const argv[]) {
+	if (argc < 2 || argc > 4) { printf("Wrong number of arguments!\n"); return 1; }
+	size_t num_threads = argc > 2 ? atoi(argv[2]) : 0;
+	size_t memory_budget = argc > 3 ? (size_t)atoi(argv[3]) << 20 : 0;
+
+	FILE* jobs_file = fopen(argv[1], "r");
+	if (!jobs_file) { perror(argv[1]); return 1; }
+	struct scheduler* sched = sched_create(num_threads, memory_budget);
+	if (!sched) { perror("sched_create"); return 1; }
+
+	// Begin timing
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// Submit every job, they start running while the rest are submitted
+	char tenant_names[MAX_TENANTS][64], tenant[64], line[1024];
+	int tenant_ids[MAX_TENANTS];
+	size_t n_tenants = 0, n_jobs = 0, iterations;
+	double weight;
+	struct job* jobs = NULL;
+	while (fgets(line, sizeof(line), jobs_file)) {
+		struct job job;
+		if (line[0] == '#' || line[strspn(line, " \t\r\n")] == 0) { continue; }
+		if (sscanf(line, "%63s %lf %zu %255s %255s", tenant, &weight, &iterations, job.input_file, job.output_file) != 5) {
+			fprintf(stderr, "Invalid job: %s", line);
+			continue;
+		}
+		size_t t = 0;
+		while (t < n_tenants && strcmp(tenant_names[t], tenant) != 0) { t++; }
+		if (t == n_tenants) {
+			if (n_tenants == MAX_TENANTS) { fprintf(stderr, "Too many tenants: %s\n", tenant); continue; }
+			int id = sched_add_tenant(sched, weight);
+			if (id < 0) { perror("sched_add_tenant"); continue; }
+			strcpy(tenant_names[n_tenants], tenant);
+			tenant_ids[n_tenants++] = id;
+		}
+
+		job.sched_job = sched_submit_path(sched, tenant_ids[t], job.input_file, iterations);
+		if (!job.sched_job) { perror(job.input_file); continue; }
+		jobs = (struct job*)realloc(jobs, (n_jobs+1)*sizeof(struct job));
+		jobs[n_jobs++] = job;
+	}
+	fclose(jobs_file);
+
+	// Save each job as it finishes, in submission order
+	for (size_t i = 0; i < n_jobs; i++) {
+		double latency = sched_wait(jobs[i].sched_job);
+		printf("%s: ", jobs[i].output_file);
+		print_time(latency);
+		printf("\n");
+		size_t m, n;
+		const uint8_t* grid = sched_job_grid(jobs[i].sched_job, &m, &n);
+		if (!grid) { perror(jobs[i].input_file); }
+		else if (!grid_to_npy_path(jobs[i].output_file, grid, 1, m, n)) { perror(jobs[i].output_file); }
+		sched_job_free(jobs[i].sched_job);
+	}
+
+	// End timing
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("Time: %g secs\n", get_time_diff(&start, &end));
+	sched_print_stats(sched);
+
+	// Cleanup
+	sched_destroy(sched);
+	free(jobs);
+	return 0;
+}
@@ -0,0 +1,123 @@
+/**
+ * Conway's Game of Life on run-length encoded rows
+ * 
+ * This version runs in serial on rows stored as runs of live cells, see
+ * rle.h. The grid is only expanded to bytes to load and save it. Compile with:
+ *     gcc -Wall -O3 -march=native game_of_life_rle.c rle.c util.c cost_model.c governor.c helpers.c -o game_of_life_rle
+ * And run with:
+ * 	   ./game_of_life_rle [--dry-run] num-of-iterations input-file output-file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <time.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "rle.h"
+#include "cost_model.h"
+#include "util.h"
+
+int main(int argc, char* const argv[]) {
+	size_t iterations = 3;
+	const char * input_file = "examples/input.npy";
+	const char * output_file = "output.npy";
+
+	// Parse options, they come before the positional arguments
+	//   --dry-run only print the predicted time and memory of the run, and calibrate the model (see cost_model.h)
+	static const struct option long_options[] = { {"dry-run", no_argument, NULL, 'D'}, {NULL, 0, NULL, 0} };
+	bool dry_run = false;
+	int opt;
+	while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+		if (opt == 'D') { dry_run = true; }
+		else { return 1; }
+	}
+	argc -= optind - 1;
+	argv += optind - 1;
+
+	// Parse command line arguments
+	// Can have num iterations, input and output file, or num iterations and input and output files
+	if (argc > 4) { printf("Wrong number of arguments!\n"); return 1; }
+	if (argc == 2) {
+		iterations = atoi(argv[1]);
+	} else if (argc == 3) {
+		input_file = argv[1];
+		output_file = argv[2];
+	} else if (argc == 4) {
+		iterations = atoi(argv[1]);
+		input_file = argv[2];
+		output_file = argv[3];
+	}
+	if (iterations <= 0) { fprintf(stderr, "Must specify a positive number of iterations\n"); return 1; }
+
+	// Messages go to stderr when the grid is written to stdout
+	if (strcmp(output_file, NPY_STDIO_PATH) == 0 && !reserve_stdout_for_data()) { perror("reserve_stdout_for_data"); return 1; }
+
+	size_t m, n;
+	uint8_t* grid = grid_from_npy_path(input_file, &m, &n);
+	if (!grid) { perror("grid_from_npy_path(grid)"); return 1; }
+
+	// Predict the time and memory of the run, a dry run stops there
+	// Only a dry run or $GOL_COST_LEARN calibrates and saves the model, others only read it
+	struct cost_model model;
+	const char* model_path = cost_model_path();
+	bool learn = dry_run || cost_model_learning();
+	if (!cost_model_load(&model, model_path) && learn) { cost_model_calibrate(&model); }
+	double density = cost_density_sample(grid, m, n);
+	struct cost_estimate estimate;
+	cost_estimate(&model, &estimate, COST_ENGINE_RLE, m, n, density, iterations, 1, m*n, 0);
+	if (dry_run) {
+		print_cost_estimate(&model, &estimate);
+		if (!cost_model_save(&model, model_path)) { perror(model_path); return 1; }
+		return 0;
+	}
+
+	// Begin timing
+	struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// Encode the input, this does not modify it
+	struct rle_grid current, next;
+	if (!rle_from_dense(&current, grid, m, n) || !rle_init(&next, m, n)) { perror("rle_from_dense"); return 1; }
+	size_t runs_start = rle_count_runs(&current);
+
+	// Begin simulation. Update the grid every iteration
+	for (size_t step = 0; step < iterations; step++) {
+		if (!rle_step(&current, &next)) { perror("rle_step"); return 1; }
+		struct rle_grid temp = current;
+		current = next;
+		next = temp;
+  	}
+
+	// End timing
+    clock_gettime(CLOCK_MONOTONIC, &end);
+	double time = get_time_diff(&start, &end);
+    printf("Time: %g secs\n", time);
+	printf("Runs: %zu at the start, %zu at the end\n", runs_start, rle_count_runs(&current));
+
+	// Correct a learning cost model with what the run took
+	struct resource_usage usage;
+	get_resource_usage(&usage);
+	print_cost_observation(&estimate, time, usage.peak_rss);
+	if (learn) {
+		cost_model_observe(&model, &estimate, time, usage.peak_rss);
+		if (!cost_model_save(&model, model_path)) { perror(model_path); }
+	}
+
+	// Save the last updated grid to the output file
+	uint8_t* dense = (uint8_t*)malloc(m*n*sizeof(uint8_t));
+	rle_to_dense(&current, dense);
+	if (!grid_to_npy_path(output_file, dense, 1, m, n)) { perror(output_file); return 1; }
+
+	// Cleanup
+	size_t addr = ((size_t)grid) & ~(sysconf(_SC_PAGE_SIZE)-1);
+	munmap((void*)addr, m*n*sizeof(uint8_t));
+	free(dense);
+	rle_free(&current);
+	rle_free(&next);
+  	return 0;
+}
@@ -2,14 +2,20 @@
  * Conway's Game of Life in serial
  * 
  * This version runs in serial. Compile with:
- *     gcc -Wall -O3 -march=native game_of_life_serial.c helpers.c util.c -o game_of_life_serial
+ *     gcc -Wall -O3 -march=native game_of_life_serial.c helpers.c util.c governor.c metrics.c frame_ring.c snapshot.c async_writer.c budget.c activity.c lz.c text_io.c pyramid.c cost_model.c window.c spaceship.c replay.c -o game_of_life_serial -lpthread -lrt
  * And run with:
- * 	   ./game_of_life_serial num-of-iterations input-file output-file
+ * 	   ./game_of_life_serial [-a] [-m] [-p port] [-f every] [-y levels] [-w row,col,rows,cols] [-s stride | -x pool] [-g generations] [-e every] [-r] [--dry-run] [-t time | -c time | -u cells] [-z num-threads] num-of-iterations input-file output-file
+ * The input and output files can be - to read the grid from stdin and write the history to stdout:
+ *     generate_board | ./game_of_life_serial 100 - - | zstd > history.npy.zst
+ * A budget cannot be combined with streaming a history too large for memory
+ * to stdout, the header is rewritten when the budget stops the run.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <stdint.h>
 #include <inttypes.h>
 #include <time.h>
@@ -18,6 +24,19 @@
 
 #include "helpers.h"
 #include "util.h"
+#include "governor.h"
+#include "metrics.h"
+#include "frame_ring.h"
+#include "snapshot.h"
+#include "async_writer.h"
+#include "budget.h"
+#include "activity.h"
+#include "lz.h"
+#include "pyramid.h"
+#include "cost_model.h"
+#include "window.h"
+#include "spaceship.h"
+#include "replay.h"
 
 
 int main(int argc, char* const argv[]) {
@@ -25,6 +44,77 @@ int main(int argc, char* const argv[]) {
 	const char * input_file = "examples/input.npy";
 	const char * output_file = "output/out.npy";
 
+	// Parse options, they come before the positional arguments
+	//   -m       publish live metrics in shared memory (read them with gol_stats)
+	//   -p port  also serve the metrics at http://127.0.0.1:port/metrics
+	//   -f every publish every that many generations in a shared-memory frame ring (see frame_ring.h)
+	//   -t time  stop at the last generation that finishes within the wall-clock time (e.g. 200ms)
+	//   -c time  stop at the last generation that finishes within the CPU time (e.g. 1.5s)
+	//   -u cells stop at the last generation that stays within the number of cell updates
+	// The number of iterations is still the upper limit when a budget is given, and the output has to be seekable if it is streamed
+	//   -a       accumulate per-cell activity and save it next to the output file
+	//   -y levels save that many levels of density pyramids next to the output file (see pyramid.h)
+	//   --dry-run only print the predicted time and memory of the run, and calibrate the model (see cost_model.h)
+	//   -z num   compress the history with that many encoder threads as it is produced (read it with gol_unlz), not to stdout
+	//   -w row,col,rows,cols  only output that rectangle of the grid
+	//   -s stride only output every stride-th cell of every stride-th row
+	//   -x pool  only output pool by pool blocks, alive if any of their cells is
+	//   -g every:k | list:g1,g2,... | log[:base]  only output those generations (see window.h)
+	//   -e every delete escaping gliders and spaceships every that many generations (see spaceship.h)
+	//   -r       replay still and oscillating tiles instead of computing them (see replay.h)
+	bool publish_metrics = false, track_activity = false, replay_tiles = false;
+	int metrics_port = 0, publish_every = 0, pyramid_levels = 0, remove_every = 0, encoders = 0, opt;
+	struct run_budget budget;
+	budget_init(&budget, BUDGET_NONE, 0);
+	static const struct option long_options[] = { {"dry-run", no_argument, NULL, 'D'}, {NULL, 0, NULL, 0} };
+	bool dry_run = false;
+	struct output_window window;
+	window_defaults(&window);
+	while ((opt = getopt_long(argc, argv, "amp:t:c:u:z:f:y:w:s:x:g:e:r", long_options, NULL)) != -1) {
+		if (opt == 'a') { track_activity = true; }
+		else if (opt == 'w') {
+			if (!window_parse_crop(&window, optarg)) { fprintf(stderr, "Invalid window: %s\n", optarg); return 1; }
+		}
+		else if (opt == 's' || opt == 'x') {
+			window.factor = atoi(optarg);
+			window.max_pool = opt == 'x';
+			if (window.factor <= 0) { fprintf(stderr, "Must specify a positive stride or pool factor\n"); return 1; }
+		}
+		else if (opt == 'g') {
+			if (!window_parse_generations(&window, optarg)) { fprintf(stderr, "Invalid generations: %s\n", optarg); return 1; }
+		}
+		else if (opt == 'e') {
+			remove_every = atoi(optarg);
+			if (remove_every <= 0) { fprintf(stderr, "Must remove spaceships a positive number of generations apart\n"); return 1; }
+		}
+		else if (opt == 'r') { replay_tiles = true; }
+		else if (opt == 'D') { dry_run = true; }
+		else if (opt == 'm') { publish_metrics = true; }
+		else if (opt == 'p') { publish_metrics = true; metrics_port = atoi(optarg); }
+		else if (opt == 'y') {
+			pyramid_levels = atoi(optarg);
+			if (pyramid_levels <= 0) { fprintf(stderr, "Must specify a positive number of pyramid levels\n"); return 1; }
+		}
+		else if (opt == 'f') {
+			publish_every = atoi(optarg);
+			if (publish_every <= 0) { fprintf(stderr, "Must publish a positive number of generations apart\n"); return 1; }
+		}
+		else if (opt == 't' || opt == 'c') {
+			double seconds;
+			if (!parse_duration(optarg, &seconds)) { fprintf(stderr, "Invalid time: %s\n", optarg); return 1; }
+			budget_init(&budget, opt == 't' ? BUDGET_WALL : BUDGET_CPU, seconds);
+		} else if (opt == 'u') {
+			double cells = atof(optarg);
+			if (cells <= 0) { fprintf(stderr, "Must specify a positive number of cell updates\n"); return 1; }
+			budget_init(&budget, BUDGET_CELLS, cells);
+		} else if (opt == 'z') {
+			encoders = atoi(optarg);
+			if (encoders <= 0) { fprintf(stderr, "Must specify a positive number of encoder threads\n"); return 1; }
+		} else { return 1; }
+	}
+	argc -= optind - 1;
+	argv += optind - 1;
+
 	// Parse command line arguments
 	// Can have num iterations, input and output file, or num iterations and input and output files
 	if (argc > 4) { printf("Wrong number of arguments!\n"); return 1; }
@@ -39,44 +129,226 @@ int main(int argc, char* const argv[]) {
 		input_file = argv[2];
 		output_file = argv[3];
 	}
+	if (encoders && strcmp(output_file, NPY_STDIO_PATH) == 0) { fprintf(stderr, "A compressed history cannot be written to stdout\n"); return 1; }
+
+	// Messages go to stderr when the history is written to stdout
+	if (strcmp(output_file, NPY_STDIO_PATH) == 0 && !reserve_stdout_for_data()) { perror("reserve_stdout_for_data"); return 1; }
+
+	// Resource snapshots at the start and the end of the load, simulate and save phases
+	struct resource_usage usage[4];
+	get_resource_usage(&usage[0]);
 
 	size_t m, n;
-	uint8_t* grid = grid_from_npy_path(input_file, &m, &n);  // Load input file
+	uint8_t* grid = grid_load_path(input_file, &m, &n);  // Load input file, either format
 	if (!grid) { perror("grid_from_npy_path(grid)"); return 1; }
+	get_resource_usage(&usage[1]);
+
+	// The output is only the selected part of the selected generations
+	if (!window_init(&window, m, n, iterations)) { fprintf(stderr, "Window outside of the %zux%zu grid\n", m, n); return 1; }
+	size_t grid_size = m * n, frame_size = window.out_m * window.out_n;
+	size_t frames = window_frames(&window, 0, iterations);
+
+	// Keep the history in memory if it fits, otherwise stream it to the output file
+	// A compressed history only keeps the frames queued for the encoders in memory
+	// The plan counts the history in whole grids, the output frames may be smaller
+	struct run_plan plan;
+	size_t history_grids = encoders ? 2*encoders : (frames*frame_size + grid_size-1) / grid_size;
+	if (!plan_run(&plan, m, n, history_grids, 1)) { perror("plan_run"); return 1; }
+	print_run_plan(&plan);
+	bool streaming = !encoders && plan.output_mode == OUTPUT_STREAMING;
+
+	// Predict the time and memory of the run, a dry run stops there
+	// Only a dry run or $GOL_COST_LEARN calibrates and saves the model, others only read it
+	struct cost_model model;
+	const char* model_path = cost_model_path();
+	bool learn = dry_run || cost_model_learning();
+	if (!cost_model_load(&model, model_path) && learn) { cost_model_calibrate(&model); }
+	double density = cost_density_sample(grid, m, n);
+	size_t history_frames = streaming ? 0 : history_grids;
+	size_t output_bytes = frames*frame_size / (encoders ? 8 : 1); // compressed frames are a bit per cell at most
+	struct cost_estimate estimate;
+	cost_estimate(&model, &estimate, COST_ENGINE_DENSE, m, n, density, iterations, 1, output_bytes, history_frames);
+	if (dry_run) {
+		print_cost_estimate(&model, &estimate);
+		if (!cost_model_save(&model, model_path)) { perror(model_path); return 1; }
+		return 0;
+	}
+
+	// Publish the progress of the run for gol_stats and Prometheus
+	struct gol_metrics* metrics = NULL;
+	if (publish_metrics) {
+		metrics = metrics_create(m, n, iterations);
+		if (!metrics) { perror("metrics_create"); return 1; }
+		if (metrics_port && !metrics_serve(metrics, metrics_port)) { perror("metrics_serve"); return 1; }
+		printf("Publishing metrics for pid %ld\n", (long)getpid());
+	}
+
+	// Hand the generations to other processes through shared memory
+	struct gol_frame_ring* ring = NULL;
+	if (publish_every) {
+		ring = frame_ring_create(m, n, GOL_FRAME_RING_SLOTS);
+		if (!ring) { perror("frame_ring_create"); return 1; }
+		printf("Publishing frames for pid %ld\n", (long)getpid());
+	}
+	// Density pyramids of every generation, written as they are computed
+	struct density_pyramid* pyramid = NULL;
+	if (pyramid_levels) {
+		pyramid = pyramid_open(output_file, m, n, pyramid_levels, iterations+1, 1);
+		if (!pyramid) { perror("pyramid_open"); return 1; }
+	}
+	FILE* out = NULL;
+	struct lz_writer* lz = NULL;
+	if (encoders) {
+		lz = lz_writer_open(output_file, window.out_m, window.out_n, encoders);
+		if (!lz) { perror(output_file); return 1; }
+	} else if (streaming) {
+		out = npy_open_output(output_file);
+		if (!out) { perror(output_file); return 1; }
+		if (budget.kind != BUDGET_NONE && fseek(out, 0, SEEK_CUR) != 0) {
+			fprintf(stderr, "A budget needs a seekable output file to stream the history to, not %s\n", output_file); return 1;
+		}
+		if (!grid_to_npy_header(out, frames, window.out_m, window.out_n)) { perror(output_file); return 1; }
+	}
+
+	// Escaping spaceships are deleted from the board before it is saved
+	struct spaceship_filter* ships = NULL;
+	if (remove_every) {
+		ships = spaceship_filter_open(output_file, m, n, SPACESHIP_MARGIN);
+		if (!ships) { perror("spaceship_filter_open"); return 1; }
+	}
+
+	// SIGUSR1 saves a snapshot of the board, SIGUSR2 reports the progress
+	if (!snapshot_install(output_file)) { perror("snapshot_install"); return 1; }
 
 	// Allocate a copy of the input-file to not modify it
 	// Begin timing
 	struct timespec start, end;
     clock_gettime(CLOCK_MONOTONIC, &start);
 
-	size_t grid_size = m * n;
 	uint8_t* grid_copy = (uint8_t*) malloc(grid_size*sizeof(uint8_t));
 	uint8_t* grid_next = (uint8_t*) malloc(grid_size*sizeof(uint8_t));
-	uint8_t* grids = (uint8_t*) malloc((iterations+1)*grid_size*sizeof(uint8_t));  // Saves a grid per iteration
+	uint8_t* grids = streaming || lz ? NULL : grid_alloc(frames*frame_size*sizeof(uint8_t));  // Saves a frame per selected generation
+	uint8_t* window_frame = window_is_full(&window) ? NULL : (uint8_t*) malloc(frame_size ? frame_size : 1);
 	memcpy(grid_copy, grid, grid_size);
-	memcpy(grids, grid, grid_size);
+
+	// Activity accumulators, updated together with the grid
+	struct activity act;
+	if (track_activity && !activity_init(&act, m, n)) { perror("activity_init"); return 1; }
+
+	// Periodic tiles are copied from the frames before instead of computed
+	struct tile_replay* replay = NULL;
+	if (replay_tiles) {
+		if (track_activity) { fprintf(stderr, "Cannot track activity of replayed tiles\n"); return 1; }
+		replay = replay_create(grid_copy, m, n, REPLAY_TILE, REPLAY_MAX_PERIOD, REPLAY_CYCLES, 1);
+		if (!replay) { perror("replay_create"); return 1; }
+	}
 
 	// Begin simulation. Update the grid every iteration and save it
-	for (size_t step = 0; step < iterations; step++) {
-		for (size_t i = 0; i < grid_size; i++) {
-			update(grid_copy, grid_next, i, n);
+	// The run stops early at the generation boundary where the budget is used up
+	// Only the selected generations are reduced to their frame and saved
+	size_t step = 0, frames_out = 0;
+	if (ring) { frame_ring_publish(ring, 0, grid_copy); }
+	if (pyramid && !pyramid_append(pyramid, grid_copy)) { perror("pyramid_append"); return 1; }
+	budget_start(&budget);
+	for (;; step++) {
+		if (window_selects(&window, step)) {
+			const uint8_t* frame = window_apply(&window, grid_copy, window_frame);
+			if (lz) {
+				if (!lz_writer_append(lz, frame)) { perror(output_file); return 1; }
+			} else if (streaming) {
+				if (fwrite(frame, 1, frame_size, out) != frame_size) { perror(output_file); return 1; }
+			} else {
+				memcpy(grids+frames_out*frame_size, frame, frame_size);
+			}
+			frames_out++;
+		}
+		if (step == iterations || budget_exhausted(&budget, step, grid_size)) { break; }
+		if (track_activity) {
+			update_rows_activity(grid_copy, grid_next, 0, m, n, &act, step+1);
+		} else if (replay) {
+			replay_step(replay, grid_copy, grid_next);
+		} else {
+			for (size_t i = 0; i < grid_size; i++) {
+				update(grid_copy, grid_next, i, m, n);
+			}
 		}
 		swap(&grid_copy, &grid_next);
-		memcpy(grids+step*grid_size, grid_copy, grid_size);
+		if (ships && (step+1) % remove_every == 0) {
+			size_t removed = spaceship_filter_apply(ships, grid_copy, step+1);
+			if (removed == (size_t)-1) { perror("spaceship_filter_apply"); return 1; }
+			if (removed && replay) { replay_changed(replay, grid_copy); }
+		}
+		if (ring && (step+1) % publish_every == 0) { frame_ring_publish(ring, step+1, grid_copy); }
+		if (pyramid && !pyramid_append(pyramid, grid_copy)) { perror("pyramid_append"); return 1; }
+		if (metrics) {
+			metrics_generation(metrics, step+1, grid_copy, grid_size);
+			if (grids) { metrics_store(metrics->io_backlog_bytes, frames_out*frame_size); }
+		}
+		if (snapshot_pending()) {
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			snapshot_service(grid_copy, m, n, step+1, iterations, get_time_diff(&start, &end));
+		}
   	}
 
+	if (ring) { frame_ring_finish(ring); }
+	if (pyramid && !pyramid_close(pyramid)) { perror("pyramid_close"); return 1; }
+	if (replay) {
+		replay_print_stats(replay);
+		replay_free(replay);
+	}
+	if (ships) {
+		spaceship_filter_print_stats(ships);
+		if (!spaceship_filter_close(ships)) { perror("spaceship_filter_close"); return 1; }
+	}
+
 	// End timing
 	clock_gettime(CLOCK_MONOTONIC, &end);
     double time = end.tv_sec-start.tv_sec+(end.tv_nsec-start.tv_nsec)/1000000000.0;
     printf("Time: %g secs\n", time);
+	printf("Generations: %zu\n", step);
+
+	get_resource_usage(&usage[2]);
+
+	// Correct a learning cost model with what the run took, if it only ran the dense engine into memory
+	cost_estimate(&model, &estimate, COST_ENGINE_DENSE, m, n, density, step, 1, output_bytes, history_frames);
+	print_cost_observation(&estimate, time, usage[2].peak_rss);
+	if (learn && !track_activity && !pyramid_levels && !replay_tiles && !remove_every && !encoders && !streaming) {
+		cost_model_observe(&model, &estimate, time, usage[2].peak_rss);
+		if (!cost_model_save(&model, model_path)) { perror(model_path); }
+	}
 
 	// Save each updated grid to the output file
-	grid_to_npy_path(output_file, grids, iterations+1, m, n);
+	// A run stopped by its budget has fewer frames than the header written up front says
+	// The history buffer is handed over (and freed) when it is saved, a pipe gets its pages without a copy
+	if (lz) {
+		if (!lz_writer_close(lz)) { perror(output_file); return 1; }
+	} else if (streaming) {
+		if (frames_out < frames && (fseek(out, 0, SEEK_SET) != 0 || !grid_to_npy_header(out, frames_out, window.out_m, window.out_n))) {
+			perror(output_file); return 1;
+		}
+		if (fclose(out) != 0) { perror(output_file); return 1; }
+	} else if (!grid_to_npy_path_splice(output_file, grids, frames*frame_size, frames_out, window.out_m, window.out_n)) {
+		perror(output_file); return 1;
+	}
+	if (metrics) { metrics_store(metrics->io_backlog_bytes, 0); }
+	if (track_activity) {
+		if (!activity_to_npy(&act, output_file)) { perror("activity_to_npy"); return 1; }
+		activity_free(&act);
+	}
+	get_resource_usage(&usage[3]);
+	print_resource_usage("Load", &usage[0], &usage[1]);
+	print_resource_usage("Simulate", &usage[1], &usage[2]);
+	print_resource_usage("Save", &usage[2], &usage[3]);
 
 	// Cleanup
+	if (!async_writer_finish()) { fprintf(stderr, "Failed to write a snapshot\n"); }
 	size_t addr = ((size_t)grid) & ~(sysconf(_SC_PAGE_SIZE)-1);
 	munmap((void*)addr, grid_size*sizeof(uint8_t));
 	free(grid_next);
 	free(grid_copy);
+	free(window_frame);
+	window_free(&window);
+	metrics_destroy(metrics);
+	frame_ring_destroy(ring);
   	return 0;
 }
@@ -0,0 +1,111 @@
+/**
+ * Conway's Game of Life for tiny boards
+ * 
+ * This version runs in serial with as little startup work as possible: no
+ * OpenMP, no governor or metrics, the input is read with a single pread()
+ * into a static buffer, and the grids live in static buffers for boards up
+ * to TINY_MAX_CELLS (larger boards still work, from the heap). It writes the
+ * same history as game_of_life_serial. Compile it statically linked with:
+ *     gcc -Wall -O3 -march=native -static game_of_life_tiny.c helpers.c util.c -o game_of_life_tiny
+ * And run with:
+ * 	   ./game_of_life_tiny num-of-iterations input-file output-file
+ * Measure the startup latency with gol_startup_bench.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "helpers.h"
+#include "util.h"
+
+#define TINY_MAX_CELLS (128*128)
+
+// Static buffers for the input file (with room for the header), the next
+// generation and the output stream
+static uint8_t __input[TINY_MAX_CELLS + 4096];
+static uint8_t __grid_next[TINY_MAX_CELLS];
+static char __output_buffer[1 << 16];
+
+int main(int argc, char* const argv[]) {
+	size_t iterations = 3;
+	const char * input_file = "examples/input.npy";
+	const char * output_file = "output/out.npy";
+
+	// Parse command line arguments
+	// Can have num iterations, input and output file, or num iterations and input and output files
+	if (argc > 4) { printf("Wrong number of arguments!\n"); return 1; }
+	if (argc == 2) {
+		iterations = atoi(argv[1]);
+		if (iterations <= 0) { fprintf(stderr, "Must specify a positive number of iterations\n"); return 1; }
+	} else if (argc == 3) {
+		input_file = argv[1];
+		output_file = argv[2];
+	} else if (argc == 4) {
+		iterations = atoi(argv[1]);
+		input_file = argv[2];
+		output_file = argv[3];
+	}
+	if (strcmp(output_file, NPY_STDIO_PATH) == 0 && !reserve_stdout_for_data()) { perror("reserve_stdout_for_data"); return 1; }
+
+	// Load the input file, the grid is a copy so it is stepped in place
+	size_t m, n;
+	uint8_t* heap_grid = NULL, * heap_next = NULL;
+	bool from_file = strcmp(input_file, NPY_STDIO_PATH) != 0;
+	uint8_t* grid = from_file ? grid_from_npy_pread(input_file, __input, sizeof(__input), &m, &n) : NULL;
+	if (!from_file || (!grid && errno == EFBIG)) {
+		// too big for the static buffer, a stream, or to be converted: load it the usual way and copy it
+		uint8_t* file_grid = grid_from_npy_path(input_file, &m, &n);
+		if (file_grid) {
+			grid = heap_grid = (uint8_t*)malloc(m*n*sizeof(uint8_t));
+			if (grid) { memcpy(grid, file_grid, m*n); }
+			// the mapping starts at the page of the header
+			size_t addr = ((size_t)file_grid) & ~(sysconf(_SC_PAGE_SIZE)-1);
+			munmap((void*)addr, (size_t)file_grid - addr + m*n);
+		}
+	}
+	if (!grid) { perror("grid_from_npy_path(grid)"); return 1; }
+	size_t grid_size = m * n;
+	uint8_t* grid_next = __grid_next;
+	if (grid_size > TINY_MAX_CELLS) {
+		grid_next = heap_next = (uint8_t*)malloc(grid_size*sizeof(uint8_t));
+		if (!grid_next) { perror("malloc(grid_next)"); return 1; }
+	}
+
+	// Each generation is written as soon as it is computed
+	FILE* out = npy_open_output(output_file);
+	if (!out) { perror(output_file); return 1; }
+	setvbuf(out, __output_buffer, _IOFBF, sizeof(__output_buffer));
+	if (!grid_to_npy_header(out, iterations+1, m, n) || fwrite(grid, 1, grid_size, out) != grid_size) {
+		perror(output_file); return 1;
+	}
+
+	// Begin timing
+	struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// Begin simulation. Update the grid every iteration and save it
+	for (size_t step = 0; step < iterations; step++) {
+		for (size_t i = 0; i < grid_size; i++) {
+			update(grid, grid_next, i, m, n);
+		}
+		swap(&grid, &grid_next);
+		if (fwrite(grid, 1, grid_size, out) != grid_size) { perror(output_file); return 1; }
+  	}
+
+	// End timing
+	clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("Time: %g secs\n", get_time_diff(&start, &end));
+	if (fclose(out) != 0) { perror(output_file); return 1; }
+
+	// Cleanup, only the grids of a large board are on the heap
+	free(heap_grid);
+	free(heap_next);
+  	return 0;
+}
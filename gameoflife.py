@@ -0,0 +1,89 @@
+"""
+Python bindings for libgameoflife.so (see life.h).
+
+Grids are shared with the library without copying: any writable,
+C-contiguous buffer of bytes works, such as a 2D numpy uint8 array, and it
+is stepped in place. The GIL is released while the library runs, so other
+Python threads keep going. Build the library with the command in life.h
+and put it next to this file, or point GOL_LIBRARY at it.
+
+    import numpy as np, gameoflife
+    grid = np.load("examples/data256.npy")
+    gameoflife.run(grid, 100, threads=4)               # grid now holds generation 100
+    frames = gameoflife.run(grid, 10, history=True)    # frames[k] is generation k, a view
+"""
+
+import ctypes
+import os
+
+ENGINES = {"dense": 0, "rle": 1}
+
+_lib = None
+
+
+def _library():
+    global _lib
+    if _lib is None:
+        path = os.environ.get("GOL_LIBRARY") or \
+            os.path.join(os.path.dirname(os.path.abspath(__file__)), "libgameoflife.so")
+        # functions of a CDLL release the GIL for the duration of the call
+        _lib = ctypes.CDLL(path, use_errno=True)
+        _lib.life_run_engine.restype = ctypes.c_size_t
+        _lib.life_run_engine.argtypes = [
+            ctypes.c_void_p, ctypes.c_size_t, ctypes.c_size_t, ctypes.c_size_t,
+            ctypes.c_size_t, ctypes.c_int, ctypes.c_void_p, ctypes.c_void_p]
+    return _lib
+
+
+def _address(buffer):
+    """Get the address of a writable buffer without copying it."""
+    return ctypes.addressof(ctypes.c_uint8.from_buffer(buffer))
+
+
+def _shape(grid, shape):
+    """Get the rows and columns of a grid, checking it can be shared."""
+    view = memoryview(grid)
+    if view.readonly:
+        raise ValueError("grid must be writable")
+    if not view.c_contiguous or view.itemsize != 1:
+        raise ValueError("grid must be a C-contiguous array of bytes")
+    if shape is None:
+        if view.ndim != 2:
+            raise ValueError("shape is required for grids that are not 2D")
+        shape = view.shape
+    m, n = shape
+    if m * n != view.nbytes:
+        raise ValueError("shape does not match the size of the grid")
+    return m, n
+
+
+def _frames(buffer, count, m, n):
+    """Views of the frames of a history buffer, as numpy if it is available."""
+    try:
+        import numpy
+    except ImportError:
+        return memoryview(buffer).cast("B", (count, m, n))
+    return numpy.frombuffer(buffer, dtype=numpy.uint8).reshape(count, m, n)
+
+
+def run(grid, iterations, threads=0, engine="dense", history=False, shape=None):
+    """
+    Steps a grid in place for the given number of generations with one of
+    the ENGINES and the number of threads (0 uses the CPU quota, the rle
+    engine is always serial).
+
+    Returns the grid, or with history=True the iterations+1 generations as
+    views of a single buffer the library wrote them into.
+    """
+    m, n = _shape(grid, shape)
+    if engine not in ENGINES:
+        raise ValueError("unknown engine %r, expected one of %s" % (engine, ", ".join(ENGINES)))
+    lib = _library()
+    frames = bytearray((iterations + 1) * m * n) if history else None
+    reached = lib.life_run_engine(
+        _address(grid), m, n, iterations, threads, ENGINES[engine],
+        _address(frames) if history else None, None)
+    if reached == ctypes.c_size_t(-1).value:
+        errno = ctypes.get_errno()
+        raise OSError(errno, os.strerror(errno))
+    return _frames(frames, reached + 1, m, n) if history else grid
@@ -0,0 +1,119 @@
+/**
+ * Compare two boards or histories
+ *
+ * Reports the first generation and cell where two NPY or compressed files
+ * differ, how many cells differ, and a heatmap of where, see diff.h. Exits
+ * with 0 if the files match, 1 if they differ and 2 if they cannot be
+ * compared. Compile with:
+ *     gcc -Wall -O3 -march=native gol_diff.c diff.c lz.c text_io.c util.c -o gol_diff -lpthread
+ * And run with:
+ * 	   ./gol_diff [-q] [-a packed-cols] [-b packed-cols] [-s block] [-H heatmap-file] [-t num-threads] file-a file-b
+ * where -a and -b say a file has bit-packed rows and -H saves the heatmap as
+ * a NPY file of uint64 counts.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "diff.h"
+#include "util.h"
+
+#define HEATMAP_MAX_SIDE 64 // blocks per side of the default heatmap
+
+/**
+ * Prints the heatmap with a character per block, darker for more mismatches.
+ */
+static void print_heatmap(const struct diff_result* result) {
+	const char* shades = " .:-=+*#%@";
+	uint64_t max = 1;
+	for (size_t i = 0; i < result->heat_m * result->heat_n; i++) {
+		if (result->heatmap[i] > max) { max = result->heatmap[i]; }
+	}
+	printf("Heatmap (%zux%zu cells per character, '@' is %" PRIu64 " mismatches):\n", result->block, result->block, max);
+	for (size_t i = 0; i < result->heat_m; i++) {
+		for (size_t j = 0; j < result->heat_n; j++) {
+			uint64_t count = result->heatmap[i*result->heat_n + j];
+			putchar(shades[(count * 9 + max - 1) / max]);
+		}
+		putchar('\n');
+	}
+}
+
+int main(int argc, char* const argv[]) {
+	// parse the options
+	bool quiet = false;
+	size_t packed_a = 0, packed_b = 0, block = 0, num_threads = 0;
+	const char* heatmap_file = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "qa:b:s:H:t:")) != -1) {
+		switch (opt) {
+			case 'q': quiet = true; break;
+			case 'a': packed_a = atol(optarg); break;
+			case 'b': packed_b = atol(optarg); break;
+			case 's': block = atol(optarg); break;
+			case 'H': heatmap_file = optarg; break;
+			case 't': num_threads = atol(optarg); break;
+			default: return 2;
+		}
+	}
+	argc -= optind - 1;
+	argv += optind - 1;
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s [-q] [-a packed-cols] [-b packed-cols] [-s block] [-H heatmap-file] [-t num-threads] file-a file-b\n", argv[0]);
+		return 2;
+	}
+
+	struct diff_input a, b;
+	if (!diff_open(&a, argv[1], packed_a)) { perror(argv[1]); return 2; }
+	if (!diff_open(&b, argv[2], packed_b)) { perror(argv[2]); return 2; }
+	if (a.m != b.m || a.n != b.n) {
+		printf("Shapes differ: %zux%zu and %zux%zu\n", a.m, a.n, b.m, b.n);
+		return 1;
+	}
+	if (block == 0) {
+		size_t side = a.m > a.n ? a.m : a.n;
+		block = (side + HEATMAP_MAX_SIDE - 1) / HEATMAP_MAX_SIDE;
+	}
+
+	// Compare
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	struct diff_result result;
+	if (!diff_compare(&a, &b, block, num_threads, &result)) { perror("diff_compare"); return 2; }
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double time = get_time_diff(&start, &end);
+
+	// Report
+	bool differ = result.mismatches || a.frames != b.frames;
+	if (a.frames != b.frames) { printf("Frame counts differ: %zu and %zu\n", a.frames, b.frames); }
+	if (result.mismatches) {
+		printf("First mismatch: generation %zu, row %zu, column %zu\n", result.first_frame, result.first_row, result.first_col);
+		printf("Mismatches: %" PRIu64 " cells in %zu of %zu generations (last %zu)\n",
+			result.mismatches, result.differing_frames, result.frames, result.last_frame);
+		if (!quiet) { print_heatmap(&result); }
+	} else {
+		printf("%zu generations of %zux%zu match\n", result.frames, a.m, a.n);
+	}
+	if (heatmap_file) {
+		size_t shape[2] = { result.heat_m, result.heat_n };
+		if (!array_to_npy_path(heatmap_file, result.heatmap, "<u8", sizeof(uint64_t), shape, 2)) { perror(heatmap_file); return 2; }
+	}
+	if (!quiet) {
+		size_t bytes = (a.compressed ? 0 : a.map_size) + (b.compressed ? 0 : b.map_size);
+		printf("Time: "); print_time(time);
+		if (bytes) { printf(" ("); print_bytes((size_t)(bytes / time)); printf("/sec mapped)"); }
+		printf("\n");
+	}
+
+	// Cleanup
+	diff_result_free(&result);
+	diff_close(&a);
+	diff_close(&b);
+	return differ ? 1 : 0;
+}
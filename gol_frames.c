@@ -0,0 +1,47 @@
+/**
+ * Follow the frames of a running simulation
+ *
+ * Attaches to the frame ring published by a game_of_life_* process run with
+ * -f and prints the population of every frame it gets, as an example of a
+ * consumer. Compile with:
+ *     gcc -Wall -O3 gol_frames.c frame_ring.c metrics.c -o gol_frames -lrt
+ * And run with:
+ * 	   ./gol_frames pid [timeout-secs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "frame_ring.h"
+#include "metrics.h"
+
+int main(int argc, char* const argv[]) {
+	if (argc < 2 || argc > 3) { fprintf(stderr, "Usage: %s pid [timeout-secs]\n", argv[0]); return 1; }
+	pid_t pid = atoi(argv[1]);
+	double timeout = argc == 3 ? atof(argv[2]) : 10.0;
+
+	const struct gol_frame_ring* ring = frame_ring_attach(pid);
+	if (!ring) { perror("frame_ring_attach"); return 1; }
+	printf("Run %" PRIu64 ": %" PRIu64 "x%" PRIu64 " grid, %" PRIu64 " slots\n",
+		ring->pid, ring->rows, ring->cols, ring->n_slots);
+
+	// Read the frames in place, a frame overwritten while it was counted is dropped
+	struct frame_view view;
+	uint64_t next = 0, frames = 0, missed = 0;
+	while (frame_ring_wait(ring, next, timeout, &view)) {
+		size_t population = count_alive(view.grid, ring->rows * ring->cols);
+		if (frame_ring_valid(ring, &view)) {
+			printf("Generation %" PRIu64 ": %zu alive\n", view.generation, population);
+			frames++;
+		}
+		missed += view.seq - next;
+		next = view.seq + 1;
+	}
+	printf("Read %" PRIu64 " frames, missed %" PRIu64 "\n", frames, missed);
+
+	frame_ring_detach(ring);
+	return 0;
+}
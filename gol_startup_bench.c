@@ -0,0 +1,80 @@
+/**
+ * Cold-start latency of a game_of_life_* run
+ *
+ * Runs a command over and over and reports how long it takes from fork() to
+ * exit, which for tiny boards is mostly startup (dynamic linking, runtime
+ * initialization, loading the input) rather than the simulation. The first
+ * run is reported on its own since it is the only one with cold caches.
+ * Compile with:
+ *     gcc -Wall -O3 gol_startup_bench.c util.c -o gol_startup_bench
+ * And run with:
+ * 	   ./gol_startup_bench num-runs command [args...]
+ * For example:
+ *     ./gol_startup_bench 200 ./game_of_life_tiny 10 examples/data32.npy /tmp/out.npy
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "util.h"
+
+static int __compare(const void* a, const void* b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+
+/**
+ * Runs the command once with its output discarded. Returns the seconds from
+ * fork() until it exited, or a negative value if it failed.
+ */
+static double __run(char* const argv[]) {
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pid_t pid = fork();
+	if (pid < 0) { return -1; }
+	if (pid == 0) {
+		int null = open("/dev/null", O_WRONLY);
+		dup2(null, STDOUT_FILENO);
+		dup2(null, STDERR_FILENO);
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+	int status;
+	if (waitpid(pid, &status, 0) < 0) { return -1; }
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) { return -1; }
+	return get_time_diff(&start, &end);
+}
+
+int main(int argc, char* const argv[]) {
+	if (argc < 3) { fprintf(stderr, "Usage: %s num-runs command [args...]\n", argv[0]); return 1; }
+	int runs = atoi(argv[1]);
+	if (runs < 2) { fprintf(stderr, "Must do at least 2 runs\n"); return 1; }
+
+	double first = __run(argv + 2);
+	if (first < 0) { fprintf(stderr, "%s failed\n", argv[2]); return 1; }
+	double* times = (double*)malloc((runs-1)*sizeof(double));
+	double total = 0;
+	for (int i = 0; i < runs-1; i++) {
+		times[i] = __run(argv + 2);
+		if (times[i] < 0) { fprintf(stderr, "%s failed\n", argv[2]); return 1; }
+		total += times[i];
+	}
+	qsort(times, runs-1, sizeof(double), __compare);
+
+	printf("First run: "); print_time(first); printf("\n");
+	printf("Next %d runs: min ", runs-1); print_time(times[0]);
+	printf(", median "); print_time(times[(runs-1)/2]);
+	printf(", mean "); print_time(total/(runs-1));
+	printf(", p99 "); print_time(times[(size_t)((runs-1)*0.99)]);
+	printf("\n");
+
+	free(times);
+	return 0;
+}
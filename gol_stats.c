@@ -0,0 +1,62 @@
+/**
+ * Live statistics of a running simulation
+ *
+ * Attaches to the metrics segment published by a game_of_life_* process run
+ * with -m (or -p) and prints its progress until the run finishes. Compile with:
+ *     gcc -Wall -O3 gol_stats.c metrics.c util.c -o gol_stats -lpthread -lrt
+ * And run with:
+ * 	   ./gol_stats pid [interval-secs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include <signal.h>
+
+#include "metrics.h"
+#include "util.h"
+
+int main(int argc, char* const argv[]) {
+	if (argc < 2 || argc > 3) { fprintf(stderr, "Usage: %s pid [interval-secs]\n", argv[0]); return 1; }
+	pid_t pid = atoi(argv[1]);
+	double interval = argc == 3 ? atof(argv[2]) : 1.0;
+	if (interval <= 0) { fprintf(stderr, "Must specify a positive interval\n"); return 1; }
+
+	const struct gol_metrics* metrics = metrics_attach(pid);
+	if (!metrics) { perror("metrics_attach"); return 1; }
+	printf("Run %" PRIu64 ": %" PRIu64 "x%" PRIu64 " grid, %" PRIu64 " generations\n",
+		metrics->pid, metrics->rows, metrics->cols, metrics->generations_total);
+
+	struct timespec pause = { (time_t)interval, (long)((interval - (time_t)interval) * 1000000000.0) };
+	uint64_t last_cells = metrics_load(metrics->cells_updated);
+	uint64_t last_ns = metrics_load(metrics->update_ns);
+	for (;;) {
+		nanosleep(&pause, NULL);
+		uint64_t generation = metrics_load(metrics->generation);
+		uint64_t cells = metrics_load(metrics->cells_updated);
+		uint64_t update_ns = metrics_load(metrics->update_ns);
+
+		// throughput over the last interval and the time left at that rate
+		double secs = (update_ns - last_ns) / 1000000000.0;
+		double rate = secs > 0 ? (cells - last_cells) / secs : 0.0;
+		double left = (metrics->generations_total - generation) * (double)(metrics->rows * metrics->cols);
+		printf("generation %" PRIu64 "/%" PRIu64 ", %.3g cells/sec, population %" PRIu64 ", I/O backlog ",
+			generation, metrics->generations_total, rate, metrics_load(metrics->population));
+		print_bytes(metrics_load(metrics->io_backlog_bytes));
+		if (rate > 0) { printf(", ETA "); print_time(left / rate); }
+		uint64_t imbalance = metrics_load(metrics->imbalance_permille);
+		if (imbalance) { printf(", imbalance %.2f after %" PRIu64 " rebalances", imbalance / 1000.0, metrics_load(metrics->rebalances)); }
+		printf("\n");
+		fflush(stdout);
+		last_cells = cells;
+		last_ns = update_ns;
+
+		// the segment outlives a crashed run, so also stop once the process is gone
+		if (generation >= metrics->generations_total || kill(pid, 0) != 0) { break; }
+	}
+	metrics_detach(metrics);
+	return 0;
+}
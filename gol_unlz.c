@@ -0,0 +1,50 @@
+/**
+ * Decompress a history or checkpoint
+ *
+ * Converts a file written with -z back to a NPY file, either all of its
+ * frames or a single one. Compile with:
+ *     gcc -Wall -O3 gol_unlz.c lz.c text_io.c util.c -o gol_unlz -lpthread
+ * And run with:
+ * 	   ./gol_unlz input-file output-file [frame]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lz.h"
+#include "util.h"
+
+int main(int argc, char* const argv[]) {
+	if (argc < 3 || argc > 4) { fprintf(stderr, "Usage: %s input-file output-file [frame]\n", argv[0]); return 1; }
+	const char* input_file = argv[1];
+	const char* output_file = argv[2];
+	if (strcmp(output_file, NPY_STDIO_PATH) == 0 && !reserve_stdout_for_data()) { perror("reserve_stdout_for_data"); return 1; }
+
+	struct lz_file lz;
+	if (!lz_open(&lz, input_file)) { perror(input_file); return 1; }
+	size_t first = 0, last = lz.frames;
+	if (argc == 4) {
+		first = atol(argv[3]);
+		last = first + 1;
+		if (first >= lz.frames) { fprintf(stderr, "Only %zu frames in %s\n", lz.frames, input_file); return 1; }
+	}
+	printf("%zu frames of %zux%zu\n", lz.frames, lz.m, lz.n);
+
+	// The frames are decompressed one at a time straight to the output
+	FILE* out = npy_open_output(output_file);
+	uint8_t* grid = (uint8_t*)malloc(lz.m*lz.n*sizeof(uint8_t));
+	if (!out || !grid || !grid_to_npy_header(out, last - first, lz.m, lz.n)) { perror(output_file); return 1; }
+	for (size_t frame = first; frame < last; frame++) {
+		if (!lz_read_frame(&lz, frame, grid)) { perror(input_file); return 1; }
+		if (fwrite(grid, 1, lz.m*lz.n, out) != lz.m*lz.n) { perror(output_file); return 1; }
+	}
+	if (fclose(out) != 0) { perror(output_file); return 1; }
+
+	// Cleanup
+	free(grid);
+	lz_close(&lz);
+	return 0;
+}
@@ -0,0 +1,233 @@
+/**
+ * Resource governor: sizes a run to the CPU and memory the process is
+ * actually allowed to use, including container (cgroup) limits.
+ */
+
+#if defined(linux)
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "governor.h"
+#include "util.h"
+
+// Only this fraction of the available memory is planned for, the rest is
+// left for the C library, thread stacks, and the page cache of the output.
+#define MEMORY_HEADROOM 0.9
+
+// get_num_cores_quota() and get_memory_available() have to be specialized
+// for each OS. Only Linux has cgroups.
+#if defined(__APPLE__)
+#include <sys/sysctl.h>
+size_t get_num_cores_quota() { return get_num_cores_affinity(); }
+size_t get_memory_available() {
+    uint64_t var = 0;
+    size_t sizeof_var = sizeof(var);
+    sysctlbyname("hw.memsize", &var, &sizeof_var, 0, 0);
+    return var;
+}
+#elif defined(linux)
+/**
+ * Checks if a comma-separated list of controllers has the controller as a
+ * whole name, so "cpu" is not found in "cpuset".
+ */
+static bool __has_controller(const char* list, const char* controller) {
+    size_t len = strlen(controller);
+    for (const char* p = list; *p; p += strcspn(p, ","), p += *p == ',') {
+        if (strncmp(p, controller, len) == 0 && (p[len] == ',' || p[len] == 0)) { return true; }
+    }
+    return false;
+}
+
+/**
+ * Gets the path of the cgroup this process belongs to for the given v1
+ * controller, or for the v2 unified hierarchy if controller is NULL.
+ */
+static bool __cgroup_path(const char* controller, char* path, size_t size) {
+    FILE* f = fopen("/proc/self/cgroup", "r");
+    if (!f) { return false; }
+    char line[512];
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), f)) {
+        // lines look like "hierarchy-id:controller-list:path"
+        char* list = strchr(line, ':');
+        char* cg = list ? strchr(list + 1, ':') : NULL;
+        if (!cg) { continue; }
+        *cg++ = 0;
+        list++;
+        cg[strcspn(cg, "\n")] = 0;
+        if (controller ? __has_controller(list, controller) : *list == 0) {
+            snprintf(path, size, "%s", cg);
+            found = true;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+/**
+ * Reads the first one or two numbers of a cgroup file. The word "max" (no
+ * limit) is read as SIZE_MAX. Returns the number of values read.
+ */
+static int __read_cgroup_values(const char* path, size_t* a, size_t* b) {
+    FILE* f = fopen(path, "r");
+    if (!f) { return 0; }
+    char first[32];
+    int count = 0;
+    if (fscanf(f, "%31s", first) == 1) {
+        count = 1;
+        if (strcmp(first, "max") == 0) { *a = SIZE_MAX; }
+        else if (first[0] == '-') { *a = SIZE_MAX; } // v1 uses -1 for no quota
+        else { *a = strtoull(first, NULL, 10); }
+        if (b && fscanf(f, "%zu", b) == 1) { count = 2; }
+    }
+    fclose(f);
+    return count;
+}
+
+/**
+ * Walks from the cgroup of this process up to the root of the hierarchy
+ * mounted at the given directory and calls the visitor for the directory of
+ * every level that exists. Containers usually only see their own cgroup as
+ * the root, so that is tried last if nothing else matched.
+ */
+static void __walk_cgroups(const char* mount, const char* controller,
+                           void (*visit)(const char* dir, void* arg), void* arg) {
+    char cg[512], dir[1024];
+    if (!__cgroup_path(controller, cg, sizeof(cg))) { strcpy(cg, "/"); }
+    for (;;) {
+        snprintf(dir, sizeof(dir), "%s%s", mount, cg);
+        if (access(dir, F_OK) == 0) { visit(dir, arg); }
+        char* slash = strrchr(cg, '/');
+        if (!slash || slash == cg) { break; }
+        *slash = 0;
+    }
+    visit(mount, arg);
+}
+
+static void __visit_cpu_v2(const char* dir, void* arg) {
+    char path[1100];
+    size_t quota, period;
+    snprintf(path, sizeof(path), "%s/cpu.max", dir);
+    if (__read_cgroup_values(path, &quota, &period) == 2 && quota != SIZE_MAX && period) {
+        double* cpus = (double*)arg;
+        if ((double)quota / period < *cpus) { *cpus = (double)quota / period; }
+    }
+}
+
+static void __visit_cpu_v1(const char* dir, void* arg) {
+    char path[1100];
+    size_t quota, period;
+    snprintf(path, sizeof(path), "%s/cpu.cfs_quota_us", dir);
+    if (__read_cgroup_values(path, &quota, NULL) != 1 || quota == SIZE_MAX) { return; }
+    snprintf(path, sizeof(path), "%s/cpu.cfs_period_us", dir);
+    if (__read_cgroup_values(path, &period, NULL) == 1 && period) {
+        double* cpus = (double*)arg;
+        if ((double)quota / period < *cpus) { *cpus = (double)quota / period; }
+    }
+}
+
+size_t get_num_cores_quota() {
+    size_t affinity = get_num_cores_affinity();
+    double cpus = (double)affinity;
+    __walk_cgroups("/sys/fs/cgroup", NULL, __visit_cpu_v2, &cpus);
+    __walk_cgroups("/sys/fs/cgroup/cpu", "cpu", __visit_cpu_v1, &cpus);
+    // a quota of 1.5 CPUs can keep 2 threads busy for most of the period
+    size_t cores = (size_t)(cpus + 0.5);
+    return cores < 1 ? 1 : cores;
+}
+
+/**
+ * The tightest memory limit seen so far and the usage charged against it.
+ */
+struct __memory_limit { size_t limit, usage; };
+
+static void __visit_memory(const char* dir, const char* max_name,
+                           const char* current_name, struct __memory_limit* mem) {
+    char path[1100];
+    size_t max, current = 0;
+    snprintf(path, sizeof(path), "%s/%s", dir, max_name);
+    if (__read_cgroup_values(path, &max, NULL) != 1 || max == SIZE_MAX) { return; }
+    snprintf(path, sizeof(path), "%s/%s", dir, current_name);
+    __read_cgroup_values(path, &current, NULL);
+    if (current > max) { current = max; }
+    if (max - current < mem->limit - mem->usage) { mem->limit = max; mem->usage = current; }
+}
+
+static void __visit_memory_v2(const char* dir, void* arg) {
+    __visit_memory(dir, "memory.max", "memory.current", (struct __memory_limit*)arg);
+}
+
+static void __visit_memory_v1(const char* dir, void* arg) {
+    __visit_memory(dir, "memory.limit_in_bytes", "memory.usage_in_bytes",
+                   (struct __memory_limit*)arg);
+}
+
+size_t get_memory_available() {
+    struct __memory_limit mem;
+    mem.limit = (size_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGE_SIZE);
+    mem.usage = 0;
+    __walk_cgroups("/sys/fs/cgroup", NULL, __visit_memory_v2, &mem);
+    __walk_cgroups("/sys/fs/cgroup/memory", "memory", __visit_memory_v1, &mem);
+    return mem.limit - mem.usage;
+}
+#else
+#error Unrecognized OS
+#endif
+
+/**
+ * Predict the peak memory of a run on an m by n grid. This covers the mapped
+ * input, the two grids that are swapped each generation, and the history
+ * buffer holding history_frames generations (0 if nothing is buffered).
+ */
+size_t predict_memory(size_t m, size_t n, size_t history_frames) {
+    size_t grid_size = m * n;
+    return grid_size * (3 + history_frames);
+}
+
+/**
+ * Plan a run on an m by n grid that outputs history_frames generations.
+ * If num_threads is 0 the thread count follows get_num_cores_quota() (or
+ * is 1 below PLAN_SERIAL_CELLS), otherwise the requested count is kept.
+ * The history is buffered when it fits the available memory and streamed
+ * to the output file otherwise.
+ *
+ * Returns false and sets errno to ENOMEM if even the streaming run does not
+ * fit, so the caller can fail before allocating anything.
+ */
+bool plan_run(struct run_plan* plan, size_t m, size_t n, size_t history_frames,
+              size_t num_threads) {
+    plan->num_threads = num_threads ? num_threads : m * n < PLAN_SERIAL_CELLS ? 1 : get_num_cores_quota();
+    plan->memory_available = get_memory_available();
+    size_t budget = (size_t)(plan->memory_available * MEMORY_HEADROOM);
+
+    plan->output_mode = OUTPUT_BUFFERED;
+    plan->memory_needed = predict_memory(m, n, history_frames);
+    if (plan->memory_needed <= budget) { return true; }
+
+    plan->output_mode = OUTPUT_STREAMING;
+    plan->memory_needed = predict_memory(m, n, 0);
+    if (plan->memory_needed <= budget) { return true; }
+
+    errno = ENOMEM;
+    return false;
+}
+
+/**
+ * Prints the plan chosen for a run.
+ */
+void print_run_plan(const struct run_plan* plan) {
+    printf("Plan: %zu threads, %s output, needs ", plan->num_threads,
+           plan->output_mode == OUTPUT_BUFFERED ? "buffered" : "streaming");
+    print_bytes(plan->memory_needed);
+    printf(" of ");
+    print_bytes(plan->memory_available);
+    printf(" available\n");
+}
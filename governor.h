@@ -0,0 +1,81 @@
+/**
+ * Resource governor: sizes a run to the CPU and memory the process is
+ * actually allowed to use, including container (cgroup) limits.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * How the generations that are kept for output leave the engine.
+ */
+enum output_mode {
+    OUTPUT_BUFFERED,  // kept in memory and written once the run is done
+    OUTPUT_STREAMING, // written to the output file as they are produced
+};
+
+/**
+ * Grids smaller than this are run on a single thread unless more are asked
+ * for, starting the OpenMP threads takes longer than the whole run.
+ */
+#define PLAN_SERIAL_CELLS (128*128)
+
+/**
+ * The resources chosen for a run by plan_run().
+ */
+struct run_plan {
+    size_t num_threads;       // threads to run the simulation with
+    size_t memory_available;  // bytes the run may use (0 if unknown)
+    size_t memory_needed;     // predicted peak bytes for the chosen mode
+    enum output_mode output_mode;
+};
+
+/**
+ * Get the number of cores this process may keep busy. This is the affinity
+ * count further limited by the cgroup CPU quota (cpu.max for cgroup v2 or
+ * cpu.cfs_quota_us for v1) of this process and all its parent cgroups.
+ */
+size_t get_num_cores_quota();
+
+/**
+ * Get the number of bytes this process can still allocate before hitting
+ * the tightest cgroup memory limit (memory.max for v2 or
+ * memory.limit_in_bytes for v1). Without a limit this is the physical
+ * memory of the machine.
+ */
+size_t get_memory_available();
+
+/**
+ * Predict the peak memory of a run on an m by n grid. This covers the mapped
+ * input, the two grids that are swapped each generation, and the history
+ * buffer holding history_frames generations (0 if nothing is buffered).
+ */
+size_t predict_memory(size_t m, size_t n, size_t history_frames);
+
+/**
+ * Plan a run on an m by n grid that outputs history_frames generations.
+ * If num_threads is 0 the thread count follows get_num_cores_quota() (or
+ * is 1 below PLAN_SERIAL_CELLS), otherwise the requested count is kept.
+ * The history is buffered when it fits the available memory and streamed
+ * to the output file otherwise.
+ *
+ * Returns false and sets errno to ENOMEM if even the streaming run does not
+ * fit, so the caller can fail before allocating anything.
+ */
+bool plan_run(struct run_plan* plan, size_t m, size_t n, size_t history_frames,
+              size_t num_threads);
+
+/**
+ * Prints the plan chosen for a run.
+ */
+void print_run_plan(const struct run_plan* plan);
+
+#ifdef __cplusplus
+}
+#endif
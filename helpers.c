@@ -20,19 +20,19 @@ void swap(uint8_t** grid, uint8_t** grid_next) {
 /**
  * Gets the number of live organisms around a given position and update the next grid based on that neighbor count 
  */
-void update(const uint8_t* grid, uint8_t* grid_next, const size_t i, const size_t sz) {
-	const size_t x = i % sz, y = i / sz;
+void update(const uint8_t* grid, uint8_t* grid_next, const size_t i, const size_t m, const size_t n) {
+	const size_t x = i % n, y = i / n;
 	int neighbor_count = 0;
 
-	// Check all 8 possible neighbors
-	neighbor_count += x >= 1 && y >= 1 && grid[i-sz-1];
-	neighbor_count +=           y >= 1 && grid[i-sz];
-	neighbor_count += x < sz && y >= 1 && grid[i-sz+1];
-	neighbor_count += x >= 1           && grid[i-1];
-	neighbor_count += x < sz           && grid[i+1];
-	neighbor_count += x >= 1 && y < sz && grid[i+sz-1];
-	neighbor_count +=           y < sz && grid[i+sz];
-	neighbor_count += x < sz && y < sz && grid[i+sz+1];
+	// Check all 8 possible neighbors, cells outside of the m by n grid are dead
+	neighbor_count += x >= 1  && y >= 1  && grid[i-n-1];
+	neighbor_count +=            y >= 1  && grid[i-n];
+	neighbor_count += x < n-1 && y >= 1  && grid[i-n+1];
+	neighbor_count += x >= 1             && grid[i-1];
+	neighbor_count += x < n-1            && grid[i+1];
+	neighbor_count += x >= 1  && y < m-1 && grid[i+n-1];
+	neighbor_count +=            y < m-1 && grid[i+n];
+	neighbor_count += x < n-1 && y < m-1 && grid[i+n+1];
 
 	// Update the grid.
 	// If there is a live organism and it has 2 or 3 live neighbors, or, if there is a dead cell and it has 3 live neighbors, 
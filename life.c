@@ -0,0 +1,110 @@
+/**
+ * Library interface to run simulations in-process, without going through
+ * NPY files and the game_of_life_* executables.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "life.h"
+#include "helpers.h"
+#include "governor.h"
+#include "rle.h"
+
+/**
+ * Runs the dense engine. With a history each generation is computed
+ * straight into its frame, otherwise two grids are swapped.
+ */
+static size_t __run_dense(uint8_t* grid, size_t m, size_t n, size_t iterations, size_t num_threads,
+                          uint8_t* history, struct run_budget* budget) {
+    size_t grid_size = m * n;
+    uint8_t* grid_next = history ? NULL : (uint8_t*)malloc(grid_size*sizeof(uint8_t));
+    if (!history && !grid_next) { errno = ENOMEM; return (size_t)-1; }
+
+    uint8_t* current = history ? history : grid;
+    size_t step;
+    for (step = 0; step < iterations; step++) {
+        if (budget_exhausted(budget, step, grid_size)) { break; }
+        if (history) { grid_next = current + grid_size; }
+#ifdef _OPENMP
+        #pragma omp parallel for num_threads(num_threads) if(num_threads > 1)
+#endif
+        for (size_t i = 0; i < grid_size; i++) {
+            update(current, grid_next, i, m, n);
+        }
+        swap(&current, &grid_next);
+    }
+
+    // the result has to end up in the caller's grid
+    if (current != grid) {
+        memcpy(grid, current, grid_size);
+        grid_next = current;
+    }
+    if (!history) { free(grid_next); }
+    return step;
+}
+
+/**
+ * Runs the run-length encoded engine, see rle.h.
+ */
+static size_t __run_rle(uint8_t* grid, size_t m, size_t n, size_t iterations,
+                        uint8_t* history, struct run_budget* budget) {
+    size_t grid_size = m * n;
+    struct rle_grid current, next;
+    if (!rle_from_dense(&current, grid, m, n)) { errno = ENOMEM; return (size_t)-1; }
+    if (!rle_init(&next, m, n)) { rle_free(&current); errno = ENOMEM; return (size_t)-1; }
+
+    size_t step;
+    for (step = 0; step < iterations; step++) {
+        if (budget_exhausted(budget, step, grid_size)) { break; }
+        if (!rle_step(&current, &next)) { step = (size_t)-1; errno = ENOMEM; break; }
+        struct rle_grid temp = current;
+        current = next;
+        next = temp;
+        if (history) { rle_to_dense(&current, history + (step+1)*grid_size); }
+    }
+    if (step != (size_t)-1) { rle_to_dense(&current, grid); }
+    rle_free(&current);
+    rle_free(&next);
+    return step;
+}
+
+/**
+ * Steps an m by n grid in place for up to the given number of generations.
+ * The generations are spread over num_threads threads when built with
+ * OpenMP, 0 threads uses as many as the CPU quota allows (1 for grids
+ * below PLAN_SERIAL_CELLS, see governor.h). The run stops
+ * early at the generation boundary where the budget is exhausted, the
+ * budget may be NULL to always run all iterations.
+ *
+ * Returns the number of generations reached. Returns (size_t)-1 and sets
+ * errno to ENOMEM if the scratch grid cannot be allocated.
+ */
+size_t life_run(uint8_t* grid, size_t m, size_t n, size_t iterations,
+                size_t num_threads, const struct run_budget* budget) {
+    return life_run_engine(grid, m, n, iterations, num_threads, LIFE_ENGINE_DENSE, NULL, budget);
+}
+
+/**
+ * Same as life_run() with a choice of engine, and optionally saves every
+ * generation reached. If history is not NULL it must hold iterations+1
+ * grids: the first is set to the input and the dense engine computes each
+ * generation directly into the next one, so nothing is copied.
+ */
+size_t life_run_engine(uint8_t* grid, size_t m, size_t n, size_t iterations,
+                       size_t num_threads, enum life_engine engine, uint8_t* history,
+                       const struct run_budget* budget) {
+    if (num_threads == 0) { num_threads = m * n < PLAN_SERIAL_CELLS ? 1 : get_num_cores_quota(); }
+    struct run_budget run_budget;
+    budget_init(&run_budget, BUDGET_NONE, 0);
+    if (budget) { run_budget = *budget; }
+    budget_start(&run_budget);
+
+    if (history) { memcpy(history, grid, m * n); }
+    if (engine == LIFE_ENGINE_RLE) { return __run_rle(grid, m, n, iterations, history, &run_budget); }
+    if (engine != LIFE_ENGINE_DENSE) { errno = EINVAL; return (size_t)-1; }
+    return __run_dense(grid, m, n, iterations, num_threads, history, &run_budget);
+}
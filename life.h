@@ -0,0 +1,54 @@
+/**
+ * Library interface to run simulations in-process, without going through
+ * NPY files and the game_of_life_* executables. Build it as a library with:
+ *     gcc -Wall -O3 -fopenmp -march=native -fPIC -shared life.c scheduler.c helpers.c budget.c util.c governor.c rle.c lz.c text_io.c -o libgameoflife.so -lpthread
+ * Python can use it through gameoflife.py.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "budget.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The engines a library run can use.
+ */
+enum life_engine {
+    LIFE_ENGINE_DENSE, // a byte per cell, like game_of_life_serial and game_of_life_shared
+    LIFE_ENGINE_RLE,   // runs of live cells, like game_of_life_rle (always serial)
+};
+
+/**
+ * Steps an m by n grid in place for up to the given number of generations.
+ * The generations are spread over num_threads threads when built with
+ * OpenMP, 0 threads uses as many as the CPU quota allows (1 for grids
+ * below PLAN_SERIAL_CELLS, see governor.h). The run stops
+ * early at the generation boundary where the budget is exhausted, the
+ * budget may be NULL to always run all iterations.
+ *
+ * Returns the number of generations reached. Returns (size_t)-1 and sets
+ * errno to ENOMEM if the scratch grid cannot be allocated.
+ */
+size_t life_run(uint8_t* grid, size_t m, size_t n, size_t iterations,
+                size_t num_threads, const struct run_budget* budget);
+
+/**
+ * Same as life_run() with a choice of engine, and optionally saves every
+ * generation reached. If history is not NULL it must hold iterations+1
+ * grids: the first is set to the input and the dense engine computes each
+ * generation directly into the next one, so nothing is copied.
+ */
+size_t life_run_engine(uint8_t* grid, size_t m, size_t n, size_t iterations,
+                       size_t num_threads, enum life_engine engine, uint8_t* history,
+                       const struct run_budget* budget);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,531 @@
+/**
+ * Block compression for histories and checkpoints, see lz.h.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "lz.h"
+#include "util.h"
+#include "text_io.h"
+
+#define LZ_MAGIC "GOLLZ\0\0\1"
+#define LZ_HEADER_SIZE 64
+#define LZ_HASH_BITS 14
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+
+// The kinds of blocks, incompressible frames are stored packed only
+#define LZ_BLOCK_STORED 0
+#define LZ_BLOCK_LZ     1
+
+static inline uint32_t __read32(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint32_t __hash(uint32_t v) { return (v * 2654435761u) >> (32 - LZ_HASH_BITS); }
+
+/**
+ * Writes the rest of a length that did not fit in its 4 bits of the token.
+ */
+static uint8_t* __put_length(uint8_t* op, size_t len) {
+    for (; len >= 255; len -= 255) { *op++ = 255; }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+/**
+ * Reads the rest of a length that did not fit in its 4 bits of the token.
+ */
+static bool __get_length(const uint8_t** ip, const uint8_t* end, size_t* len) {
+    uint8_t b;
+    do {
+        if (*ip >= end) { return false; }
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return true;
+}
+
+/**
+ * Writes a sequence of literals followed by a match, or only literals if
+ * offset is 0 (the end of the block).
+ */
+static uint8_t* __put_sequence(uint8_t* op, const uint8_t* literals, size_t lit,
+                               size_t offset, size_t match) {
+    uint8_t* token = op++;
+    size_t mlen = offset ? match - LZ_MIN_MATCH : 0;
+    *token = (uint8_t)((lit >= 15 ? 15 : lit) << 4 | (mlen >= 15 ? 15 : mlen));
+    if (lit >= 15) { op = __put_length(op, lit - 15); }
+    memcpy(op, literals, lit);
+    op += lit;
+    if (offset) {
+        *op++ = offset & 255;
+        *op++ = offset >> 8;
+        if (mlen >= 15) { op = __put_length(op, mlen - 15); }
+    }
+    return op;
+}
+
+/**
+ * Get the largest compressed size of size bytes.
+ */
+size_t lz_compress_bound(size_t size) { return size + size / 255 + 16; }
+
+/**
+ * Compresses size bytes into dst, which must hold lz_compress_bound(size)
+ * bytes. Returns the compressed size.
+ *
+ * This is a greedy single pass: the hash of the next 4 bytes finds the last
+ * position they were seen at, and a match is extended as far as it goes.
+ * The search skips ahead faster the longer it goes without a match, so
+ * random areas of the board cost little time.
+ */
+size_t lz_compress(const uint8_t* src, size_t size, uint8_t* dst) {
+    uint32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+    const uint8_t* ip = src, * anchor = src, * end = src + size;
+    uint8_t* op = dst;
+    while (size >= LZ_MIN_MATCH && ip <= end - LZ_MIN_MATCH) {
+        uint32_t seq = __read32(ip), h = __hash(seq);
+        const uint8_t* ref = src + table[h];
+        table[h] = (uint32_t)(ip - src);
+        if (ref >= ip || ip - ref > LZ_MAX_OFFSET || __read32(ref) != seq) {
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+        const uint8_t* mp = ip + LZ_MIN_MATCH, * rp = ref + LZ_MIN_MATCH;
+        while (mp < end && *mp == *rp) { mp++; rp++; }
+        op = __put_sequence(op, anchor, ip - anchor, ip - ref, mp - ip);
+        ip = anchor = mp;
+    }
+    op = __put_sequence(op, anchor, end - anchor, 0, 0);
+    return op - dst;
+}
+
+/**
+ * Decompresses a block into dst. Returns false if the block is corrupt or
+ * does not decompress to exactly size bytes.
+ */
+bool lz_decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t size) {
+    const uint8_t* ip = src, * iend = src + src_size;
+    uint8_t* op = dst, * oend = dst + size;
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t lit = token >> 4, mlen = token & 15;
+        if (lit == 15 && !__get_length(&ip, iend, &lit)) { return false; }
+        if (lit > (size_t)(iend - ip) || lit > (size_t)(oend - op)) { return false; }
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (ip == iend) { break; } // the last sequence has no match
+
+        if (iend - ip < 2) { return false; }
+        size_t offset = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        if (mlen == 15 && !__get_length(&ip, iend, &mlen)) { return false; }
+        mlen += LZ_MIN_MATCH;
+        if (!offset || offset > (size_t)(op - dst) || mlen > (size_t)(oend - op)) { return false; }
+        const uint8_t* ref = op - offset;
+        if (offset >= mlen) { memcpy(op, ref, mlen); op += mlen; }
+        else { while (mlen--) { *op++ = *ref++; } } // overlapping, repeats the last offset bytes
+    }
+    return op == oend;
+}
+
+/**
+ * Packs the 0/1 cells of a grid into bits, 8 cells per byte with the first
+ * cell in the lowest bit.
+ */
+static void __pack(const uint8_t* grid, size_t size, uint8_t* packed) {
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t x;
+        memcpy(&x, grid + i, 8);
+        packed[i / 8] = (uint8_t)((x * 0x0102040810204080ull) >> 56); // gathers the low bit of each byte
+    }
+    if (i < size) {
+        uint8_t b = 0;
+        for (size_t k = 0; i + k < size; k++) { b |= (grid[i + k] & 1) << k; }
+        packed[i / 8] = b;
+    }
+}
+
+/**
+ * Unpacks bits from __pack() into 0/1 cells.
+ */
+static void __unpack(const uint8_t* packed, size_t size, uint8_t* grid) {
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t x = ((packed[i / 8] * 0x0101010101010101ull) & 0x8040201008040201ull) + 0x00406070787c7e7full;
+        x = (x >> 7) & 0x0101010101010101ull; // bit k of the byte ends up in the low bit of byte k
+        memcpy(grid + i, &x, 8);
+    }
+    for (size_t k = 0; i + k < size; k++) { grid[i + k] = (packed[i / 8] >> k) & 1; }
+}
+
+///////////////////// Writer /////////////////////
+
+enum __slot_state { SLOT_EMPTY, SLOT_PENDING, SLOT_ENCODING, SLOT_DONE };
+
+struct __lz_slot {
+    uint8_t* frame;  // the copied frame
+    uint8_t* packed; // the frame packed to bits
+    uint8_t* block;  // kind byte followed by the packed or compressed frame
+    size_t block_size;
+    enum __slot_state state;
+};
+
+struct lz_writer {
+    FILE* file;
+    size_t m, n;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pthread_t* threads;
+    size_t num_threads;
+
+    // frames are queued in a ring of slots, frames_out <= frames_in
+    struct __lz_slot* slots;
+    size_t n_slots, frames_in, frames_out;
+
+    // offset and size of each written block
+    uint64_t* index;
+    size_t index_capacity;
+    uint64_t offset;
+    bool writing, closing, failed;
+};
+
+/**
+ * Packs and compresses the frame of a slot into its block.
+ */
+static void __encode(const struct lz_writer* w, struct __lz_slot* slot) {
+    size_t size = w->m * w->n, packed_size = (size + 7) / 8;
+    __pack(slot->frame, size, slot->packed);
+    size_t compressed = lz_compress(slot->packed, packed_size, slot->block + 1);
+    if (compressed < packed_size) {
+        slot->block[0] = LZ_BLOCK_LZ;
+        slot->block_size = 1 + compressed;
+    } else {
+        slot->block[0] = LZ_BLOCK_STORED;
+        memcpy(slot->block + 1, slot->packed, packed_size);
+        slot->block_size = 1 + packed_size;
+    }
+}
+
+/**
+ * Writes the encoded frames at the front of the queue in order. Only one
+ * thread writes at a time, the others leave their finished frames to it.
+ * Must be called with the lock held.
+ */
+static void __write_done(struct lz_writer* w) {
+    if (w->writing) { return; }
+    w->writing = true;
+    struct __lz_slot* slot;
+    while ((slot = &w->slots[w->frames_out % w->n_slots])->state == SLOT_DONE) {
+        if (2 * w->frames_out + 2 > w->index_capacity) {
+            size_t capacity = w->index_capacity ? 2 * w->index_capacity : 64;
+            uint64_t* index = (uint64_t*)realloc(w->index, capacity * sizeof(uint64_t));
+            if (!index) { w->failed = true; } else { w->index = index; w->index_capacity = capacity; }
+        }
+        pthread_mutex_unlock(&w->lock);
+        bool ok = !w->failed && fwrite(slot->block, 1, slot->block_size, w->file) == slot->block_size;
+        pthread_mutex_lock(&w->lock);
+        if (ok) {
+            w->index[2 * w->frames_out] = w->offset;
+            w->index[2 * w->frames_out + 1] = slot->block_size;
+            w->offset += slot->block_size;
+        }
+        w->failed |= !ok;
+        w->frames_out++;
+        slot->state = SLOT_EMPTY;
+        pthread_cond_broadcast(&w->changed);
+    }
+    w->writing = false;
+}
+
+static void* __encoder(void* arg) {
+    struct lz_writer* w = (struct lz_writer*)arg;
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        // the oldest frame that still has to be encoded
+        struct __lz_slot* slot = NULL;
+        for (size_t k = w->frames_out; k < w->frames_in && !slot; k++) {
+            if (w->slots[k % w->n_slots].state == SLOT_PENDING) { slot = &w->slots[k % w->n_slots]; }
+        }
+        if (!slot) {
+            if (w->closing) { break; }
+            pthread_cond_wait(&w->changed, &w->lock);
+            continue;
+        }
+        slot->state = SLOT_ENCODING;
+        pthread_mutex_unlock(&w->lock);
+        __encode(w, slot);
+        pthread_mutex_lock(&w->lock);
+        slot->state = SLOT_DONE;
+        __write_done(w);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+/**
+ * Writes the header of a compressed file.
+ */
+static bool __write_header(FILE* file, size_t m, size_t n, size_t frames, uint64_t index_offset) {
+    uint8_t header[LZ_HEADER_SIZE] = {0};
+    uint64_t fields[4] = {m, n, frames, index_offset}; // assumes running on little-endian
+    memcpy(header, LZ_MAGIC, 8);
+    memcpy(header + 8, fields, sizeof(fields));
+    return fwrite(header, 1, sizeof(header), file) == sizeof(header);
+}
+
+static void __writer_free(struct lz_writer* w) {
+    if (w->slots) {
+        for (size_t i = 0; i < w->n_slots; i++) {
+            free(w->slots[i].frame);
+            free(w->slots[i].packed);
+            free(w->slots[i].block);
+        }
+    }
+    free(w->slots);
+    free(w->threads);
+    free(w->index);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->changed);
+    free(w);
+}
+
+/**
+ * Creates a compressed file for an m by n run with the given number of
+ * encoder threads. The file has to be seekable. Returns NULL if the file or
+ * the threads cannot be created.
+ */
+struct lz_writer* lz_writer_open(const char* path, size_t m, size_t n, size_t num_threads) {
+    if (num_threads < 1) { num_threads = 1; }
+    struct lz_writer* w = (struct lz_writer*)calloc(1, sizeof(struct lz_writer));
+    if (!w) { return NULL; }
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->changed, NULL);
+    w->m = m;
+    w->n = n;
+
+    // two frames per encoder keeps them busy while the blocks are written
+    size_t size = m * n, packed_size = (size + 7) / 8;
+    w->n_slots = 2 * num_threads;
+    w->slots = (struct __lz_slot*)calloc(w->n_slots, sizeof(struct __lz_slot));
+    w->threads = (pthread_t*)malloc(num_threads * sizeof(pthread_t));
+    bool ok = w->slots && w->threads;
+    for (size_t i = 0; ok && i < w->n_slots; i++) {
+        w->slots[i].frame = (uint8_t*)malloc(size ? size : 1);
+        w->slots[i].packed = (uint8_t*)malloc(packed_size + 8);
+        w->slots[i].block = (uint8_t*)malloc(1 + lz_compress_bound(packed_size));
+        ok = w->slots[i].frame && w->slots[i].packed && w->slots[i].block;
+    }
+    if (!ok) { __writer_free(w); errno = ENOMEM; return NULL; }
+
+    // the header is written again with the frame count and index offset when closing
+    w->file = fopen(path, "wb");
+    if (!w->file || !__write_header(w->file, m, n, 0, 0)) {
+        if (w->file) { fclose(w->file); }
+        __writer_free(w);
+        return NULL;
+    }
+    w->offset = LZ_HEADER_SIZE;
+    for (; w->num_threads < num_threads; w->num_threads++) {
+        if (pthread_create(&w->threads[w->num_threads], NULL, __encoder, w) != 0) { break; }
+    }
+    if (!w->num_threads) { fclose(w->file); __writer_free(w); return NULL; }
+    return w;
+}
+
+/**
+ * Queues the next frame. The grid is copied so it can be changed as soon as
+ * this returns, which only waits if all encoders are busy. Returns false if
+ * a block could not be written.
+ */
+bool lz_writer_append(struct lz_writer* w, const uint8_t* grid) {
+    pthread_mutex_lock(&w->lock);
+    struct __lz_slot* slot = &w->slots[w->frames_in % w->n_slots];
+    while (slot->state != SLOT_EMPTY && !w->failed) { pthread_cond_wait(&w->changed, &w->lock); }
+    if (w->failed) { pthread_mutex_unlock(&w->lock); return false; }
+    pthread_mutex_unlock(&w->lock);
+
+    // only this thread fills empty slots
+    memcpy(slot->frame, grid, w->m * w->n);
+
+    pthread_mutex_lock(&w->lock);
+    slot->state = SLOT_PENDING;
+    w->frames_in++;
+    pthread_cond_broadcast(&w->changed);
+    pthread_mutex_unlock(&w->lock);
+    return true;
+}
+
+/**
+ * Finishes the queued frames, writes the index and closes the file. Returns
+ * false if anything could not be written.
+ */
+bool lz_writer_close(struct lz_writer* w) {
+    pthread_mutex_lock(&w->lock);
+    w->closing = true;
+    pthread_cond_broadcast(&w->changed);
+    pthread_mutex_unlock(&w->lock);
+    for (size_t i = 0; i < w->num_threads; i++) { pthread_join(w->threads[i], NULL); }
+
+    size_t frames = w->frames_out;
+    bool ok = !w->failed && frames == w->frames_in &&
+              fwrite(w->index, sizeof(uint64_t), 2 * frames, w->file) == 2 * frames &&
+              fseek(w->file, 0, SEEK_SET) == 0 &&
+              __write_header(w->file, w->m, w->n, frames, w->offset);
+    ok = fclose(w->file) == 0 && ok;
+    __writer_free(w);
+    return ok;
+}
+
+/**
+ * Encodes a grid as a whole compressed file of one frame in memory, for
+ * writing it out later. The file is allocated with malloc().
+ */
+uint8_t* lz_encode_grid(const uint8_t* grid, size_t m, size_t n, size_t* size) {
+    size_t packed_size = (m * n + 7) / 8;
+    uint8_t* packed = (uint8_t*)malloc(packed_size + 8);
+    uint8_t* file = (uint8_t*)malloc(LZ_HEADER_SIZE + 1 + lz_compress_bound(packed_size) + 2 * sizeof(uint64_t));
+    if (!packed || !file) { free(packed); free(file); errno = ENOMEM; return NULL; }
+
+    // the block is the same as __encode() makes
+    uint8_t* block = file + LZ_HEADER_SIZE;
+    __pack(grid, m * n, packed);
+    size_t block_size = lz_compress(packed, packed_size, block + 1);
+    if (block_size < packed_size) {
+        block[0] = LZ_BLOCK_LZ;
+    } else {
+        block[0] = LZ_BLOCK_STORED;
+        memcpy(block + 1, packed, packed_size);
+        block_size = packed_size;
+    }
+    block_size++;
+    free(packed);
+
+    uint64_t index_offset = LZ_HEADER_SIZE + block_size;
+    uint64_t fields[4] = {m, n, 1, index_offset}, index[2] = {LZ_HEADER_SIZE, block_size}; // assumes running on little-endian
+    memset(file, 0, LZ_HEADER_SIZE);
+    memcpy(file, LZ_MAGIC, 8);
+    memcpy(file + 8, fields, sizeof(fields));
+    memcpy(file + index_offset, index, sizeof(index));
+    *size = index_offset + sizeof(index);
+    return file;
+}
+
+///////////////////// Reader /////////////////////
+
+/**
+ * Opens a compressed file and reads its index. Returns false if it cannot
+ * be read or is not a compressed file.
+ */
+bool lz_open(struct lz_file* lz, const char* path) {
+    lz->index = NULL;
+    lz->file = fopen(path, "rb");
+    if (!lz->file) { return false; }
+    uint8_t header[LZ_HEADER_SIZE];
+    uint64_t fields[4];
+    if (fread(header, 1, sizeof(header), lz->file) != sizeof(header) || memcmp(header, LZ_MAGIC, 8) != 0) {
+        lz_close(lz);
+        errno = EINVAL;
+        return false;
+    }
+    memcpy(fields, header + 8, sizeof(fields));
+    lz->m = fields[0];
+    lz->n = fields[1];
+    lz->frames = fields[2];
+    lz->index = (uint64_t*)malloc((2 * lz->frames + 1) * sizeof(uint64_t));
+    if (!lz->index || fseek(lz->file, (long)fields[3], SEEK_SET) != 0 ||
+        fread(lz->index, sizeof(uint64_t), 2 * lz->frames, lz->file) != 2 * lz->frames) {
+        lz_close(lz);
+        errno = EINVAL;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Decompresses one frame into an m by n grid. Returns false if it cannot be
+ * read or is corrupt.
+ */
+bool lz_read_frame(const struct lz_file* lz, size_t frame, uint8_t* grid) {
+    if (frame >= lz->frames) { errno = EINVAL; return false; }
+    size_t size = lz->m * lz->n, packed_size = (size + 7) / 8;
+    uint64_t offset = lz->index[2 * frame], block_size = lz->index[2 * frame + 1];
+    uint8_t* block = (uint8_t*)malloc(block_size ? block_size : 1);
+    uint8_t* packed = (uint8_t*)malloc(packed_size + 8);
+    bool ok = block && packed && block_size >= 1 &&
+              fseek(lz->file, (long)offset, SEEK_SET) == 0 &&
+              fread(block, 1, block_size, lz->file) == block_size;
+    if (ok && block[0] == LZ_BLOCK_STORED) {
+        ok = block_size - 1 == packed_size;
+        if (ok) { memcpy(packed, block + 1, packed_size); }
+    } else if (ok) {
+        ok = block[0] == LZ_BLOCK_LZ && lz_decompress(block + 1, block_size - 1, packed, packed_size);
+    }
+    if (ok) { __unpack(packed, size, grid); }
+    else if (!errno) { errno = EINVAL; }
+    free(block);
+    free(packed);
+    return ok;
+}
+
+/**
+ * Closes a compressed file.
+ */
+void lz_close(struct lz_file* lz) {
+    if (lz->file) { fclose(lz->file); }
+    free(lz->index);
+    lz->file = NULL;
+    lz->index = NULL;
+}
+
+/**
+ * Checks if a file starts like a compressed file.
+ */
+bool is_lz_path(const char* path) {
+    if (strcmp(path, NPY_STDIO_PATH) == 0) { return false; }
+    FILE* f = fopen(path, "rb");
+    if (!f) { return false; }
+    char magic[8];
+    bool is_lz = fread(magic, 1, 8, f) == 8 && memcmp(magic, LZ_MAGIC, 8) == 0;
+    fclose(f);
+    return is_lz;
+}
+
+/**
+ * Loads the last frame of a compressed file, like grid_from_npy_path(). The
+ * grid is page-aligned memory from mmap() so it is released the same way.
+ */
+uint8_t* grid_from_lz_path(const char* path, size_t* m, size_t* n) {
+    struct lz_file lz;
+    if (!lz_open(&lz, path)) { return NULL; }
+    if (!lz.frames || !lz.m || !lz.n) { lz_close(&lz); errno = EINVAL; return NULL; }
+    void* x = mmap(NULL, lz.m * lz.n, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (x == MAP_FAILED) { lz_close(&lz); return NULL; }
+    if (!lz_read_frame(&lz, lz.frames - 1, (uint8_t*)x)) {
+        munmap(x, lz.m * lz.n);
+        lz_close(&lz);
+        return NULL;
+    }
+    *m = lz.m;
+    *n = lz.n;
+    lz_close(&lz);
+    return (uint8_t*)x;
+}
+
+/**
+ * Loads a grid from a NPY file, a text file (.csv or .cells, see text_io.h)
+ * or the last frame of a compressed file.
+ */
+uint8_t* grid_load_path(const char* path, size_t* m, size_t* n) {
+    if (is_lz_path(path)) { return grid_from_lz_path(path, m, n); }
+    if (is_text_path(path)) { return grid_from_text_path(path, m, n); }
+    return grid_from_npy_path(path, m, n);
+}
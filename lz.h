@@ -0,0 +1,125 @@
+/**
+ * Block compression for histories and checkpoints.
+ *
+ * Frames are packed to one bit per cell and then compressed with a small
+ * LZ77 coder (byte-oriented like LZ4: a token with the literal and match
+ * lengths, the literals, and a 16-bit match offset). Empty and repeating
+ * areas of a Life board become long matches, and the rest costs at most a
+ * bit per cell plus a few bytes.
+ *
+ * A compressed file (.npy.lz by convention) holds one block per frame and
+ * ends with an index of the blocks, so any frame can be read on its own:
+ *
+ *     header   "GOLLZ\0\0\1", rows, cols, frames, index offset (64 bytes)
+ *     blocks   a kind byte (stored or LZ) followed by the packed frame
+ *     index    offset and size of every block
+ *
+ * The writer compresses frames on a pool of encoder threads while the
+ * simulation keeps going, and writes the blocks in order.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Get the largest compressed size of size bytes.
+ */
+size_t lz_compress_bound(size_t size);
+
+/**
+ * Compresses size bytes into dst, which must hold lz_compress_bound(size)
+ * bytes. Returns the compressed size.
+ */
+size_t lz_compress(const uint8_t* src, size_t size, uint8_t* dst);
+
+/**
+ * Decompresses a block into dst. Returns false if the block is corrupt or
+ * does not decompress to exactly size bytes.
+ */
+bool lz_decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t size);
+
+/**
+ * Writes the frames of an m by n run to a compressed file.
+ */
+struct lz_writer;
+
+/**
+ * Creates a compressed file for an m by n run with the given number of
+ * encoder threads. The file has to be seekable. Returns NULL if the file or
+ * the threads cannot be created.
+ */
+struct lz_writer* lz_writer_open(const char* path, size_t m, size_t n, size_t num_threads);
+
+/**
+ * Queues the next frame. The grid is copied so it can be changed as soon as
+ * this returns, which only waits if all encoders are busy. Returns false if
+ * a block could not be written.
+ */
+bool lz_writer_append(struct lz_writer* writer, const uint8_t* grid);
+
+/**
+ * Finishes the queued frames, writes the index and closes the file. Returns
+ * false if anything could not be written.
+ */
+bool lz_writer_close(struct lz_writer* writer);
+
+/**
+ * Encodes a grid as a whole compressed file of one frame in memory, for
+ * writing it out later. The file is allocated with malloc().
+ */
+uint8_t* lz_encode_grid(const uint8_t* grid, size_t m, size_t n, size_t* size);
+
+/**
+ * A compressed file opened for reading.
+ */
+struct lz_file {
+    FILE* file;
+    size_t m, n, frames;
+    uint64_t* index; // offset and size of each block
+};
+
+/**
+ * Opens a compressed file and reads its index. Returns false if it cannot
+ * be read or is not a compressed file.
+ */
+bool lz_open(struct lz_file* lz, const char* path);
+
+/**
+ * Decompresses one frame into an m by n grid. Returns false if it cannot be
+ * read or is corrupt.
+ */
+bool lz_read_frame(const struct lz_file* lz, size_t frame, uint8_t* grid);
+
+/**
+ * Closes a compressed file.
+ */
+void lz_close(struct lz_file* lz);
+
+/**
+ * Checks if a file starts like a compressed file.
+ */
+bool is_lz_path(const char* path);
+
+/**
+ * Loads the last frame of a compressed file, like grid_from_npy_path(). The
+ * grid is page-aligned memory from mmap() so it is released the same way.
+ */
+uint8_t* grid_from_lz_path(const char* path, size_t* m, size_t* n);
+
+/**
+ * Loads a grid from a NPY file, a text file (.csv or .cells, see text_io.h)
+ * or the last frame of a compressed file.
+ */
+uint8_t* grid_load_path(const char* path, size_t* m, size_t* n);
+
+#ifdef __cplusplus
+}
+#endif
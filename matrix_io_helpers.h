@@ -1,40 +1,111 @@
-////////// CSV File Reading //////////
-
-static inline double __read_csv_val(const char* tok) {
-    double val;
-    int off;
-    if (sscanf(tok, " %lf %n", &val, &off) != 1 || off != strlen(tok)) {
-        fprintf(stderr, "Not a number in CSV file, using 0.0: %s\n", tok);
-        return 0.0;
+////////// Text File Reading //////////
+
+// Boards as text, one row per line: CSV of 0/1 values, or plaintext .cells
+// with '.' for dead and 'O' (or '*') for alive cells where lines starting
+// with '!' are comments. Rows can be shorter than the board, the rest of
+// the row is dead. The scans go 16 bytes at a time with SSE2.
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Finds the first newline at or after p, or end if there is none.
+ */
+static inline const char* __text_find_newline(const char* p, const char* end) {
+#ifdef __SSE2__
+    const __m128i nl = _mm_set1_epi8('\n');
+    for (; p + 16 <= end; p += 16) {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), nl));
+        if (mask) { return p + __builtin_ctz(mask); }
     }
-    return val;
-}
-
-static inline size_t __read_csv_first_line(char* line, double** out) {
-    char* tok = strtok(line, ",\n");
-    size_t i = 0, size = 16;
-    double* vals = (double*)malloc(16*sizeof(double));
-    while (tok) {
-        vals[i] = __read_csv_val(tok);
-        if (++i == size) {
-            size += size > 512 ? 512 : size;
-            vals = (double*)realloc(vals, size*sizeof(double));
-        }
-        tok = strtok(NULL, ",");
+#endif
+    while (p < end && *p != '\n') { p++; }
+    return p;
+}
+
+/**
+ * Counts the commas in a line.
+ */
+static inline size_t __text_count_commas(const char* p, const char* end) {
+    size_t count = 0;
+#ifdef __SSE2__
+    const __m128i comma = _mm_set1_epi8(',');
+    for (; p + 16 <= end; p += 16) {
+        count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), comma)));
     }
-    *out = vals;
-    return i;
+#endif
+    for (; p < end; p++) { count += *p == ','; }
+    return count;
 }
 
-static inline void __read_csv_line(char* line, double* out, size_t count) {
-    char* tok = strtok(line, ",\n");
+/**
+ * Get the end of a line without a trailing carriage return.
+ */
+static inline const char* __text_trim(const char* line, const char* eol) {
+    return eol > line && eol[-1] == '\r' ? eol - 1 : eol;
+}
+
+/**
+ * Checks if a line holds a row of the board, and gets the number of cells
+ * it has if so. Blank CSV lines and .cells comments (starting with !) are
+ * not rows, but a blank .cells line is a row of dead cells since trailing
+ * dead cells can be left out.
+ */
+static inline bool __text_row_width(const char* line, const char* eol, bool csv, size_t* width) {
+    eol = __text_trim(line, eol);
+    if (csv ? eol == line : eol > line && *line == '!') { return false; }
+    *width = csv ? __text_count_commas(line, eol) + 1 : (size_t)(eol - line);
+    return true;
+}
+
+/**
+ * Parses a .cells row into n cells.
+ */
+static inline void __text_parse_cells(const char* line, const char* eol, uint8_t* row, size_t n) {
+    eol = __text_trim(line, eol);
+    size_t len = (size_t)(eol - line) < n ? (size_t)(eol - line) : n, i = 0;
+#ifdef __SSE2__
+    const __m128i o = _mm_set1_epi8('O'), star = _mm_set1_epi8('*'), one = _mm_set1_epi8(1);
+    for (; i + 16 <= len; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i*)(line + i));
+        __m128i alive = _mm_or_si128(_mm_cmpeq_epi8(c, o), _mm_cmpeq_epi8(c, star));
+        _mm_storeu_si128((__m128i*)(row + i), _mm_and_si128(alive, one));
+    }
+#endif
+    for (; i < len; i++) { row[i] = line[i] == 'O' || line[i] == '*'; }
+    memset(row + len, 0, n - len);
+}
+
+/**
+ * Parses a CSV row into n cells. Any value with a nonzero digit is alive.
+ */
+static inline void __text_parse_csv(const char* line, const char* eol, uint8_t* row, size_t n) {
+    eol = __text_trim(line, eol);
+    const char* p = line;
     size_t i = 0;
-    while (tok) {
-        out[i] = __read_csv_val(tok);
-        if (++i == count) { return; } // stop reading
-        tok = strtok(NULL, ",");
+#ifdef __SSE2__
+    // the common "0,1,1,0,..." layout has the digits at the even bytes and
+    // the commas at the odd bytes, so 32 bytes are 16 cells
+    const __m128i low = _mm_set1_epi16(0x00ff), zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1), comma = _mm_set1_epi8(','), digit0 = _mm_set1_epi8('0');
+    for (; i + 16 <= n && p + 32 <= eol; i += 16, p += 32) {
+        __m128i a = _mm_loadu_si128((const __m128i*)p), b = _mm_loadu_si128((const __m128i*)(p + 16));
+        __m128i values = _mm_sub_epi8(_mm_packus_epi16(_mm_and_si128(a, low), _mm_and_si128(b, low)), digit0);
+        __m128i commas = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        __m128i ok = _mm_and_si128(_mm_cmpeq_epi8(commas, comma),
+                                   _mm_cmpeq_epi8(_mm_andnot_si128(one, values), zero));
+        if (_mm_movemask_epi8(ok) != 0xffff) { break; } // some other layout, finish the row one value at a time
+        _mm_storeu_si128((__m128i*)(row + i), values);
     }
-    memset(out+i, 0, (count-i)*sizeof(double)); // zero-fill remainder
+#endif
+    while (i < n && p < eol) {
+        uint8_t alive = 0;
+        for (; p < eol && *p != ','; p++) { alive |= *p >= '1' && *p <= '9'; }
+        row[i++] = alive;
+        if (p < eol) { p++; } // the comma
+    }
+    memset(row + i, 0, n - i);
 }
 
 
@@ -79,61 +150,157 @@ static inline bool __py_dict_value_bool(const char* dict,
     return false;
 }
 
+static inline bool __py_dict_value_dims(const char* dict, const char* key,
+                                        size_t* dims, size_t* n_dims) {
+    const char* s = __py_dict_value(dict, key);
+    dims[0] = dims[1] = dims[2] = 1;
+    *n_dims = 0;
+    if (!s || *s++ != '(') { return false; }
+    for (;;) {
+        while (isspace(*s)) { s++; }
+        if (*s == ')') { break; }
+        if (*n_dims == 3 || !isdigit(*s)) { return false; }
+        dims[(*n_dims)++] = strtoull(s, (char**)&s, 10);
+        while (isspace(*s)) { s++; }
+        if (*s == ',') { s++; } else if (*s != ')') { return false; }
+    }
+    return true;
+}
+
 static inline bool __py_dict_value_tuple(const char* dict,
                                          const char* key, size_t* val) {
-    const char* s = __py_dict_value(dict, key);
-    val[0] = val[1] = 1;
-    char c = 0;
-    return s && *s++ == '(' && ((sscanf(s, " %c", &c) == 1 && c == ')') ||
-        (sscanf(s, " %zu %c", &val[0], &c) == 2 && c == ')') ||
-        (sscanf(s, " %zu , %c", &val[0], &c) == 2 && c == ')') ||
-        (sscanf(s, " %zu , %zu %c", &val[0], &val[1], &c) == 3 && c == ')') ||
-        (sscanf(s, " %zu , %zu , %c", &val[0], &val[1], &c) == 3 && c == ')'));
+    size_t dims[3], n_dims;
+    if (!__py_dict_value_dims(dict, key, dims, &n_dims)) { return false; }
+    // a single frame of a history, as written by grid_to_npy(), is a 2d grid
+    if (n_dims == 3) {
+        if (dims[0] != 1) { return false; }
+        dims[0] = dims[1];
+        dims[1] = dims[2];
+    }
+    val[0] = dims[0];
+    val[1] = dims[1];
+    return true;
 }
 
-static inline bool __npy_read_header(FILE* file, size_t* sh, size_t* offset) {
-    unsigned char header[10];
-    if (fread(header, 1, 10, file) != 10) { return false; }
-    if (memcmp(header, "\x93NUMPY", 6) != 0) { errno = EINVAL; return false; }
-    // header[6] is major file version
-    // header[7] is minor file version
-    int len = *(unsigned short*)(header+8); // assumes running on little-endian
-    *offset = sizeof(header) + len;
-    char* dict = (char*)malloc(len+1);
-    if (fread(dict, 1, len, file) != len || dict[0] != '{') {
-        free(dict);
-        errno = EINVAL;
-        return false;
+/**
+ * The element type and layout of a NPY array.
+ */
+struct __npy_dtype {
+    char kind;          // 'b' bool, 'u' unsigned, 'i' signed, 'f' float
+    size_t itemsize;    // bytes per element
+    bool big_endian;
+    bool fortran_order; // column-major
+};
+
+/**
+ * Parses a numpy type descriptor like '<i8' or '|b1'. Only bools, integers
+ * of 1 to 8 bytes and floats of 2, 4 or 8 bytes are supported.
+ */
+static inline bool __npy_parse_descr(const char* descr, struct __npy_dtype* dtype) {
+    if (strcmp(descr, "uint8") == 0) { descr = "|u1"; }
+    dtype->big_endian = *descr == '>';
+    if (*descr == '<' || *descr == '>' || *descr == '|' || *descr == '=') { descr++; }
+    char* end;
+    dtype->kind = *descr;
+    dtype->itemsize = strtoul(descr + 1, &end, 10);
+    if (*end || end == descr + 1) { return false; }
+    switch (dtype->kind) {
+        case 'b': return dtype->itemsize == 1;
+        case 'u': case 'i':
+            return dtype->itemsize == 1 || dtype->itemsize == 2 || dtype->itemsize == 4 || dtype->itemsize == 8;
+        case 'f': return dtype->itemsize == 2 || dtype->itemsize == 4 || dtype->itemsize == 8;
+        default: return false;
     }
-    dict[len] = 0;
+}
+
+/**
+ * Checks the header dictionary of a NPY file (NUL-terminated) and gets the
+ * shape of the matrix and its element type from it.
+ */
+static inline bool __npy_check_dict(const char* dict, size_t* sh, struct __npy_dtype* dtype) {
+    if (dict[0] != '{') { errno = EINVAL; return false; }
 
-    // only allowed descr: 'float64', 'f8', or '<f8'
+    // allowed descr: bools, integers and floats (see __npy_parse_descr())
     char* descr = __py_dict_value_str(dict, "descr");
-    if (!descr) { free(dict); errno = EINVAL; return false; }
-    if (strcmp(descr, "uint8") != 0 && strcmp(descr, "u1") != 0 &&
-        strcmp(descr, "<u1") != 0 && strcmp(descr, ">u1") != 0 && strcmp(descr, "|u1") != 0) {
-        errno = EINVAL;
-        free(descr);
-        free(dict);
-        return false;
-    }
+    if (!descr) { errno = EINVAL; return false; }
+    bool supported = __npy_parse_descr(descr, dtype);
     free(descr);
+    if (!supported) { errno = EINVAL; return false; }
 
-    // only allowed fortran_order is false
-    bool fortran_order = false;
-    if (!__py_dict_value_bool(dict, "fortran_order", &fortran_order) &&
-        fortran_order) {
+    // either order is allowed, Fortran order is transposed when loading
+    if (!__py_dict_value_bool(dict, "fortran_order", &dtype->fortran_order)) {
         errno = EINVAL;
-        free(dict);
         return false;
     }
 
-    // only allowed to be 0d, 1d, or 2d, but this is checked elsewhere
+    // only allowed to be 0d, 1d, 2d, or a single 2d frame
     if (!__py_dict_value_tuple(dict, "shape", sh) || sh[0] < 1 || sh[1] < 1) {
         errno = EINVAL;
-        free(dict);
         return false;
     }
-    free(dict);
     return true;
 }
+
+/**
+ * Reads the header dictionary of a NPY file, allocated with malloc().
+ */
+static inline char* __npy_read_dict(FILE* file, size_t* offset) {
+    unsigned char header[10];
+    if (fread(header, 1, 10, file) != 10) { return NULL; }
+    if (memcmp(header, "\x93NUMPY", 6) != 0) { errno = EINVAL; return NULL; }
+    // header[6] is major file version
+    // header[7] is minor file version
+    int len = *(unsigned short*)(header+8); // assumes running on little-endian
+    *offset = sizeof(header) + len;
+    char* dict = (char*)malloc(len+1);
+    if (fread(dict, 1, len, file) != len) {
+        free(dict);
+        errno = EINVAL;
+        return NULL;
+    }
+    dict[len] = 0;
+    return dict;
+}
+
+static inline bool __npy_read_header(FILE* file, size_t* sh, size_t* offset, struct __npy_dtype* dtype) {
+    char* dict = __npy_read_dict(file, offset);
+    if (!dict) { return false; }
+    bool ok = __npy_check_dict(dict, sh, dtype);
+    free(dict);
+    return ok;
+}
+
+/**
+ * Same as __npy_read_header() but for arrays of up to 3 dimensions, like
+ * histories, which are given as is.
+ */
+static inline bool __npy_read_array_header(FILE* file, size_t* dims, size_t* n_dims, size_t* offset,
+                                           struct __npy_dtype* dtype) {
+    char* dict = __npy_read_dict(file, offset);
+    if (!dict) { return false; }
+    char* descr = __py_dict_value_str(dict, "descr");
+    bool ok = descr && __npy_parse_descr(descr, dtype) &&
+              __py_dict_value_bool(dict, "fortran_order", &dtype->fortran_order) &&
+              __py_dict_value_dims(dict, "shape", dims, n_dims);
+    free(descr);
+    free(dict);
+    if (!ok) { errno = EINVAL; }
+    return ok;
+}
+
+/**
+ * Same as __npy_read_header() for a file that is already in memory. The
+ * header is NUL-terminated in place, so the buffer needs to be writable.
+ */
+static inline bool __npy_parse_header(char* buf, size_t size, size_t* sh, size_t* offset,
+                                      struct __npy_dtype* dtype) {
+    if (size < 10 || memcmp(buf, "\x93NUMPY", 6) != 0) { errno = EINVAL; return false; }
+    size_t len = *(unsigned short*)(buf+8); // assumes running on little-endian
+    *offset = 10 + len;
+    if (*offset > size || len < 1) { errno = EINVAL; return false; }
+    char last = buf[*offset-1];
+    buf[*offset-1] = 0; // the header ends with a newline that is not part of the dictionary
+    bool ok = __npy_check_dict(buf + 10, sh, dtype);
+    buf[*offset-1] = last;
+    return ok;
+}
@@ -0,0 +1,268 @@
+/**
+ * Live metrics of a run, published in a named POSIX shared-memory segment so
+ * other processes can watch the progress without stopping the run.
+ */
+
+#if defined(linux)
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "metrics.h"
+
+#define METRICS_RECV_TIMEOUT 1 // seconds a scrape may take to send its request
+
+struct __metrics_server {
+    const struct gol_metrics* metrics;
+    int sock;
+    pthread_t thread;
+};
+
+// The server of the metrics of this process, there is one segment per process
+static struct __metrics_server* __server = NULL;
+
+static uint64_t __now_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+/**
+ * Get the name of the shared-memory segment of the given process.
+ */
+void metrics_shm_name(pid_t pid, char* name, size_t size) {
+    snprintf(name, size, "/gol-metrics-%ld", (long)pid);
+}
+
+/**
+ * Creates and maps the metrics segment of this process for a run on an
+ * m by n grid for the given number of generations. Returns NULL if the
+ * segment cannot be created.
+ */
+struct gol_metrics* metrics_create(size_t m, size_t n, size_t generations) {
+    char name[64];
+    metrics_shm_name(getpid(), name, sizeof(name));
+    int fd = shm_open(name, O_CREAT|O_RDWR|O_TRUNC, 0644);
+    if (fd < 0) { return NULL; }
+    if (ftruncate(fd, sizeof(struct gol_metrics)) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    struct gol_metrics* metrics = (struct gol_metrics*)mmap(NULL, sizeof(struct gol_metrics),
+        PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (metrics == MAP_FAILED) { shm_unlink(name); return NULL; }
+
+    metrics->version = GOL_METRICS_VERSION;
+    metrics->pid = getpid();
+    metrics->rows = m;
+    metrics->cols = n;
+    metrics->start_ns = metrics->update_ns = __now_ns();
+    metrics->generations_total = generations;
+    // readers check the magic last so they never see a half-initialized block
+    __atomic_store_n(&metrics->magic, GOL_METRICS_MAGIC, __ATOMIC_RELEASE);
+    return metrics;
+}
+
+/**
+ * Stops the server of the metrics segment of this process and unmaps and
+ * removes the segment.
+ */
+void metrics_destroy(struct gol_metrics* metrics) {
+    if (!metrics) { return; }
+    // a scrape being answered still reads the segment, wait for it
+    if (__server && __server->metrics == metrics) {
+        shutdown(__server->sock, SHUT_RDWR);
+        pthread_join(__server->thread, NULL);
+        close(__server->sock);
+        free(__server);
+        __server = NULL;
+    }
+    char name[64];
+    metrics_shm_name(getpid(), name, sizeof(name));
+    munmap(metrics, sizeof(struct gol_metrics));
+    shm_unlink(name);
+}
+
+/**
+ * Maps the metrics segment of another process read-only. Returns NULL if it
+ * does not exist or is not a metrics segment.
+ */
+const struct gol_metrics* metrics_attach(pid_t pid) {
+    char name[64];
+    metrics_shm_name(pid, name, sizeof(name));
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) { return NULL; }
+    void* x = mmap(NULL, sizeof(struct gol_metrics), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (x == MAP_FAILED) { return NULL; }
+    const struct gol_metrics* metrics = (const struct gol_metrics*)x;
+    if (__atomic_load_n(&metrics->magic, __ATOMIC_ACQUIRE) != GOL_METRICS_MAGIC ||
+        metrics->version != GOL_METRICS_VERSION) {
+        munmap(x, sizeof(struct gol_metrics));
+        errno = EINVAL;
+        return NULL;
+    }
+    return metrics;
+}
+
+/**
+ * Unmaps a segment mapped with metrics_attach().
+ */
+void metrics_detach(const struct gol_metrics* metrics) {
+    if (metrics) { munmap((void*)metrics, sizeof(struct gol_metrics)); }
+}
+
+/**
+ * Counts the live cells in a grid.
+ */
+size_t count_alive(const uint8_t* grid, size_t grid_size) {
+    // cells are 0 or 1 so the sum of a block of up to 255 fits in a byte,
+    // which lets the compiler vectorize the inner loop
+    size_t total = 0;
+    for (size_t i = 0; i < grid_size; i += 255) {
+        size_t end = i + 255 < grid_size ? i + 255 : grid_size;
+        uint8_t sum = 0;
+        for (size_t j = i; j < end; j++) { sum += grid[j] != 0; }
+        total += sum;
+    }
+    return total;
+}
+
+/**
+ * Records that a generation finished with the given grid, updating all of
+ * its cells. The population is recounted every GOL_METRICS_POPULATION_INTERVAL
+ * generations and for the last one.
+ */
+void metrics_generation(struct gol_metrics* metrics, size_t generation,
+                        const uint8_t* grid, size_t grid_size) {
+    if (generation % GOL_METRICS_POPULATION_INTERVAL == 0 ||
+        generation == metrics->generations_total) {
+        metrics_store(metrics->population, count_alive(grid, grid_size));
+    }
+    metrics_add(metrics->cells_updated, grid_size);
+    metrics_store(metrics->update_ns, __now_ns());
+    metrics_store(metrics->generation, generation);
+}
+
+/**
+ * Formats the metrics in the Prometheus text exposition format. Returns the
+ * length of the text like snprintf().
+ */
+int metrics_format_prometheus(const struct gol_metrics* metrics, char* buf, size_t size) {
+    uint64_t cells = metrics_load(metrics->cells_updated);
+    double elapsed = (__now_ns() - metrics->start_ns) / 1000000000.0;
+    return snprintf(buf, size,
+        "# HELP gol_generation Generations completed.\n"
+        "# TYPE gol_generation gauge\n"
+        "gol_generation %" PRIu64 "\n"
+        "# HELP gol_generations_total Generations the run was asked for.\n"
+        "# TYPE gol_generations_total gauge\n"
+        "gol_generations_total %" PRIu64 "\n"
+        "# HELP gol_cells_updated_total Cell updates done so far.\n"
+        "# TYPE gol_cells_updated_total counter\n"
+        "gol_cells_updated_total %" PRIu64 "\n"
+        "# HELP gol_cells_per_second Average cell updates per second.\n"
+        "# TYPE gol_cells_per_second gauge\n"
+        "gol_cells_per_second %g\n"
+        "# HELP gol_population Live cells at the last sample.\n"
+        "# TYPE gol_population gauge\n"
+        "gol_population %" PRIu64 "\n"
+        "# HELP gol_io_backlog_bytes Output produced but not yet written.\n"
+        "# TYPE gol_io_backlog_bytes gauge\n"
+        "gol_io_backlog_bytes %" PRIu64 "\n"
+        "# HELP gol_elapsed_seconds Time since the run started.\n"
+        "# TYPE gol_elapsed_seconds gauge\n"
+        "gol_elapsed_seconds %g\n"
+        "# HELP gol_thread_imbalance Slowest thread over the mean at the last check, 1 is balanced.\n"
+        "# TYPE gol_thread_imbalance gauge\n"
+        "gol_thread_imbalance %g\n"
+        "# HELP gol_rebalances_total Times rows were moved between threads.\n"
+        "# TYPE gol_rebalances_total counter\n"
+        "gol_rebalances_total %" PRIu64 "\n",
+        metrics_load(metrics->generation), metrics->generations_total, cells,
+        elapsed > 0 ? cells / elapsed : 0.0, metrics_load(metrics->population),
+        metrics_load(metrics->io_backlog_bytes), elapsed,
+        metrics_load(metrics->imbalance_permille) / 1000.0, metrics_load(metrics->rebalances));
+}
+
+/**
+ * Answers every connection with the current metrics, whatever was asked for,
+ * until the socket is shut down.
+ */
+static void* __metrics_serve(void* arg) {
+    struct __metrics_server* server = (struct __metrics_server*)arg;
+    char request[1024], body[4096], header[128];
+    for (;;) {
+        int client = accept(server->sock, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR) { continue; }
+            break;
+        }
+        struct timeval timeout = { METRICS_RECV_TIMEOUT, 0 };
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        if (recv(client, request, sizeof(request), 0) >= 0) {
+            int len = metrics_format_prometheus(server->metrics, body, sizeof(body));
+            int head = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\n"
+                "Content-Length: %d\r\n\r\n", len);
+            if (send(client, header, head, MSG_NOSIGNAL) == head) {
+                send(client, body, len, MSG_NOSIGNAL);
+            }
+        }
+        close(client);
+    }
+    return NULL;
+}
+
+/**
+ * Starts a background thread serving the metrics in the Prometheus text
+ * format over HTTP on 127.0.0.1 at the given port, until metrics_destroy().
+ * Returns false if the port cannot be bound or the metrics are served
+ * already.
+ */
+bool metrics_serve(const struct gol_metrics* metrics, int port) {
+    if (__server) { errno = EBUSY; return false; }
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) { return false; }
+    int one = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(sock, 8) != 0) {
+        close(sock);
+        return false;
+    }
+
+    struct __metrics_server* server = (struct __metrics_server*)malloc(sizeof(struct __metrics_server));
+    if (!server) { close(sock); return false; }
+    server->metrics = metrics;
+    server->sock = sock;
+    if (pthread_create(&server->thread, NULL, __metrics_serve, server) != 0) {
+        close(sock);
+        free(server);
+        return false;
+    }
+    __server = server;
+    return true;
+}
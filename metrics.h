@@ -0,0 +1,116 @@
+/**
+ * Live metrics of a run, published in a named POSIX shared-memory segment so
+ * other processes can watch the progress without stopping the run.
+ *
+ * The engine updates the counters with relaxed atomic stores, readers load
+ * them the same way. Every counter is consistent on its own, the block as a
+ * whole is not a snapshot.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GOL_METRICS_MAGIC 0x5343495254454d47ull // "GMETRICS"
+#define GOL_METRICS_VERSION 2
+
+/**
+ * The shared metrics block. All fields but the header are updated with
+ * relaxed atomics, use metrics_load() to read them.
+ */
+struct gol_metrics {
+    uint64_t magic;
+    uint64_t version;
+    uint64_t pid;
+    uint64_t rows, cols;
+    uint64_t start_ns;          // CLOCK_MONOTONIC time the run started
+
+    uint64_t generation;        // generations completed
+    uint64_t generations_total; // generations the run was asked for
+    uint64_t cells_updated;     // cell updates done so far
+    uint64_t population;        // live cells at the last sample
+    uint64_t io_backlog_bytes;  // output produced but not yet written
+    uint64_t update_ns;         // CLOCK_MONOTONIC time of the last update
+    uint64_t imbalance_permille; // slowest thread over the mean at the last check, 1000 is balanced (0 if not measured)
+    uint64_t rebalances;        // times rows were moved between threads
+};
+
+/**
+ * Generations between population samples, counting the live cells is a
+ * full pass over the grid.
+ */
+#define GOL_METRICS_POPULATION_INTERVAL 16
+
+/**
+ * Relaxed atomic store and load of a metrics field.
+ */
+#define metrics_store(field, value) __atomic_store_n(&(field), (uint64_t)(value), __ATOMIC_RELAXED)
+#define metrics_add(field, value) __atomic_fetch_add(&(field), (uint64_t)(value), __ATOMIC_RELAXED)
+#define metrics_load(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+/**
+ * Get the name of the shared-memory segment of the given process.
+ */
+void metrics_shm_name(pid_t pid, char* name, size_t size);
+
+/**
+ * Creates and maps the metrics segment of this process for a run on an
+ * m by n grid for the given number of generations. Returns NULL if the
+ * segment cannot be created.
+ */
+struct gol_metrics* metrics_create(size_t m, size_t n, size_t generations);
+
+/**
+ * Stops the server of the metrics segment of this process and unmaps and
+ * removes the segment.
+ */
+void metrics_destroy(struct gol_metrics* metrics);
+
+/**
+ * Maps the metrics segment of another process read-only. Returns NULL if it
+ * does not exist or is not a metrics segment.
+ */
+const struct gol_metrics* metrics_attach(pid_t pid);
+
+/**
+ * Unmaps a segment mapped with metrics_attach().
+ */
+void metrics_detach(const struct gol_metrics* metrics);
+
+/**
+ * Records that a generation finished with the given grid, updating all of
+ * its cells. The population is recounted every GOL_METRICS_POPULATION_INTERVAL
+ * generations and for the last one.
+ */
+void metrics_generation(struct gol_metrics* metrics, size_t generation,
+                        const uint8_t* grid, size_t grid_size);
+
+/**
+ * Counts the live cells in a grid.
+ */
+size_t count_alive(const uint8_t* grid, size_t grid_size);
+
+/**
+ * Formats the metrics in the Prometheus text exposition format. Returns the
+ * length of the text like snprintf().
+ */
+int metrics_format_prometheus(const struct gol_metrics* metrics, char* buf, size_t size);
+
+/**
+ * Starts a background thread serving the metrics in the Prometheus text
+ * format over HTTP on 127.0.0.1 at the given port, until metrics_destroy().
+ * Returns false if the port cannot be bound or the metrics are served
+ * already.
+ */
+bool metrics_serve(const struct gol_metrics* metrics, int port);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,190 @@
+/**
+ * Density pyramids of a run, see pyramid.h.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "pyramid.h"
+#include "util.h"
+
+#define PYRAMID_MAX_LEVELS 32
+
+struct __level {
+    size_t m, n;     // blocks per column and row
+    size_t itemsize; // bytes per block in the file
+    uint32_t* counts; // levels after the first
+    void* out;       // the counts narrowed for the file
+    char* path;
+    FILE* file;
+};
+
+struct density_pyramid {
+    size_t m, n;
+    size_t n_levels;
+    size_t generations, appended;
+    size_t num_threads;
+    uint8_t* first; // the first level, 2x2 blocks fit in bytes
+    struct __level levels[PYRAMID_MAX_LEVELS];
+};
+
+static const char* __descr(size_t itemsize) {
+    return itemsize == 1 ? "<u1" : itemsize == 2 ? "<u2" : "<u4";
+}
+
+static bool __write_header(struct __level* l, size_t generations) {
+    size_t shape[3] = {generations, l->m, l->n};
+    return npy_write_header(l->file, __descr(l->itemsize), shape, 3);
+}
+
+static void __free(struct density_pyramid* p) {
+    for (size_t k = 0; k < p->n_levels; k++) {
+        struct __level* l = &p->levels[k];
+        if (l->file) { fclose(l->file); }
+        free(l->counts);
+        if (l->out != p->first && l->out != (void*)l->counts) { free(l->out); }
+        free(l->path);
+    }
+    free(p->first);
+    free(p);
+}
+
+/**
+ * Creates the files of a pyramid with the given number of levels (fewer if
+ * the blocks would be larger than the grid) for up to the given number of
+ * generations. The first level is computed with num_threads threads when
+ * built with OpenMP. Returns NULL if the files cannot be created.
+ */
+struct density_pyramid* pyramid_open(const char* output_file, size_t m, size_t n,
+                                     size_t levels, size_t generations, size_t num_threads) {
+    struct density_pyramid* p = (struct density_pyramid*)calloc(1, sizeof(struct density_pyramid));
+    if (!p) { return NULL; }
+    p->m = m;
+    p->n = n;
+    p->generations = generations;
+    p->num_threads = num_threads ? num_threads : 1;
+
+    bool ok = true;
+    size_t side = 1;
+    for (size_t k = 0; k < levels && k < PYRAMID_MAX_LEVELS && ok; k++) {
+        side *= 2;
+        if (side / 2 >= m && side / 2 >= n) { break; } // the last level is a single block
+        struct __level* l = &p->levels[p->n_levels++];
+        l->m = (m + side - 1) / side;
+        l->n = (n + side - 1) / side;
+        l->itemsize = side <= 8 ? 1 : side <= 128 ? 2 : 4; // a block has at most side*side cells
+        size_t size = l->m * l->n;
+        if (k == 0) {
+            ok = (l->out = p->first = (uint8_t*)malloc(size ? size : 1)) != NULL;
+        } else {
+            l->counts = (uint32_t*)malloc(size * sizeof(uint32_t));
+            l->out = l->itemsize == 4 ? (void*)l->counts : malloc(size * l->itemsize);
+            ok = l->counts && l->out;
+        }
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".density%zu.npy", side);
+        l->path = sibling_path(output_file, suffix);
+        ok = ok && (l->file = fopen(l->path, "wb")) && __write_header(l, generations);
+    }
+    if (!ok) { __free(p); return NULL; }
+    return p;
+}
+
+/**
+ * Counts the 2x2 blocks of two rows of cells (the second may be NULL past
+ * the last row). Eight cells of each row are added at once: the two rows
+ * are added bytewise, then neighbouring bytes into 16-bit lanes.
+ */
+static void __first_level(const uint8_t* r0, const uint8_t* r1, size_t n, uint8_t* out) {
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8) {
+        uint64_t x, y = 0;
+        memcpy(&x, r0 + j, 8);
+        if (r1) { memcpy(&y, r1 + j, 8); }
+        x += y;
+        x = (x & 0x00ff00ff00ff00ffull) + ((x >> 8) & 0x00ff00ff00ff00ffull);
+        x = (x | (x >> 8)) & 0x0000ffff0000ffffull;
+        x = (x | (x >> 16)) & 0x00000000ffffffffull; // the 4 counts in the low bytes, assumes little-endian
+        memcpy(out + j / 2, &x, 4);
+    }
+    for (; j < n; j += 2) {
+        uint8_t count = r0[j] + (j + 1 < n ? r0[j + 1] : 0);
+        if (r1) { count += r1[j] + (j + 1 < n ? r1[j + 1] : 0); }
+        out[j / 2] = count;
+    }
+}
+
+/**
+ * Gets a count of a level, which for the first one is a byte.
+ */
+static inline uint32_t __count(const struct density_pyramid* p, size_t k, size_t i, size_t j) {
+    const struct __level* l = &p->levels[k];
+    return k == 0 ? p->first[i * l->n + j] : l->counts[i * l->n + j];
+}
+
+/**
+ * Computes the pyramid of the next generation and appends it to the files.
+ * Returns false if it cannot be written.
+ */
+bool pyramid_append(struct density_pyramid* p, const uint8_t* grid) {
+    if (!p->n_levels) { return true; }
+    size_t m = p->m, n = p->n, half = p->levels[0].n;
+    int num_threads = (int)p->num_threads;
+    #ifdef _OPENMP
+    #pragma omp parallel for num_threads(num_threads) if(num_threads > 1)
+    #endif
+    for (size_t i = 0; i < m; i += 2) {
+        __first_level(grid + i * n, i + 1 < m ? grid + (i + 1) * n : NULL, n, p->first + (i / 2) * half);
+    }
+    (void)num_threads;
+
+    // Every other level sums the 2x2 blocks below it
+    for (size_t k = 1; k < p->n_levels; k++) {
+        struct __level* l = &p->levels[k], * below = &p->levels[k - 1];
+        for (size_t i = 0; i < l->m; i++) {
+            for (size_t j = 0; j < l->n; j++) {
+                size_t bi = 2 * i, bj = 2 * j;
+                uint32_t count = __count(p, k - 1, bi, bj);
+                if (bj + 1 < below->n) { count += __count(p, k - 1, bi, bj + 1); }
+                if (bi + 1 < below->m) {
+                    count += __count(p, k - 1, bi + 1, bj);
+                    if (bj + 1 < below->n) { count += __count(p, k - 1, bi + 1, bj + 1); }
+                }
+                l->counts[i * l->n + j] = count;
+            }
+        }
+        size_t size = l->m * l->n;
+        if (l->itemsize == 1) { for (size_t i = 0; i < size; i++) { ((uint8_t*)l->out)[i] = (uint8_t)l->counts[i]; } }
+        else if (l->itemsize == 2) { for (size_t i = 0; i < size; i++) { ((uint16_t*)l->out)[i] = (uint16_t)l->counts[i]; } }
+    }
+
+    for (size_t k = 0; k < p->n_levels; k++) {
+        struct __level* l = &p->levels[k];
+        size_t size = l->m * l->n;
+        if (fwrite(l->out, l->itemsize, size, l->file) != size) { return false; }
+    }
+    p->appended++;
+    return true;
+}
+
+/**
+ * Closes the files, fixing their headers if fewer generations than planned
+ * were appended. Returns false if anything could not be written.
+ */
+bool pyramid_close(struct density_pyramid* p) {
+    bool ok = true;
+    for (size_t k = 0; k < p->n_levels; k++) {
+        struct __level* l = &p->levels[k];
+        if (p->appended != p->generations) {
+            ok = fseek(l->file, 0, SEEK_SET) == 0 && __write_header(l, p->appended) && ok;
+        }
+        ok = fclose(l->file) == 0 && ok;
+        l->file = NULL;
+    }
+    __free(p);
+    return ok;
+}
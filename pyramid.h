@@ -0,0 +1,52 @@
+/**
+ * Density pyramids of a run, for viewing huge histories at any zoom without
+ * reading them at full resolution. Level k counts the live cells of each
+ * 2^k by 2^k block, and is saved next to the output file as
+ * <output>.density<2^k>.npy with a frame per generation:
+ *
+ *     <output>.density2.npy   uint8  (generations, m/2, n/2)
+ *     <output>.density4.npy   uint8  (generations, m/4, n/4)
+ *     ...                     uint16 from 16x16 blocks, uint32 from 256x256
+ *
+ * Blocks at the bottom and right edges cover fewer cells. The first level
+ * is computed from 8 cells at a time of two rows, every other level from
+ * the 2x2 blocks of the level below, so a pyramid costs about a third of a
+ * pass over the grid per generation.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct density_pyramid;
+
+/**
+ * Creates the files of a pyramid with the given number of levels (fewer if
+ * the blocks would be larger than the grid) for up to the given number of
+ * generations. The first level is computed with num_threads threads when
+ * built with OpenMP. Returns NULL if the files cannot be created.
+ */
+struct density_pyramid* pyramid_open(const char* output_file, size_t m, size_t n,
+                                     size_t levels, size_t generations, size_t num_threads);
+
+/**
+ * Computes the pyramid of the next generation and appends it to the files.
+ * Returns false if it cannot be written.
+ */
+bool pyramid_append(struct density_pyramid* pyramid, const uint8_t* grid);
+
+/**
+ * Closes the files, fixing their headers if fewer generations than planned
+ * were appended. Returns false if anything could not be written.
+ */
+bool pyramid_close(struct density_pyramid* pyramid);
+
+#ifdef __cplusplus
+}
+#endif
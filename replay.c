@@ -0,0 +1,234 @@
+/**
+ * Periodic-tile replay, see replay.h.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "replay.h"
+#include "helpers.h"
+
+#define REPLAY_MAX_PERIODS 32 // periods are kept as bits of a mask
+
+struct tile_replay {
+    size_t m, n, tile;
+    size_t tiles_m, tiles_n, n_tiles;
+    size_t max_period, cycles, num_threads;
+    size_t generation;
+    uint8_t* frames;   // the last max_period generations, generation g is frame g % max_period
+    uint64_t* hashes;  // max_period+1 generations of tile hashes, generation g is row g % (max_period+1)
+    uint32_t* runs;    // for each tile and period, generations in a row the hash repeated with it
+    uint32_t* masks;   // for each tile, bit p-1 if the period p repeated for enough cycles
+    uint8_t* period;   // period each tile is replayed with, 0 if it is computed
+    size_t computed, replayed;
+};
+
+static inline void __bounds(const struct tile_replay* r, size_t t, size_t* r0, size_t* c0, size_t* th, size_t* tw) {
+    *r0 = (t / r->tiles_n) * r->tile;
+    *c0 = (t % r->tiles_n) * r->tile;
+    *th = r->m - *r0 < r->tile ? r->m - *r0 : r->tile;
+    *tw = r->n - *c0 < r->tile ? r->n - *c0 : r->tile;
+}
+
+static inline uint64_t __fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdull;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ull;
+    k ^= k >> 33;
+    return k;
+}
+
+/**
+ * Hashes the cells of a tile 8 at a time. Every word goes through the
+ * MurmurHash3 finalizer (like in cache.c) so each cell affects all bits of
+ * the hash, since tiles are replayed on equal hashes alone.
+ */
+static uint64_t __hash(const struct tile_replay* r, const uint8_t* grid, size_t t) {
+    size_t r0, c0, th, tw;
+    __bounds(r, t, &r0, &c0, &th, &tw);
+    uint64_t h = 14695981039346656037ull, w;
+    for (size_t i = 0; i < th; i++) {
+        const uint8_t* row = grid + (r0 + i) * r->n + c0;
+        size_t j = 0;
+        for (; j + 8 <= tw; j += 8) { memcpy(&w, row + j, 8); h = __fmix64(h ^ w); }
+        if (j < tw) {
+            w = 0;
+            memcpy(&w, row + j, tw - j);
+            h = __fmix64(h ^ w ^ ((uint64_t)(tw - j) << 56));
+        }
+    }
+    return h;
+}
+
+static void __copy_tile(const struct tile_replay* r, const uint8_t* src, uint8_t* dst, size_t t) {
+    size_t r0, c0, th, tw;
+    __bounds(r, t, &r0, &c0, &th, &tw);
+    for (size_t i = 0; i < th; i++) { memcpy(dst + (r0 + i) * r->n + c0, src + (r0 + i) * r->n + c0, tw); }
+}
+
+static inline uint64_t* __hashes(const struct tile_replay* r, size_t generation) {
+    return r->hashes + (generation % (r->max_period + 1)) * r->n_tiles;
+}
+
+static inline uint8_t* __frame(const struct tile_replay* r, size_t generation) {
+    return r->frames + (generation % r->max_period) * r->m * r->n;
+}
+
+/**
+ * Creates the replay of an m by n grid, split into tile by tile tiles, that
+ * replays periods up to max_period once they repeat for the given number
+ * of cycles. Tiles are stepped with num_threads threads when built with
+ * OpenMP. Returns NULL and sets errno if the grid is empty or it cannot be
+ * allocated.
+ */
+struct tile_replay* replay_create(const uint8_t* grid, size_t m, size_t n, size_t tile,
+                                  size_t max_period, size_t cycles, size_t num_threads) {
+    if (!m || !n || !tile || !max_period || max_period > REPLAY_MAX_PERIODS) { errno = EINVAL; return NULL; }
+    struct tile_replay* r = (struct tile_replay*)calloc(1, sizeof(struct tile_replay));
+    if (!r) { return NULL; }
+    r->m = m;
+    r->n = n;
+    r->tile = tile;
+    r->tiles_m = (m + tile - 1) / tile;
+    r->tiles_n = (n + tile - 1) / tile;
+    r->n_tiles = r->tiles_m * r->tiles_n;
+    r->max_period = max_period;
+    r->cycles = cycles ? cycles : 1;
+    r->num_threads = num_threads ? num_threads : 1;
+    bool ok = (r->frames = (uint8_t*)malloc(max_period * m * n)) &&
+              (r->hashes = (uint64_t*)malloc((max_period + 1) * r->n_tiles * sizeof(uint64_t))) &&
+              (r->runs = (uint32_t*)calloc(max_period * r->n_tiles, sizeof(uint32_t))) &&
+              (r->masks = (uint32_t*)calloc(r->n_tiles, sizeof(uint32_t))) &&
+              (r->period = (uint8_t*)calloc(r->n_tiles, 1));
+    if (!ok) { replay_free(r); errno = ENOMEM; return NULL; }
+    memcpy(r->frames, grid, m * n);
+    for (size_t t = 0; t < r->n_tiles; t++) { r->hashes[t] = __hash(r, grid, t); }
+    return r;
+}
+
+/**
+ * Chooses the period a tile is replayed with in the next generation, 0 to
+ * compute it. A replayed tile goes on while it and its neighbours repeated
+ * in the last generation, another one starts once they all repeated with a
+ * period for enough cycles.
+ */
+static size_t __decide(const struct tile_replay* r, size_t t) {
+    size_t ti = t / r->tiles_n, tj = t % r->tiles_n, p = r->period[t];
+    uint32_t mask = ~0u;
+    for (size_t i = ti ? ti - 1 : 0; i <= ti + 1 && i < r->tiles_m; i++) {
+        for (size_t j = tj ? tj - 1 : 0; j <= tj + 1 && j < r->tiles_n; j++) {
+            size_t u = i * r->tiles_n + j;
+            if (p && !r->runs[u * r->max_period + p - 1]) { return 0; }
+            mask &= r->masks[u];
+        }
+    }
+    return p ? p : mask ? (size_t)__builtin_ctz(mask) + 1 : 0;
+}
+
+/**
+ * Computes the next generation of the grid, which has to be the last
+ * generation computed (or the one the replay was created with), into
+ * grid_next.
+ */
+void replay_step(struct tile_replay* r, const uint8_t* grid, uint8_t* grid_next) {
+    size_t g = r->generation, P = r->max_period, computed = 0, replayed = 0;
+    uint8_t* frame_next = __frame(r, g + 1);
+    uint64_t* hashes_next = __hashes(r, g + 1);
+    int num_threads = (int)r->num_threads;
+
+    // Every tile is replayed or computed from the last generation alone
+    #ifdef _OPENMP
+    #pragma omp parallel for num_threads(num_threads) if(num_threads > 1) schedule(dynamic, 16) reduction(+:computed, replayed)
+    #endif
+    for (size_t t = 0; t < r->n_tiles; t++) {
+        size_t p = __decide(r, t);
+        r->period[t] = (uint8_t)p;
+        if (p) {
+            // the frame of the period before is also the slot of the next one when p is the longest period
+            const uint8_t* src = __frame(r, g + 1 - p);
+            __copy_tile(r, src, grid_next, t);
+            if (p != P) { __copy_tile(r, src, frame_next, t); }
+            hashes_next[t] = __hashes(r, g + 1 - p)[t];
+            replayed++;
+        } else {
+            size_t r0, c0, th, tw;
+            __bounds(r, t, &r0, &c0, &th, &tw);
+            for (size_t i = r0; i < r0 + th; i++) {
+                for (size_t j = c0; j < c0 + tw; j++) { update(grid, grid_next, i * r->n + j, r->m, r->n); }
+            }
+            __copy_tile(r, grid_next, frame_next, t);
+            hashes_next[t] = __hash(r, grid_next, t);
+            computed++;
+        }
+    }
+
+    // Then the periods each tile repeats with are counted
+    #ifdef _OPENMP
+    #pragma omp parallel for num_threads(num_threads) if(num_threads > 1)
+    #endif
+    for (size_t t = 0; t < r->n_tiles; t++) {
+        uint32_t* runs = r->runs + t * P, mask = 0;
+        for (size_t p = 1; p <= P; p++) {
+            bool repeated = g + 1 >= p && __hashes(r, g + 1 - p)[t] == hashes_next[t];
+            runs[p - 1] = repeated ? runs[p - 1] + (runs[p - 1] < UINT32_MAX) : 0;
+            if (runs[p - 1] >= r->cycles * p) { mask |= 1u << (p - 1); }
+        }
+        r->masks[t] = mask;
+    }
+    (void)num_threads;
+
+    r->generation++;
+    r->computed += computed;
+    r->replayed += replayed;
+}
+
+/**
+ * Takes in a grid that was changed outside of the replay, like by removing
+ * spaceships. The tiles that changed are computed again until they settle.
+ */
+void replay_changed(struct tile_replay* r, const uint8_t* grid) {
+    uint64_t* hashes = __hashes(r, r->generation);
+    for (size_t t = 0; t < r->n_tiles; t++) {
+        uint64_t h = __hash(r, grid, t);
+        if (h == hashes[t]) { continue; }
+        hashes[t] = h;
+        memset(r->runs + t * r->max_period, 0, r->max_period * sizeof(uint32_t));
+        r->masks[t] = 0;
+        r->period[t] = 0;
+    }
+    memcpy(__frame(r, r->generation), grid, r->m * r->n);
+}
+
+/**
+ * Prints how many tiles were computed and replayed, and how many are
+ * periodic now with each period.
+ */
+void replay_print_stats(const struct tile_replay* r) {
+    size_t total = r->computed + r->replayed;
+    printf("Replay: %zu of %zu tile generations replayed (%.1f%%), periodic tiles now:",
+           r->replayed, total, total ? 100.0 * r->replayed / total : 0.0);
+    size_t count[REPLAY_MAX_PERIODS + 1] = {0};
+    for (size_t t = 0; t < r->n_tiles; t++) { count[r->period[t]]++; }
+    for (size_t p = 1; p <= r->max_period; p++) {
+        if (count[p]) { printf(" %zu of period %zu,", count[p], p); }
+    }
+    printf(" %zu of %zu computed\n", count[0], r->n_tiles);
+}
+
+/**
+ * Frees a replay.
+ */
+void replay_free(struct tile_replay* r) {
+    if (!r) { return; }
+    free(r->frames);
+    free(r->hashes);
+    free(r->runs);
+    free(r->masks);
+    free(r->period);
+    free(r);
+}
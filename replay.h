@@ -0,0 +1,69 @@
+/**
+ * Periodic-tile replay, for boards that settle into still lifes and
+ * oscillators.
+ *
+ * The grid is split into tiles and a hash of every tile is kept for the last
+ * generations. A tile whose hash and the hashes of its 8 neighbours have
+ * repeated with a period p (1 for still lifes) for a few cycles is marked
+ * periodic. Its next generation is then copied from the frame p generations
+ * back instead of computed, since the tile and its halo are the same as they
+ * were then. The replay stops as soon as the tile or a neighbour changes
+ * differently, and the tile is computed again until it settles.
+ *
+ * The frames of the last max_period generations are kept, so a replay run
+ * takes that many more grids of memory.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REPLAY_TILE 32       // default side of the tiles
+#define REPLAY_MAX_PERIOD 6  // default longest period replayed, a blinker next to a pulsar has 6
+#define REPLAY_CYCLES 3      // default cycles a period has to repeat for
+
+struct tile_replay;
+
+/**
+ * Creates the replay of an m by n grid, split into tile by tile tiles, that
+ * replays periods up to max_period once they repeat for the given number
+ * of cycles. Tiles are stepped with num_threads threads when built with
+ * OpenMP. Returns NULL and sets errno if the grid is empty or it cannot be
+ * allocated.
+ */
+struct tile_replay* replay_create(const uint8_t* grid, size_t m, size_t n, size_t tile,
+                                  size_t max_period, size_t cycles, size_t num_threads);
+
+/**
+ * Computes the next generation of the grid, which has to be the last
+ * generation computed (or the one the replay was created with), into
+ * grid_next.
+ */
+void replay_step(struct tile_replay* replay, const uint8_t* grid, uint8_t* grid_next);
+
+/**
+ * Takes in a grid that was changed outside of the replay, like by removing
+ * spaceships. The tiles that changed are computed again until they settle.
+ */
+void replay_changed(struct tile_replay* replay, const uint8_t* grid);
+
+/**
+ * Prints how many tiles were computed and replayed, and how many are
+ * periodic now with each period.
+ */
+void replay_print_stats(const struct tile_replay* replay);
+
+/**
+ * Frees a replay.
+ */
+void replay_free(struct tile_replay* replay);
+
+#ifdef __cplusplus
+}
+#endif
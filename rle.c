@@ -0,0 +1,185 @@
+/**
+ * Run-length encoded engine, see rle.h.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "rle.h"
+
+/**
+ * Makes room for one more run in a row.
+ */
+static bool __rle_push(struct rle_row* row, uint32_t start, uint32_t end) {
+    if (2 * row->n_runs + 2 > row->capacity) {
+        size_t capacity = row->capacity ? 2 * row->capacity : 8;
+        uint32_t* runs = (uint32_t*)realloc(row->runs, capacity * sizeof(uint32_t));
+        if (!runs) { return false; }
+        row->runs = runs;
+        row->capacity = capacity;
+    }
+    row->runs[2 * row->n_runs] = start;
+    row->runs[2 * row->n_runs + 1] = end;
+    row->n_runs++;
+    return true;
+}
+
+/**
+ * Allocates an empty (all dead) m by n grid. The width must fit in 32 bits.
+ * Returns false if it cannot be allocated.
+ */
+bool rle_init(struct rle_grid* grid, size_t m, size_t n) {
+    grid->m = m;
+    grid->n = n;
+    grid->rows = n <= UINT32_MAX ? (struct rle_row*)calloc(m, sizeof(struct rle_row)) : NULL;
+    return grid->rows != NULL;
+}
+
+/**
+ * Frees a grid.
+ */
+void rle_free(struct rle_grid* grid) {
+    if (!grid->rows) { return; }
+    for (size_t y = 0; y < grid->m; y++) { free(grid->rows[y].runs); }
+    free(grid->rows);
+    grid->rows = NULL;
+}
+
+/**
+ * Encodes a dense m by n grid of 0/1 bytes. Returns false if the grid cannot
+ * be allocated.
+ */
+bool rle_from_dense(struct rle_grid* grid, const uint8_t* dense, size_t m, size_t n) {
+    if (!rle_init(grid, m, n)) { return false; }
+    for (size_t y = 0; y < m; y++) {
+        const uint8_t* row = dense + y * n;
+        size_t x = 0;
+        while (x < n) {
+            // skip the dead cells, a word at a time when the row is empty there
+            uint64_t word;
+            while (x + 8 <= n && (memcpy(&word, row + x, 8), !word)) { x += 8; }
+            while (x < n && !row[x]) { x++; }
+            if (x == n) { break; }
+            size_t start = x;
+            while (x < n && row[x]) { x++; }
+            if (!__rle_push(&grid->rows[y], start, x)) { rle_free(grid); return false; }
+        }
+    }
+    return true;
+}
+
+/**
+ * Decodes a grid into a dense m by n grid of 0/1 bytes.
+ */
+void rle_to_dense(const struct rle_grid* grid, uint8_t* dense) {
+    memset(dense, 0, grid->m * grid->n);
+    for (size_t y = 0; y < grid->m; y++) {
+        const struct rle_row* row = &grid->rows[y];
+        for (size_t k = 0; k < row->n_runs; k++) {
+            memset(dense + y * grid->n + row->runs[2*k], 1, row->runs[2*k+1] - row->runs[2*k]);
+        }
+    }
+}
+
+/**
+ * A row's run boundaries shifted by -1, 0 or 1 cells. Sweeping over it
+ * gives the live cells of the row to the left, at, or to the right of x.
+ */
+struct __cursor {
+    const uint32_t* bounds;
+    size_t count, i;
+    int64_t shift;
+    bool center; // tracks the cell itself instead of the neighborhood
+};
+
+static inline int64_t __cursor_pos(const struct __cursor* c) {
+    return (int64_t)c->bounds[c->i] - c->shift;
+}
+
+/**
+ * Computes the next generation of one row from the rows above, at and below
+ * it (above and below may be NULL outside of the grid).
+ *
+ * The live cells in the 3x3 block around x (including x) is the sum of
+ * nine 0/1 step functions, one per row and shift, and all of them only
+ * change at run boundaries. The rows are merged by sweeping over the
+ * boundaries in order while keeping the block count T and the state A of
+ * the cell itself. A cell lives in the next generation if T is 3, or if T
+ * is 4 and the cell is alive.
+ */
+static bool __rle_step_row(const struct rle_row* above, const struct rle_row* row,
+                           const struct rle_row* below, size_t n, struct rle_row* out) {
+    struct __cursor cursors[10];
+    int n_cursors = 0;
+    const struct rle_row* rows[3] = {above, row, below};
+    for (int r = 0; r < 3; r++) {
+        if (!rows[r] || !rows[r]->n_runs) { continue; }
+        for (int shift = -1; shift <= 1; shift++) {
+            struct __cursor c = {rows[r]->runs, 2 * rows[r]->n_runs, 0, shift, false};
+            cursors[n_cursors++] = c;
+        }
+    }
+    if (row && row->n_runs) {
+        struct __cursor c = {row->runs, 2 * row->n_runs, 0, 0, true};
+        cursors[n_cursors++] = c;
+    }
+
+    out->n_runs = 0;
+    int block = 0, self = 0;
+    int64_t x = 0, live_start = -1;
+    for (;;) {
+        // apply every boundary at x, entering a run adds one and leaving it takes one away
+        int64_t next = (int64_t)n;
+        for (int k = 0; k < n_cursors; k++) {
+            struct __cursor* c = &cursors[k];
+            while (c->i < c->count && __cursor_pos(c) <= x) {
+                int delta = (c->i & 1) ? -1 : 1;
+                if (c->center) { self += delta; } else { block += delta; }
+                c->i++;
+            }
+            if (c->i < c->count && __cursor_pos(c) < next) { next = __cursor_pos(c); }
+        }
+
+        // the counts are constant from x up to the next boundary
+        bool live = block == 3 || (block == 4 && self);
+        if (live && live_start < 0) { live_start = x; }
+        else if (!live && live_start >= 0) {
+            if (!__rle_push(out, live_start, x)) { return false; }
+            live_start = -1;
+        }
+        if (next >= (int64_t)n) { break; }
+        x = next;
+    }
+    if (live_start >= 0 && !__rle_push(out, live_start, n)) { return false; }
+    return true;
+}
+
+/**
+ * Computes the next generation of grid into grid_next, which must have the
+ * same shape. Returns false if a row cannot be allocated.
+ */
+bool rle_step(const struct rle_grid* grid, struct rle_grid* grid_next) {
+    size_t m = grid->m;
+    for (size_t y = 0; y < m; y++) {
+        const struct rle_row* above = y > 0 ? &grid->rows[y-1] : NULL;
+        const struct rle_row* below = y + 1 < m ? &grid->rows[y+1] : NULL;
+        // rows without any run nearby stay empty
+        if ((!above || !above->n_runs) && !grid->rows[y].n_runs && (!below || !below->n_runs)) {
+            grid_next->rows[y].n_runs = 0;
+            continue;
+        }
+        if (!__rle_step_row(above, &grid->rows[y], below, grid->n, &grid_next->rows[y])) { return false; }
+    }
+    return true;
+}
+
+/**
+ * Get the total number of runs in a grid.
+ */
+size_t rle_count_runs(const struct rle_grid* grid) {
+    size_t runs = 0;
+    for (size_t y = 0; y < grid->m; y++) { runs += grid->rows[y].n_runs; }
+    return runs;
+}
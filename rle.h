@@ -0,0 +1,71 @@
+/**
+ * Run-length encoded engine. Each row is stored as the sorted boundaries of
+ * its runs of live cells, and the next generation of a row is computed by
+ * merging the run lists of the three rows around it without expanding them
+ * to dense bytes. The cost scales with the number of runs instead of the
+ * width of the grid, which suits boards with long empty or uniform stretches.
+ *
+ * Cells outside of the grid are dead, like for update().
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A row of live runs: runs[2*k] is the first cell of the k-th run and
+ * runs[2*k+1] is one past its last cell. Runs are sorted and never touch.
+ */
+struct rle_row {
+    uint32_t* runs;
+    size_t n_runs;
+    size_t capacity; // of runs, in boundaries
+};
+
+struct rle_grid {
+    size_t m, n;
+    struct rle_row* rows;
+};
+
+/**
+ * Allocates an empty (all dead) m by n grid. The width must fit in 32 bits.
+ * Returns false if it cannot be allocated.
+ */
+bool rle_init(struct rle_grid* grid, size_t m, size_t n);
+
+/**
+ * Frees a grid.
+ */
+void rle_free(struct rle_grid* grid);
+
+/**
+ * Encodes a dense m by n grid of 0/1 bytes. Returns false if the grid cannot
+ * be allocated.
+ */
+bool rle_from_dense(struct rle_grid* grid, const uint8_t* dense, size_t m, size_t n);
+
+/**
+ * Decodes a grid into a dense m by n grid of 0/1 bytes.
+ */
+void rle_to_dense(const struct rle_grid* grid, uint8_t* dense);
+
+/**
+ * Computes the next generation of grid into grid_next, which must have the
+ * same shape. Returns false if a row cannot be allocated.
+ */
+bool rle_step(const struct rle_grid* grid, struct rle_grid* grid_next);
+
+/**
+ * Get the total number of runs in a grid.
+ */
+size_t rle_count_runs(const struct rle_grid* grid);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,431 @@
+/**
+ * Runs many simulations at once on one shared pool of worker threads, see
+ * scheduler.h.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "scheduler.h"
+#include "helpers.h"
+#include "governor.h"
+#include "util.h"
+#include "lz.h"
+
+// Admitted jobs are loaded by the first worker that picks them
+enum __job_state { JOB_WAITING, JOB_ADMITTED, JOB_LOADING, JOB_RUNNING, JOB_DONE };
+
+struct sched_job {
+    struct scheduler* sched;
+    int tenant;
+    enum __job_state state;
+    char* input_file;             // loaded into a grid of the job's own, NULL if the caller's grid is stepped
+    int error;                    // errno of a job that could not be loaded
+    uint8_t* grid, * current, * next;
+    size_t m, n, iterations, generation;
+    size_t band_rows, n_bands;    // the tiles of a generation
+    size_t next_band, bands_done; // progress through the current generation
+    size_t memory;
+    struct timespec submitted, finished;
+    struct sched_job* next_job;   // all jobs in submission order
+};
+
+struct __tenant {
+    double weight;
+    double vtime;      // work done divided by the weight
+    size_t active;     // jobs submitted but not done
+    size_t jobs_done;
+    double cells;
+    double latency_sum, latency_max;
+};
+
+struct scheduler {
+    pthread_mutex_t lock;
+    pthread_cond_t work;     // workers wait here for tasks
+    pthread_cond_t finished; // waiters wait here for jobs to finish
+    pthread_t* threads;
+    size_t num_threads;
+    bool stopping;
+
+    size_t memory_budget, memory_used;
+    struct sched_job* jobs, * jobs_tail;
+    struct __tenant* tenants;
+    size_t n_tenants;
+    double vtime; // virtual time of the last task handed out
+};
+
+static inline size_t __remaining(const struct sched_job* job) {
+    return (job->iterations - job->generation) * job->m * job->n;
+}
+
+/**
+ * Admits waiting jobs in submission order while they fit the memory budget.
+ * Must hold the lock.
+ */
+static void __admit(struct scheduler* sched) {
+    for (struct sched_job* job = sched->jobs; job; job = job->next_job) {
+        if (job->state != JOB_WAITING) { continue; }
+        if (sched->memory_used + job->memory > sched->memory_budget) { break; }
+        sched->memory_used += job->memory;
+        job->state = JOB_ADMITTED;
+        // an idle tenant does not get to bank credit for the time it was idle
+        struct __tenant* t = &sched->tenants[job->tenant];
+        if (t->vtime < sched->vtime) { t->vtime = sched->vtime; }
+    }
+}
+
+/**
+ * Picks the job to run the next tile task of. Admitted jobs are loaded
+ * first. Then small jobs go first, shortest first, then the tenant that is
+ * furthest behind its fair share gets a task of its shortest job. Must hold
+ * the lock.
+ */
+static struct sched_job* __pick(struct scheduler* sched) {
+    struct sched_job* small = NULL, * fair = NULL;
+    for (struct sched_job* job = sched->jobs; job; job = job->next_job) {
+        if (job->state == JOB_ADMITTED) { return job; }
+        if (job->state != JOB_RUNNING || job->next_band == job->n_bands) { continue; }
+        size_t remaining = __remaining(job);
+        if (remaining <= SCHED_SMALL_JOB_CELLS) {
+            if (!small || remaining < __remaining(small)) { small = job; }
+        } else if (!fair) {
+            fair = job;
+        } else {
+            double vt = sched->tenants[job->tenant].vtime, best = sched->tenants[fair->tenant].vtime;
+            if (vt < best || (vt == best && remaining < __remaining(fair))) { fair = job; }
+        }
+    }
+    return small ? small : fair;
+}
+
+/**
+ * Releases a grid from grid_load_path(), which is mapped from the page it
+ * starts in.
+ */
+static void __release(uint8_t* grid, size_t size) {
+    size_t addr = ((size_t)grid) & ~(sysconf(_SC_PAGE_SIZE)-1);
+    munmap((void*)addr, (size_t)grid - addr + size);
+}
+
+/**
+ * Allocates the grid an admitted job is swapped with, and loads the input
+ * file of the job into memory of its own first so the file is never
+ * changed. Runs without the lock. Returns false and sets the error of the
+ * job if it cannot be loaded.
+ */
+static bool __load(struct sched_job* job) {
+    size_t size = job->m * job->n;
+    if (job->input_file) {
+        size_t m, n;
+        errno = 0;
+        uint8_t* file_grid = grid_load_path(job->input_file, &m, &n);
+        if (!file_grid) { job->error = errno ? errno : EINVAL; return false; }
+        bool same = m == job->m && n == job->n; // the file may have changed since it was submitted
+        job->grid = same ? (uint8_t*)malloc(size) : NULL;
+        if (job->grid) { memcpy(job->grid, file_grid, size); }
+        __release(file_grid, m * n);
+        if (!job->grid) { job->error = same ? ENOMEM : EINVAL; return false; }
+    }
+    job->next = (uint8_t*)malloc(size);
+    if (!job->next) { job->error = ENOMEM; return false; }
+    job->current = job->grid;
+    return true;
+}
+
+static inline void __free_job(struct sched_job* job) {
+    if (job->input_file) { free(job->grid); }
+    free(job->input_file);
+    free(job);
+}
+
+/**
+ * Finishes a job whose last generation is done, or that could not be
+ * loaded. Must hold the lock.
+ */
+static void __finish(struct scheduler* sched, struct sched_job* job) {
+    // the result has to end up in the grid of the job
+    if (!job->error && job->current != job->grid) {
+        memcpy(job->grid, job->current, job->m * job->n);
+        job->next = job->current;
+    }
+    free(job->next);
+    job->next = NULL;
+    job->current = job->grid;
+    job->state = JOB_DONE;
+    clock_gettime(CLOCK_MONOTONIC, &job->finished);
+    sched->memory_used -= job->memory;
+
+    struct __tenant* t = &sched->tenants[job->tenant];
+    double latency = get_time_diff(&job->submitted, &job->finished);
+    t->active--;
+    t->jobs_done++;
+    t->latency_sum += latency;
+    if (latency > t->latency_max) { t->latency_max = latency; }
+
+    __admit(sched);
+    pthread_cond_broadcast(&sched->finished);
+    pthread_cond_broadcast(&sched->work);
+}
+
+static void* __worker(void* arg) {
+    struct scheduler* sched = (struct scheduler*)arg;
+    pthread_mutex_lock(&sched->lock);
+    for (;;) {
+        struct sched_job* job;
+        while (!(job = __pick(sched)) && !sched->stopping) { pthread_cond_wait(&sched->work, &sched->lock); }
+        if (!job) { break; }
+
+        // load an admitted job without the lock, a job of no generations is done once loaded
+        if (job->state == JOB_ADMITTED) {
+            job->state = JOB_LOADING;
+            pthread_mutex_unlock(&sched->lock);
+            bool loaded = __load(job);
+            pthread_mutex_lock(&sched->lock);
+            job->state = JOB_RUNNING;
+            if (!loaded || job->iterations == 0) { __finish(sched, job); }
+            else { pthread_cond_broadcast(&sched->work); }
+            continue;
+        }
+
+        // claim a tile of the current generation and compute it without the lock
+        size_t band = job->next_band++;
+        size_t first = band * job->band_rows * job->n;
+        size_t last = (band + 1) * job->band_rows;
+        last = (last < job->m ? last : job->m) * job->n;
+        struct __tenant* t = &sched->tenants[job->tenant];
+        t->vtime += (last - first) / t->weight;
+        if (t->vtime > sched->vtime) { sched->vtime = t->vtime; }
+        const uint8_t* current = job->current;
+        uint8_t* next = job->next;
+        pthread_mutex_unlock(&sched->lock);
+
+        for (size_t i = first; i < last; i++) {
+            update(current, next, i, job->m, job->n);
+        }
+
+        // tenants may have been added and moved meanwhile
+        pthread_mutex_lock(&sched->lock);
+        sched->tenants[job->tenant].cells += last - first;
+        if (++job->bands_done == job->n_bands) {
+            // the last tile of a generation moves the job to the next one
+            swap(&job->current, &job->next);
+            job->next_band = job->bands_done = 0;
+            if (++job->generation == job->iterations) { __finish(sched, job); }
+            else { pthread_cond_broadcast(&sched->work); }
+        }
+    }
+    pthread_mutex_unlock(&sched->lock);
+    return NULL;
+}
+
+/**
+ * Creates a scheduler with a pool of num_threads workers that admits jobs
+ * while their grids fit in memory_budget bytes. 0 threads uses as many as
+ * the CPU quota allows, a 0 budget uses the memory available to the process.
+ * Returns NULL if the workers cannot be started.
+ */
+struct scheduler* sched_create(size_t num_threads, size_t memory_budget) {
+    struct scheduler* sched = (struct scheduler*)calloc(1, sizeof(struct scheduler));
+    if (!sched) { return NULL; }
+    pthread_mutex_init(&sched->lock, NULL);
+    pthread_cond_init(&sched->work, NULL);
+    pthread_cond_init(&sched->finished, NULL);
+    sched->num_threads = num_threads ? num_threads : get_num_cores_quota();
+    sched->memory_budget = memory_budget ? memory_budget : get_memory_available();
+    sched->threads = (pthread_t*)malloc(sched->num_threads * sizeof(pthread_t));
+    for (size_t i = 0; i < sched->num_threads; i++) {
+        if (pthread_create(&sched->threads[i], NULL, __worker, sched) != 0) {
+            sched->num_threads = i;
+            sched_destroy(sched);
+            return NULL;
+        }
+    }
+    return sched;
+}
+
+/**
+ * Waits for all submitted jobs to finish, stops the workers and frees the
+ * scheduler. Jobs that were not freed yet are freed too.
+ */
+void sched_destroy(struct scheduler* sched) {
+    pthread_mutex_lock(&sched->lock);
+    for (struct sched_job* job = sched->jobs; job; job = job->next_job) {
+        while (job->state != JOB_DONE) { pthread_cond_wait(&sched->finished, &sched->lock); }
+    }
+    sched->stopping = true;
+    pthread_cond_broadcast(&sched->work);
+    pthread_mutex_unlock(&sched->lock);
+    for (size_t i = 0; i < sched->num_threads; i++) { pthread_join(sched->threads[i], NULL); }
+
+    while (sched->jobs) {
+        struct sched_job* job = sched->jobs;
+        sched->jobs = job->next_job;
+        __free_job(job);
+    }
+    pthread_cond_destroy(&sched->finished);
+    pthread_cond_destroy(&sched->work);
+    pthread_mutex_destroy(&sched->lock);
+    free(sched->tenants);
+    free(sched->threads);
+    free(sched);
+}
+
+/**
+ * Adds a tenant that gets a share of the workers proportional to its weight
+ * while it has work. Returns the id of the tenant to submit jobs with, or
+ * -1 and sets errno to ENOMEM if it cannot be allocated.
+ */
+int sched_add_tenant(struct scheduler* sched, double weight) {
+    pthread_mutex_lock(&sched->lock);
+    struct __tenant* tenants = (struct __tenant*)realloc(sched->tenants, (sched->n_tenants + 1) * sizeof(struct __tenant));
+    if (!tenants) { pthread_mutex_unlock(&sched->lock); errno = ENOMEM; return -1; }
+    sched->tenants = tenants;
+    int id = (int)sched->n_tenants++;
+    memset(&sched->tenants[id], 0, sizeof(struct __tenant));
+    sched->tenants[id].weight = weight > 0 ? weight : 1.0;
+    pthread_mutex_unlock(&sched->lock);
+    return id;
+}
+
+/**
+ * Queues a job of an m by n grid that takes the given memory once admitted.
+ * The job has to have its grid or its input file. Returns NULL and sets
+ * errno like sched_submit(), and the job is freed.
+ */
+static struct sched_job* __enqueue(struct scheduler* sched, struct sched_job* job, int tenant,
+                                   size_t m, size_t n, size_t iterations, size_t memory) {
+    if (m * n == 0 || memory > sched->memory_budget) {
+        errno = m * n == 0 ? EINVAL : ENOMEM;
+        __free_job(job);
+        return NULL;
+    }
+    job->sched = sched;
+    job->tenant = tenant;
+    job->m = m;
+    job->n = n;
+    job->iterations = iterations;
+    job->memory = memory;
+    job->band_rows = SCHED_TILE_CELLS / n ? SCHED_TILE_CELLS / n : 1;
+    job->n_bands = (m + job->band_rows - 1) / job->band_rows;
+    clock_gettime(CLOCK_MONOTONIC, &job->submitted);
+
+    pthread_mutex_lock(&sched->lock);
+    if (tenant < 0 || (size_t)tenant >= sched->n_tenants) {
+        pthread_mutex_unlock(&sched->lock);
+        __free_job(job);
+        errno = EINVAL;
+        return NULL;
+    }
+    if (sched->jobs_tail) { sched->jobs_tail->next_job = job; } else { sched->jobs = job; }
+    sched->jobs_tail = job;
+    sched->tenants[tenant].active++;
+    __admit(sched);
+    pthread_cond_broadcast(&sched->work);
+    pthread_mutex_unlock(&sched->lock);
+    return job;
+}
+
+/**
+ * Submits a job that steps the m by n grid in place for the given number of
+ * generations. The grid must stay valid until the job is done. Returns NULL
+ * and sets errno to ENOMEM if the job can never fit the memory budget or
+ * EINVAL if the grid is empty or the tenant does not exist.
+ */
+struct sched_job* sched_submit(struct scheduler* sched, int tenant, uint8_t* grid,
+                               size_t m, size_t n, size_t iterations) {
+    struct sched_job* job = (struct sched_job*)calloc(1, sizeof(struct sched_job));
+    if (!job) { errno = ENOMEM; return NULL; }
+    job->grid = job->current = grid;
+    // the caller's grid is counted too, the scheduler allocates the other one
+    return __enqueue(sched, job, tenant, m, n, iterations, predict_memory(m, n, 0) - m * n);
+}
+
+/**
+ * Submits a job that steps the grid of an input file (any format
+ * grid_load_path() takes) for the given number of generations. The file is
+ * loaded once now for its shape and released, then again once the job is
+ * admitted, so it only takes memory from then on. Returns NULL and sets
+ * errno like sched_submit(), or if the file cannot be loaded.
+ */
+struct sched_job* sched_submit_path(struct scheduler* sched, int tenant, const char* input_file,
+                                    size_t iterations) {
+    size_t m, n;
+    errno = 0;
+    uint8_t* file_grid = grid_load_path(input_file, &m, &n);
+    if (!file_grid) { if (!errno) { errno = EINVAL; } return NULL; }
+    __release(file_grid, m * n);
+    struct sched_job* job = (struct sched_job*)calloc(1, sizeof(struct sched_job));
+    if (!job || !(job->input_file = strdup(input_file))) { free(job); errno = ENOMEM; return NULL; }
+    // the mapped input and both grids, like a run of game_of_life_shared
+    return __enqueue(sched, job, tenant, m, n, iterations, predict_memory(m, n, 0));
+}
+
+/**
+ * Waits for a job to finish. Returns the seconds from its submission to its
+ * completion.
+ */
+double sched_wait(struct sched_job* job) {
+    struct scheduler* sched = job->sched;
+    pthread_mutex_lock(&sched->lock);
+    while (job->state != JOB_DONE) { pthread_cond_wait(&sched->finished, &sched->lock); }
+    pthread_mutex_unlock(&sched->lock);
+    return get_time_diff(&job->submitted, &job->finished);
+}
+
+/**
+ * Get the last generation of a finished job, an m by n grid. It is the
+ * caller's grid for sched_submit(), and freed with the job for
+ * sched_submit_path(). Returns NULL and sets errno if the job could not be
+ * loaded.
+ */
+const uint8_t* sched_job_grid(const struct sched_job* job, size_t* m, size_t* n) {
+    if (job->error) { errno = job->error; return NULL; }
+    *m = job->m;
+    *n = job->n;
+    return job->grid;
+}
+
+/**
+ * Frees a finished job.
+ */
+void sched_job_free(struct sched_job* job) {
+    struct scheduler* sched = job->sched;
+    sched_wait(job);
+    pthread_mutex_lock(&sched->lock);
+    struct sched_job** link = &sched->jobs, * prev = NULL;
+    while (*link != job) { prev = *link; link = &(*link)->next_job; }
+    *link = job->next_job;
+    if (sched->jobs_tail == job) { sched->jobs_tail = prev; }
+    pthread_mutex_unlock(&sched->lock);
+    __free_job(job);
+}
+
+/**
+ * Prints the work done and the job latencies per tenant.
+ */
+void sched_print_stats(struct scheduler* sched) {
+    pthread_mutex_lock(&sched->lock);
+    printf("Scheduler: %zu workers, ", sched->num_threads);
+    print_bytes(sched->memory_used);
+    printf(" of ");
+    print_bytes(sched->memory_budget);
+    printf(" in use\n");
+    for (size_t i = 0; i < sched->n_tenants; i++) {
+        const struct __tenant* t = &sched->tenants[i];
+        printf("  tenant %zu (weight %g): %zu jobs, %.3g cell updates, mean latency ",
+               i, t->weight, t->jobs_done, t->cells);
+        print_time(t->jobs_done ? t->latency_sum / t->jobs_done : 0.0);
+        printf(", max latency ");
+        print_time(t->latency_max);
+        printf("\n");
+    }
+    pthread_mutex_unlock(&sched->lock);
+}
@@ -0,0 +1,98 @@
+/**
+ * Runs many simulations at once on one shared pool of worker threads, so
+ * concurrent jobs do not each start a thread per core and oversubscribe the
+ * machine.
+ *
+ * Every generation of a job is split into tile tasks (bands of rows) that
+ * any worker can pick up. Tasks are handed out weighted-fair between
+ * tenants, with small jobs served first to keep their latency low. Jobs are
+ * only admitted while their grids fit in the memory budget, the rest wait
+ * in submission order without their grids being loaded.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Jobs with at most this many cell updates in total are small jobs
+#define SCHED_SMALL_JOB_CELLS ((size_t)1 << 22)
+
+// Target number of cells in a tile task
+#define SCHED_TILE_CELLS ((size_t)1 << 16)
+
+struct scheduler;
+struct sched_job;
+
+/**
+ * Creates a scheduler with a pool of num_threads workers that admits jobs
+ * while their grids fit in memory_budget bytes. 0 threads uses as many as
+ * the CPU quota allows, a 0 budget uses the memory available to the process.
+ * Returns NULL if the workers cannot be started.
+ */
+struct scheduler* sched_create(size_t num_threads, size_t memory_budget);
+
+/**
+ * Waits for all submitted jobs to finish, stops the workers and frees the
+ * scheduler. Jobs that were not freed yet are freed too.
+ */
+void sched_destroy(struct scheduler* sched);
+
+/**
+ * Adds a tenant that gets a share of the workers proportional to its weight
+ * while it has work. Returns the id of the tenant to submit jobs with, or
+ * -1 and sets errno to ENOMEM if it cannot be allocated.
+ */
+int sched_add_tenant(struct scheduler* sched, double weight);
+
+/**
+ * Submits a job that steps the m by n grid in place for the given number of
+ * generations. The grid must stay valid until the job is done. Returns NULL
+ * and sets errno to ENOMEM if the job can never fit the memory budget or
+ * EINVAL if the grid is empty or the tenant does not exist.
+ */
+struct sched_job* sched_submit(struct scheduler* sched, int tenant, uint8_t* grid,
+                               size_t m, size_t n, size_t iterations);
+
+/**
+ * Submits a job that steps the grid of an input file (any format
+ * grid_load_path() takes) for the given number of generations. The file is
+ * loaded once now for its shape and released, then again once the job is
+ * admitted, so it only takes memory from then on. Returns NULL and sets
+ * errno like sched_submit(), or if the file cannot be loaded.
+ */
+struct sched_job* sched_submit_path(struct scheduler* sched, int tenant, const char* input_file,
+                                    size_t iterations);
+
+/**
+ * Waits for a job to finish. Returns the seconds from its submission to its
+ * completion.
+ */
+double sched_wait(struct sched_job* job);
+
+/**
+ * Get the last generation of a finished job, an m by n grid. It is the
+ * caller's grid for sched_submit(), and freed with the job for
+ * sched_submit_path(). Returns NULL and sets errno if the job could not be
+ * loaded.
+ */
+const uint8_t* sched_job_grid(const struct sched_job* job, size_t* m, size_t* n);
+
+/**
+ * Frees a finished job.
+ */
+void sched_job_free(struct sched_job* job);
+
+/**
+ * Prints the work done and the job latencies per tenant.
+ */
+void sched_print_stats(struct scheduler* sched);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,71 @@
+/**
+ * Signal-triggered snapshots and progress reports of a running simulation.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+
+#include "snapshot.h"
+#include "async_writer.h"
+#include "util.h"
+
+unsigned snapshot_requests = 0;
+
+// the output file the snapshots are written next to
+static const char* __snapshot_output = NULL;
+
+static void __snapshot_signal(int sig) {
+    unsigned request = sig == SIGUSR1 ? SNAPSHOT_BOARD : SNAPSHOT_PROGRESS;
+    __atomic_fetch_or(&snapshot_requests, request, __ATOMIC_RELAXED);
+}
+
+/**
+ * Installs the SIGUSR1 and SIGUSR2 handlers for a run that outputs to the
+ * given file. Snapshots are written next to it, so the name has to stay
+ * valid for the run. Returns false if the handlers cannot be installed.
+ */
+bool snapshot_install(const char* output_file) {
+    __snapshot_output = output_file;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = __snapshot_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    return sigaction(SIGUSR1, &sa, NULL) == 0 && sigaction(SIGUSR2, &sa, NULL) == 0;
+}
+
+/**
+ * Handles the pending requests for an m by n grid at the given generation
+ * of a run of total generations that has been going for elapsed seconds.
+ * The board is copied and handed to the async writer so the run continues
+ * right away.
+ */
+void snapshot_service(const uint8_t* grid, size_t m, size_t n,
+                      size_t generation, size_t total, double elapsed) {
+    unsigned requests = __atomic_exchange_n(&snapshot_requests, 0, __ATOMIC_RELAXED);
+
+    if (requests & SNAPSHOT_BOARD) {
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".gen%zu.npy", generation);
+        char* path = sibling_path(__snapshot_output, suffix);
+        uint8_t* copy = (uint8_t*)malloc(m * n);
+        memcpy(copy, grid, m * n);
+        printf("Snapshot of generation %zu queued as %s\n", generation, path);
+        async_write_npy(path, copy, 1, m, n);
+    }
+
+    if (requests & SNAPSHOT_PROGRESS) {
+        double rate = elapsed > 0 ? generation / elapsed : 0.0;
+        printf("Progress: generation %zu/%zu (%.1f%%), %.3g generations/sec, %.3g cells/sec, elapsed ",
+               generation, total, 100.0 * generation / total, rate, rate * m * n);
+        print_time(elapsed);
+        if (rate > 0) { printf(", ETA "); print_time((total - generation) / rate); }
+        printf("\n");
+        fflush(stdout);
+    }
+}
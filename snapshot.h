@@ -0,0 +1,56 @@
+/**
+ * Signal-triggered snapshots and progress reports of a running simulation.
+ *
+ *     kill -USR1 pid    write the current board to <output>.gen<N>.npy
+ *     kill -USR2 pid    print progress, throughput and ETA
+ *
+ * The signal handlers only set a flag, the generation loop picks it up at
+ * the next generation boundary with snapshot_pending() and then calls
+ * snapshot_service() to do the work.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SNAPSHOT_BOARD    1u // SIGUSR1: save the board
+#define SNAPSHOT_PROGRESS 2u // SIGUSR2: report progress
+
+/**
+ * The requests received since the last snapshot_service() call.
+ */
+extern unsigned snapshot_requests;
+
+/**
+ * Checks if any request is pending. This is a single relaxed atomic load so
+ * it can be done every generation.
+ */
+static inline bool snapshot_pending() {
+    return __atomic_load_n(&snapshot_requests, __ATOMIC_RELAXED) != 0;
+}
+
+/**
+ * Installs the SIGUSR1 and SIGUSR2 handlers for a run that outputs to the
+ * given file. Snapshots are written next to it, so the name has to stay
+ * valid for the run. Returns false if the handlers cannot be installed.
+ */
+bool snapshot_install(const char* output_file);
+
+/**
+ * Handles the pending requests for an m by n grid at the given generation
+ * of a run of total generations that has been going for elapsed seconds.
+ * The board is copied and handed to the async writer so the run continues
+ * right away.
+ */
+void snapshot_service(const uint8_t* grid, size_t m, size_t n,
+                      size_t generation, size_t total, double elapsed);
+
+#ifdef __cplusplus
+}
+#endif
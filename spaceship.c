@@ -0,0 +1,341 @@
+/**
+ * Removal of escaping spaceships, see spaceship.h.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "spaceship.h"
+#include "helpers.h"
+#include "util.h"
+
+#define SHIP_MAX_SIDE 8     // templates are kept as 8x8 bit masks
+#define SHIP_MAX_CELLS 32
+#define SHIP_SIM_SIZE 24    // board the phases of each spaceship are computed on
+#define SHIP_MAX_TEMPLATES 256
+
+/**
+ * The spaceships recognized, in their first phase.
+ */
+static const struct { const char* name; const char* rows[5]; } __ships[] = {
+    {"glider", {".O.", "..O", "OOO"}},
+    {"lwss", {".O..O", "O....", "O...O", "OOOO."}},
+    {"mwss", {"...O..", ".O...O", "O.....", "O....O", "OOOOO."}},
+    {"hwss", {"...OO..", ".O....O", "O......", "O.....O", "OOOOOO."}},
+};
+#define SHIP_TYPES (sizeof(__ships) / sizeof(__ships[0]))
+
+/**
+ * A phase of a spaceship in one orientation.
+ */
+struct __template {
+    size_t h, w;
+    uint64_t mask; // bit r*8+c for the cell at row r and column c
+    int vr, vc;    // cells moved every 4 generations
+    size_t type;
+};
+
+struct __box { size_t r0, c0, r1, c1; bool empty; };
+
+/**
+ * An object of a pass that is a spaceship.
+ */
+struct __ship {
+    struct __box box;
+    size_t cells[SHIP_MAX_CELLS], n_cells;
+    const struct __template* t;
+    bool kept;
+};
+
+struct spaceship_filter {
+    size_t m, n, margin;
+    struct __template templates[SHIP_MAX_TEMPLATES];
+    size_t n_templates;
+    uint8_t* visited;
+    size_t* stack;
+    size_t stack_capacity;
+    struct __ship* ships;
+    size_t ships_capacity;
+    struct __box* rest;  // objects that are not spaceships
+    size_t rest_capacity;
+    size_t removed[SHIP_TYPES];
+    char* path;
+    FILE* log;
+};
+
+static void __box_add(struct __box* b, size_t r, size_t c) {
+    if (b->empty) { b->r0 = b->r1 = r; b->c0 = b->c1 = c; b->empty = false; return; }
+    if (r < b->r0) { b->r0 = r; }
+    if (r > b->r1) { b->r1 = r; }
+    if (c < b->c0) { b->c0 = c; }
+    if (c > b->c1) { b->c1 = c; }
+}
+
+/**
+ * Get the bounding box and mask of the live cells of a small square board.
+ */
+static bool __shape(const uint8_t* grid, size_t size, struct __template* t, size_t* r0, size_t* c0) {
+    struct __box b = { 0, 0, 0, 0, true };
+    for (size_t i = 0; i < size * size; i++) { if (grid[i]) { __box_add(&b, i / size, i % size); } }
+    if (b.empty || b.r1 - b.r0 >= SHIP_MAX_SIDE || b.c1 - b.c0 >= SHIP_MAX_SIDE) { return false; }
+    t->h = b.r1 - b.r0 + 1;
+    t->w = b.c1 - b.c0 + 1;
+    t->mask = 0;
+    for (size_t r = 0; r < t->h; r++) {
+        for (size_t c = 0; c < t->w; c++) {
+            if (grid[(b.r0 + r) * size + b.c0 + c]) { t->mask |= 1ull << (r * 8 + c); }
+        }
+    }
+    *r0 = b.r0;
+    *c0 = b.c0;
+    return true;
+}
+
+/**
+ * Adds a template in one of the 8 orientations: bit 0 transposes, bit 1
+ * mirrors the rows and bit 2 the columns.
+ */
+static void __add_oriented(struct spaceship_filter* f, const struct __template* t, int orientation) {
+    struct __template o = *t;
+    if (orientation & 1) { o.h = t->w; o.w = t->h; o.vr = t->vc; o.vc = t->vr; }
+    if (orientation & 2) { o.vr = -o.vr; }
+    if (orientation & 4) { o.vc = -o.vc; }
+    o.mask = 0;
+    for (size_t r = 0; r < t->h; r++) {
+        for (size_t c = 0; c < t->w; c++) {
+            if (!(t->mask >> (r * 8 + c) & 1)) { continue; }
+            size_t rr = orientation & 1 ? c : r, cc = orientation & 1 ? r : c;
+            if (orientation & 2) { rr = o.h - 1 - rr; }
+            if (orientation & 4) { cc = o.w - 1 - cc; }
+            o.mask |= 1ull << (rr * 8 + cc);
+        }
+    }
+    for (size_t k = 0; k < f->n_templates; k++) {
+        const struct __template* x = &f->templates[k];
+        if (x->h == o.h && x->w == o.w && x->mask == o.mask) { return; }
+    }
+    if (f->n_templates < SHIP_MAX_TEMPLATES) { f->templates[f->n_templates++] = o; }
+}
+
+/**
+ * Adds the 4 phases of a spaceship in every orientation, found by running
+ * it. Returns false if it does not come back shifted after 4 generations.
+ */
+static bool __add_ship(struct spaceship_filter* f, size_t type) {
+    uint8_t a[SHIP_SIM_SIZE * SHIP_SIM_SIZE] = {0}, b[SHIP_SIM_SIZE * SHIP_SIM_SIZE];
+    uint8_t* grid = a, * grid_next = b;
+    for (size_t r = 0; r < 5 && __ships[type].rows[r]; r++) {
+        for (size_t c = 0; __ships[type].rows[r][c]; c++) {
+            grid[(SHIP_SIM_SIZE / 3 + r) * SHIP_SIM_SIZE + SHIP_SIM_SIZE / 3 + c] = __ships[type].rows[r][c] == 'O';
+        }
+    }
+    struct __template phases[5];
+    size_t r0[5], c0[5];
+    for (int p = 0; p < 5; p++) {
+        if (!__shape(grid, SHIP_SIM_SIZE, &phases[p], &r0[p], &c0[p])) { return false; }
+        for (size_t i = 0; i < SHIP_SIM_SIZE * SHIP_SIM_SIZE; i++) { update(grid, grid_next, i, SHIP_SIM_SIZE, SHIP_SIM_SIZE); }
+        swap(&grid, &grid_next);
+    }
+    if (phases[4].mask != phases[0].mask || phases[4].h != phases[0].h) { return false; }
+    for (int p = 0; p < 4; p++) {
+        phases[p].vr = (int)r0[4] - (int)r0[0];
+        phases[p].vc = (int)c0[4] - (int)c0[0];
+        phases[p].type = type;
+        for (int orientation = 0; orientation < 8; orientation++) { __add_oriented(f, &phases[p], orientation); }
+    }
+    return true;
+}
+
+/**
+ * Creates the filter of an m by n run and its log next to the output file.
+ * Returns NULL if it cannot be allocated or the log cannot be created.
+ */
+struct spaceship_filter* spaceship_filter_open(const char* output_file, size_t m, size_t n, size_t margin) {
+    struct spaceship_filter* f = (struct spaceship_filter*)calloc(1, sizeof(struct spaceship_filter));
+    if (!f) { return NULL; }
+    f->m = m;
+    f->n = n;
+    f->margin = margin;
+    bool ok = true;
+    for (size_t type = 0; type < SHIP_TYPES && ok; type++) { ok = __add_ship(f, type); }
+    if (!ok) { errno = EINVAL; }
+    ok = ok && (f->visited = (uint8_t*)malloc(m * n + 1)) &&
+         (f->path = sibling_path(output_file, ".spaceships.txt")) && (f->log = fopen(f->path, "w")) &&
+         fprintf(f->log, "# generation type row col direction\n") > 0;
+    if (!ok) { spaceship_filter_close(f); return NULL; }
+    return f;
+}
+
+static bool __push(struct spaceship_filter* f, size_t* top, size_t i) {
+    if (*top == f->stack_capacity) {
+        size_t capacity = f->stack_capacity ? 2 * f->stack_capacity : 1024;
+        size_t* stack = (size_t*)realloc(f->stack, capacity * sizeof(size_t));
+        if (!stack) { return false; }
+        f->stack = stack;
+        f->stack_capacity = capacity;
+    }
+    f->stack[(*top)++] = i;
+    return true;
+}
+
+/**
+ * Finds the object of live cells at most 2 apart that starts at cell i. Its
+ * first SHIP_MAX_CELLS cells are kept in ship. Returns false if memory
+ * cannot be allocated.
+ */
+static bool __object(struct spaceship_filter* f, const uint8_t* grid, size_t i, struct __ship* ship) {
+    size_t top = 0, m = f->m, n = f->n;
+    ship->box.empty = true;
+    ship->n_cells = 0;
+    f->visited[i] = 1;
+    if (!__push(f, &top, i)) { return false; }
+    while (top) {
+        size_t k = f->stack[--top], r = k / n, c = k % n;
+        __box_add(&ship->box, r, c);
+        if (ship->n_cells < SHIP_MAX_CELLS) { ship->cells[ship->n_cells] = k; }
+        ship->n_cells++;
+        for (size_t rr = r >= 2 ? r - 2 : 0; rr <= r + 2 && rr < m; rr++) {
+            for (size_t cc = c >= 2 ? c - 2 : 0; cc <= c + 2 && cc < n; cc++) {
+                size_t j = rr * n + cc;
+                if (grid[j] && !f->visited[j]) {
+                    f->visited[j] = 1;
+                    if (!__push(f, &top, j)) { return false; }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Get the template an object matches, or NULL if it is not a spaceship.
+ */
+static const struct __template* __match(const struct spaceship_filter* f, const struct __ship* ship) {
+    const struct __box* b = &ship->box;
+    if (ship->n_cells > SHIP_MAX_CELLS || b->r1 - b->r0 >= SHIP_MAX_SIDE || b->c1 - b->c0 >= SHIP_MAX_SIDE) { return NULL; }
+    size_t h = b->r1 - b->r0 + 1, w = b->c1 - b->c0 + 1;
+    uint64_t mask = 0;
+    for (size_t k = 0; k < ship->n_cells; k++) {
+        mask |= 1ull << ((ship->cells[k] / f->n - b->r0) * 8 + ship->cells[k] % f->n - b->c0);
+    }
+    for (size_t k = 0; k < f->n_templates; k++) {
+        const struct __template* t = &f->templates[k];
+        if (t->h == h && t->w == w && t->mask == mask) { return t; }
+    }
+    return NULL;
+}
+
+/**
+ * Checks if an axis keeps a spaceship (from a0 to a1, moving at v) more
+ * than margin cells away from an object (from b0 to b1, moving at v_other)
+ * for good: the gap is that large and never shrinks. Objects that are not
+ * spaceships may grow, so the spaceship has to be moving away from them.
+ */
+static bool __apart(size_t a0, size_t a1, size_t b0, size_t b1, int v, int v_other, bool grows, size_t margin) {
+    int rate;
+    if (a0 > b1 + margin) { rate = v - v_other; }       // the spaceship is after the object
+    else if (a1 + margin < b0) { rate = v_other - v; }  // before it
+    else { return false; }
+    return rate > 0 || (rate == 0 && !grows);
+}
+
+/**
+ * Checks if a spaceship stays away from an object on either axis.
+ */
+static bool __escapes(const struct __ship* s, const struct __box* b, int vr, int vc, bool grows, size_t margin) {
+    const struct __box* a = &s->box;
+    return __apart(a->r0, a->r1, b->r0, b->r1, s->t->vr, vr, grows, margin) ||
+           __apart(a->c0, a->c1, b->c0, b->c1, s->t->vc, vc, grows, margin);
+}
+
+static const char* __direction(int vr, int vc) {
+    static const char* names[3][3] = { {"NW", "N", "NE"}, {"W", "-", "E"}, {"SW", "S", "SE"} };
+    return names[(vr > 0) - (vr < 0) + 1][(vc > 0) - (vc < 0) + 1];
+}
+
+/**
+ * Deletes the escaping spaceships of a generation from the grid and logs
+ * them. Returns the number deleted, or (size_t)-1 if the log cannot be
+ * written or memory cannot be allocated.
+ */
+size_t spaceship_filter_apply(struct spaceship_filter* f, uint8_t* grid, size_t generation) {
+    // Split the live cells into spaceships and other objects
+    size_t n_ships = 0, n_rest = 0, size = f->m * f->n;
+    memset(f->visited, 0, size);
+    for (size_t i = 0; i < size; i++) {
+        if (!grid[i] || f->visited[i]) { continue; }
+        if (n_ships == f->ships_capacity) {
+            size_t capacity = f->ships_capacity ? 2 * f->ships_capacity : 16;
+            struct __ship* ships = (struct __ship*)realloc(f->ships, capacity * sizeof(struct __ship));
+            if (!ships) { return (size_t)-1; }
+            f->ships = ships;
+            f->ships_capacity = capacity;
+        }
+        struct __ship* ship = &f->ships[n_ships];
+        if (!__object(f, grid, i, ship)) { return (size_t)-1; }
+        if ((ship->t = __match(f, ship))) { ship->kept = true; n_ships++; continue; }
+        if (n_rest == f->rest_capacity) {
+            size_t capacity = f->rest_capacity ? 2 * f->rest_capacity : 64;
+            struct __box* rest = (struct __box*)realloc(f->rest, capacity * sizeof(struct __box));
+            if (!rest) { return (size_t)-1; }
+            f->rest = rest;
+            f->rest_capacity = capacity;
+        }
+        f->rest[n_rest++] = ship->box;
+    }
+
+    // Spaceships are checked against every object that is left, until none escapes
+    size_t removed = 0;
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (size_t k = 0; k < n_ships; k++) {
+            struct __ship* ship = &f->ships[k];
+            if (!ship->kept) { continue; }
+            bool escapes = true;
+            for (size_t j = 0; j < n_rest && escapes; j++) { escapes = __escapes(ship, &f->rest[j], 0, 0, true, f->margin); }
+            for (size_t j = 0; j < n_ships && escapes; j++) {
+                const struct __ship* other = &f->ships[j];
+                if (j != k && other->kept) { escapes = __escapes(ship, &other->box, other->t->vr, other->t->vc, false, f->margin); }
+            }
+            if (!escapes) { continue; }
+            ship->kept = false;
+            changed = true;
+            removed++;
+            f->removed[ship->t->type]++;
+            for (size_t c = 0; c < ship->n_cells; c++) { grid[ship->cells[c]] = 0; }
+            if (fprintf(f->log, "%zu %s %zu %zu %s\n", generation, __ships[ship->t->type].name,
+                        ship->box.r0, ship->box.c0, __direction(ship->t->vr, ship->t->vc)) < 0) {
+                return (size_t)-1;
+            }
+        }
+    }
+    return removed;
+}
+
+/**
+ * Prints how many spaceships of each type were deleted.
+ */
+void spaceship_filter_print_stats(const struct spaceship_filter* f) {
+    printf("Spaceships removed:");
+    for (size_t type = 0; type < SHIP_TYPES; type++) { printf(" %zu %s", f->removed[type], __ships[type].name); }
+    printf(", logged in %s\n", f->path);
+}
+
+/**
+ * Closes the log and frees the filter. Returns false if the log cannot be
+ * written.
+ */
+bool spaceship_filter_close(struct spaceship_filter* f) {
+    bool ok = !f->log || fclose(f->log) == 0;
+    free(f->visited);
+    free(f->stack);
+    free(f->ships);
+    free(f->rest);
+    free(f->path);
+    free(f);
+    return ok;
+}
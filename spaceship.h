@@ -0,0 +1,60 @@
+/**
+ * Removal of escaping spaceships, to keep the live part of long soup runs
+ * bounded.
+ *
+ * A pass groups the live cells into objects (cells at most 2 apart belong
+ * together) and recognizes gliders, lightweight, middleweight and
+ * heavyweight spaceships in any phase and orientation. A spaceship escapes
+ * once every other object is more than margin cells away from it along the
+ * rows or the columns, by a gap that can only grow: it moves away from the
+ * debris (which may grow), and away from or alongside the other spaceships.
+ * Escaping spaceships are deleted from the board and logged next to the
+ * output file, in <output>.spaceships.txt, as lines of
+ *
+ *     generation type row col direction
+ *
+ * with the top left corner of the spaceship and its direction (N, NE, E,
+ * ... with north the first row).
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SPACESHIP_MARGIN 8 // default cells between an escaping spaceship and the rest
+
+struct spaceship_filter;
+
+/**
+ * Creates the filter of an m by n run and its log next to the output file.
+ * Returns NULL if it cannot be allocated or the log cannot be created.
+ */
+struct spaceship_filter* spaceship_filter_open(const char* output_file, size_t m, size_t n, size_t margin);
+
+/**
+ * Deletes the escaping spaceships of a generation from the grid and logs
+ * them. Returns the number deleted, or (size_t)-1 if the log cannot be
+ * written or memory cannot be allocated.
+ */
+size_t spaceship_filter_apply(struct spaceship_filter* filter, uint8_t* grid, size_t generation);
+
+/**
+ * Prints how many spaceships of each type were deleted.
+ */
+void spaceship_filter_print_stats(const struct spaceship_filter* filter);
+
+/**
+ * Closes the log and frees the filter. Returns false if the log cannot be
+ * written.
+ */
+bool spaceship_filter_close(struct spaceship_filter* filter);
+
+#ifdef __cplusplus
+}
+#endif
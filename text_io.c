@@ -0,0 +1,168 @@
+/**
+ * Loading boards from text, see text_io.h.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <errno.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "matrix_io_helpers.h"
+#include "text_io.h"
+#include "util.h"
+
+// Text smaller than this per thread is not worth another thread
+#define TEXT_CHUNK_MIN (1 << 20)
+
+/**
+ * A chunk of whole lines, scanned and then parsed by one thread.
+ */
+struct __chunk {
+    const char* start, * end;
+    bool csv;
+    size_t rows, width; // found by the scan
+    size_t first_row;   // given for the parse
+    uint8_t* grid;
+    size_t n;
+};
+
+static void* __scan(void* arg) {
+    struct __chunk* c = (struct __chunk*)arg;
+    c->rows = c->width = 0;
+    for (const char* line = c->start; line < c->end;) {
+        const char* eol = __text_find_newline(line, c->end);
+        size_t width;
+        if (__text_row_width(line, eol, c->csv, &width)) {
+            c->rows++;
+            if (width > c->width) { c->width = width; }
+        }
+        line = eol + 1;
+    }
+    return NULL;
+}
+
+static void* __parse(void* arg) {
+    struct __chunk* c = (struct __chunk*)arg;
+    uint8_t* row = c->grid + c->first_row * c->n;
+    for (const char* line = c->start; line < c->end;) {
+        const char* eol = __text_find_newline(line, c->end);
+        size_t width;
+        if (__text_row_width(line, eol, c->csv, &width)) {
+            if (c->csv) { __text_parse_csv(line, eol, row, c->n); }
+            else { __text_parse_cells(line, eol, row, c->n); }
+            row += c->n;
+        }
+        line = eol + 1;
+    }
+    return NULL;
+}
+
+/**
+ * Runs a function on every chunk, one thread each (the first on this one).
+ */
+static void __run_chunks(void* (*func)(void*), struct __chunk* chunks, size_t count) {
+    pthread_t* threads = (pthread_t*)malloc(count * sizeof(pthread_t));
+    bool* started = (bool*)calloc(count, sizeof(bool));
+    for (size_t i = 1; i < count && threads && started; i++) {
+        started[i] = pthread_create(&threads[i], NULL, func, &chunks[i]) == 0;
+    }
+    func(&chunks[0]);
+    for (size_t i = 1; i < count; i++) {
+        if (started && started[i]) { pthread_join(threads[i], NULL); }
+        else { func(&chunks[i]); } // no thread for it
+    }
+    free(threads);
+    free(started);
+}
+
+/**
+ * Checks if a path names a text board, by its .csv or .cells extension.
+ */
+bool is_text_path(const char* path) {
+    const char* ext = strrchr(path, '.');
+    return ext && (strcasecmp(ext, ".csv") == 0 || strcasecmp(ext, ".cells") == 0);
+}
+
+/**
+ * Parses a board from text in memory with the given number of threads (0
+ * uses all cores). The board is as wide as its longest row and is
+ * page-aligned memory from mmap(), so it is released like the grids from
+ * grid_from_npy_path(). Returns NULL if the text has no rows or the board
+ * cannot be allocated.
+ */
+uint8_t* grid_from_text(const char* text, size_t size, bool csv, size_t num_threads,
+                        size_t* m, size_t* n) {
+    if (num_threads == 0) { num_threads = get_num_cores_affinity(); }
+    if (num_threads > size / TEXT_CHUNK_MIN + 1) { num_threads = size / TEXT_CHUNK_MIN + 1; }
+    struct __chunk* chunks = (struct __chunk*)calloc(num_threads, sizeof(struct __chunk));
+    if (!chunks) { return NULL; }
+
+    // split at the first newline after each even share of the text
+    const char* end = text + size, * start = text;
+    size_t count = 0;
+    for (size_t i = 0; i < num_threads && start < end; i++) {
+        const char* split = i + 1 == num_threads ? end : text + size / num_threads * (i + 1);
+        if (split < start) { split = start; }
+        split = split < end ? __text_find_newline(split, end) : end;
+        if (split < end) { split++; }
+        chunks[count].start = start;
+        chunks[count].end = split;
+        chunks[count].csv = csv;
+        count++;
+        start = split;
+    }
+    if (!count) { free(chunks); errno = EINVAL; return NULL; }
+
+    // count the rows of each chunk to know where its rows go in the board
+    __run_chunks(__scan, chunks, count);
+    size_t rows = 0, width = 0;
+    for (size_t i = 0; i < count; i++) {
+        chunks[i].first_row = rows;
+        rows += chunks[i].rows;
+        if (chunks[i].width > width) { width = chunks[i].width; }
+    }
+    if (!rows || !width) { free(chunks); errno = EINVAL; return NULL; }
+
+    void* x = mmap(NULL, rows * width, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (x == MAP_FAILED) { free(chunks); return NULL; }
+    for (size_t i = 0; i < count; i++) {
+        chunks[i].grid = (uint8_t*)x;
+        chunks[i].n = width;
+    }
+    __run_chunks(__parse, chunks, count);
+    free(chunks);
+    *m = rows;
+    *n = width;
+    return (uint8_t*)x;
+}
+
+/**
+ * Same as grid_from_text() but takes a file path instead, the format
+ * follows the extension.
+ */
+uint8_t* grid_from_text_path(const char* path, size_t* m, size_t* n) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { return NULL; }
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(fd); return NULL; }
+    if (st.st_size == 0) { close(fd); errno = EINVAL; return NULL; }
+    void* text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED) { return NULL; }
+    madvise(text, st.st_size, MADV_SEQUENTIAL);
+
+    const char* ext = strrchr(path, '.');
+    bool csv = ext && strcasecmp(ext, ".csv") == 0;
+    uint8_t* grid = grid_from_text((const char*)text, st.st_size, csv, 0, m, n);
+    munmap(text, st.st_size);
+    return grid;
+}
@@ -0,0 +1,44 @@
+/**
+ * Loading boards from text: CSV files of 0/1 values and plaintext .cells
+ * files ('.' dead, 'O' alive, '!' comment lines), one row per line. Rows
+ * of .cells files can leave out their trailing dead cells, and a blank line
+ * is a row of dead cells.
+ *
+ * Large files are split into chunks at newline boundaries that are scanned
+ * and parsed in parallel, straight into the board.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Checks if a path names a text board, by its .csv or .cells extension.
+ */
+bool is_text_path(const char* path);
+
+/**
+ * Parses a board from text in memory with the given number of threads (0
+ * uses all cores). The board is as wide as its longest row and is
+ * page-aligned memory from mmap(), so it is released like the grids from
+ * grid_from_npy_path(). Returns NULL if the text has no rows or the board
+ * cannot be allocated.
+ */
+uint8_t* grid_from_text(const char* text, size_t size, bool csv, size_t num_threads,
+                        size_t* m, size_t* n);
+
+/**
+ * Same as grid_from_text() but takes a file path instead, the format
+ * follows the extension.
+ */
+uint8_t* grid_from_text_path(const char* path, size_t* m, size_t* n);
+
+#ifdef __cplusplus
+}
+#endif
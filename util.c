@@ -15,6 +15,11 @@
 #include <errno.h>
 #include <sys/mman.h>
 #include <ctype.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 #include "matrix_io_helpers.h"
 #include "util.h"
@@ -82,12 +87,166 @@ size_t get_num_cores_affinity() { cpu_set_t cs; CPU_ZERO(&cs); sched_getaffinity
 #error Unrecognized OS
 #endif
 
+// The memory sizes in get_resource_usage() also have to be specialized for
+// each OS. On Linux getrusage() reports ru_maxrss in KiB and the rest comes
+// from /proc, on macOS ru_maxrss is already in bytes.
+#if defined(__APPLE__)
+static void __get_memory_usage(const struct rusage* ru, struct resource_usage* usage) {
+    usage->peak_rss = ru->ru_maxrss;
+}
+#elif defined(linux)
+/**
+ * Adds up the values (given in kB) of all lines in a /proc file that start
+ * with one of the given keys. Returns the total in bytes.
+ */
+static size_t __proc_kb_sum(const char* path, const char** keys, size_t n_keys) {
+    FILE* f = fopen(path, "r");
+    if (!f) { return 0; }
+    char line[256];
+    size_t total = 0;
+    while (fgets(line, sizeof(line), f)) {
+        for (size_t i = 0; i < n_keys; i++) {
+            size_t len = strlen(keys[i]);
+            size_t kb;
+            if (strncmp(line, keys[i], len) == 0 && sscanf(line + len, " %zu", &kb) == 1) {
+                total += kb * 1024;
+            }
+        }
+    }
+    fclose(f);
+    return total;
+}
+static void __get_memory_usage(const struct rusage* ru, struct resource_usage* usage) {
+    static const char* peak[1] = {"VmHWM:"}, * rss[1] = {"VmRSS:"};
+    static const char* hugetlb[1] = {"HugetlbPages:"}, * thp[1] = {"AnonHugePages:"};
+    usage->peak_rss = __proc_kb_sum("/proc/self/status", peak, 1);
+    if (!usage->peak_rss) { usage->peak_rss = ru->ru_maxrss * 1024; }
+    usage->rss = __proc_kb_sum("/proc/self/status", rss, 1);
+    usage->huge_pages = __proc_kb_sum("/proc/self/status", hugetlb, 1) +
+                        __proc_kb_sum("/proc/self/smaps_rollup", thp, 1);
+}
+#endif
+
+/**
+ * Take a snapshot of the resources used by this process so far.
+ */
+void get_resource_usage(struct resource_usage* usage) {
+    struct rusage ru;
+    memset(usage, 0, sizeof(*usage));
+    if (getrusage(RUSAGE_SELF, &ru) != 0) { return; }
+    usage->minor_faults = ru.ru_minflt;
+    usage->major_faults = ru.ru_majflt;
+    usage->vol_ctx_switches = ru.ru_nvcsw;
+    usage->invol_ctx_switches = ru.ru_nivcsw;
+    __get_memory_usage(&ru, usage);
+}
+
+/**
+ * Prints the resources used during a phase of the run. Faults and context
+ * switches are the counts between the two snapshots, the memory sizes are
+ * taken from the end snapshot.
+ */
+void print_resource_usage(const char* phase, const struct resource_usage* start,
+                          const struct resource_usage* end) {
+    printf("%s: peak RSS ", phase);
+    print_bytes(end->peak_rss);
+    printf(", RSS ");
+    print_bytes(end->rss);
+    printf(", huge pages ");
+    print_bytes(end->huge_pages);
+    printf(", faults %ld minor / %ld major, context switches %ld voluntary / %ld involuntary\n",
+           end->minor_faults - start->minor_faults, end->major_faults - start->major_faults,
+           end->vol_ctx_switches - start->vol_ctx_switches,
+           end->invol_ctx_switches - start->invol_ctx_switches);
+}
+
+// Converting other element types to cells: an element is alive if any of
+// its bits is set, except for the sign bit of floats so -0.0 is dead. The
+// loops are simple enough for the compiler to vectorize, and they are split
+// over threads when built with OpenMP.
+typedef uint16_t __attribute__((aligned(1))) __u16_unaligned;
+typedef uint32_t __attribute__((aligned(1))) __u32_unaligned;
+typedef uint64_t __attribute__((aligned(1))) __u64_unaligned;
+
+#define CONVERT_BLOCK 65536 // elements converted by a thread at a time
+#define TRANSPOSE_TILE 64   // rows and columns of a tile of a Fortran-order transpose
+
+#ifdef _OPENMP
+#define __PARALLEL_FOR _Pragma("omp parallel for")
+#else
+#define __PARALLEL_FOR
+#endif
+
+#define __DEFINE_CONVERT(name, T)                                                       \
+static void name(const void* src, uint8_t* dst, size_t m, size_t n, uint64_t mask,      \
+                 bool fortran_order) {                                                  \
+    const T* s = (const T*)src;                                                         \
+    const T bits = (T)mask;                                                             \
+    if (!fortran_order) {                                                               \
+        size_t size = m * n;                                                            \
+        __PARALLEL_FOR                                                                  \
+        for (size_t b = 0; b < size; b += CONVERT_BLOCK) {                              \
+            size_t end = b + CONVERT_BLOCK < size ? b + CONVERT_BLOCK : size;           \
+            for (size_t i = b; i < end; i++) { dst[i] = (s[i] & bits) != 0; }           \
+        }                                                                               \
+        return;                                                                         \
+    }                                                                                   \
+    /* column-major: element (i, j) is at j*m + i, transposed a tile at a time */      \
+    __PARALLEL_FOR                                                                      \
+    for (size_t ib = 0; ib < m; ib += TRANSPOSE_TILE) {                                 \
+        size_t iend = ib + TRANSPOSE_TILE < m ? ib + TRANSPOSE_TILE : m;                \
+        for (size_t jb = 0; jb < n; jb += TRANSPOSE_TILE) {                             \
+            size_t jend = jb + TRANSPOSE_TILE < n ? jb + TRANSPOSE_TILE : n;            \
+            for (size_t i = ib; i < iend; i++) {                                        \
+                for (size_t j = jb; j < jend; j++) { dst[i*n + j] = (s[j*m + i] & bits) != 0; } \
+            }                                                                           \
+        }                                                                               \
+    }                                                                                   \
+}
+__DEFINE_CONVERT(__convert_8, uint8_t)
+__DEFINE_CONVERT(__convert_16, __u16_unaligned)
+__DEFINE_CONVERT(__convert_32, __u32_unaligned)
+__DEFINE_CONVERT(__convert_64, __u64_unaligned)
+
+/**
+ * Converts an m by n array of any supported element type to cells.
+ */
+static void __convert(const void* src, uint8_t* dst, size_t m, size_t n, const struct __npy_dtype* dtype) {
+    uint64_t mask = ~0ull;
+    if (dtype->kind == 'f') {
+        // the sign bit is the top bit of the last byte, or of the first one if big-endian
+        uint64_t sign = dtype->big_endian ? 0x80 : 1ull << (8*dtype->itemsize - 1);
+        mask = ~sign;
+    }
+    switch (dtype->itemsize) {
+        case 1: __convert_8(src, dst, m, n, mask, dtype->fortran_order); break;
+        case 2: __convert_16(src, dst, m, n, mask, dtype->fortran_order); break;
+        case 4: __convert_32(src, dst, m, n, mask, dtype->fortran_order); break;
+        default: __convert_64(src, dst, m, n, mask, dtype->fortran_order); break;
+    }
+}
+
+/**
+ * Checks if an array can be used as the grid as is: bytes that are 0 or 1
+ * in row-major order.
+ */
+static inline bool __is_cells(const struct __npy_dtype* dtype) {
+    return (dtype->kind == 'u' || dtype->kind == 'b') && dtype->itemsize == 1 && !dtype->fortran_order;
+}
+
 /**
  * Creates a new matrix by loading the data from the given NPY file. This is
- * a file format used by the numpy library. This function only supports arrays
- * that are little-endian doubles, c-contiguous, and 1 or 2 dimensional. The
- * file is loaded as memory-mapped so it is backed by the file and loaded
- * on-demand. The file should be opened for reading or reading and writing.
+ * a file format used by the numpy library. This function supports arrays of
+ * bools, integers of 1 to 8 bytes and floats in either byte order and in C
+ * or Fortran order, that are 1 or 2 dimensional. Cells are alive where the
+ * array is nonzero.
+ * 
+ * Row-major uint8 and bool arrays are loaded as memory-mapped so they are
+ * backed by the file and loaded on-demand. Other arrays are converted in a
+ * single pass to new page-aligned memory. Files that cannot be mapped
+ * (pipes, sockets, ...) are read as a stream into anonymous memory. Either
+ * way the grid is released by unmapping the page it starts in. The file
+ * should be opened for reading or reading and writing.
  * 
  * This will return NULL if the data cannot be read, the file format is not
  * recognized, there are memory allocation issues, or the array is not a
@@ -95,32 +254,91 @@ size_t get_num_cores_affinity() { cpu_set_t cs; CPU_ZERO(&cs); sched_getaffinity
  */
 uint8_t* grid_from_npy(FILE* file, size_t *m, size_t *n) {
     // Read the header, check it, and get the shape of the matrix
+    // The header is parsed as it is read so this works on streams as well
     size_t sh[2], offset;
-    if (!__npy_read_header(file, sh, &offset)) { return NULL; }
+    struct __npy_dtype dtype;
+    if (!__npy_read_header(file, sh, &offset, &dtype)) { return NULL; }
+    size_t size = sh[0]*sh[1], bytes = size*dtype.itemsize;
+    bool cells = __is_cells(&dtype);
     
     // Get the memory mapped data
-    void* x = (void*)mmap(NULL, sh[0]*sh[1] + offset,
-                          PROT_READ|PROT_WRITE, MAP_SHARED, fileno(file), 0);
+    // A read-only file (like stdin redirected from a file) gets a private copy-on-write mapping
+    struct stat st;
+    bool mappable = fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode);
+    void* x = MAP_FAILED;
+    if (mappable) {
+        int flags = cells ? MAP_SHARED : MAP_PRIVATE; // only mapped to be converted
+        x = mmap(NULL, bytes + offset, PROT_READ|PROT_WRITE, flags, fileno(file), 0);
+        if (x == MAP_FAILED && errno == EACCES) {
+            x = mmap(NULL, bytes + offset, PROT_READ|PROT_WRITE, MAP_PRIVATE, fileno(file), 0);
+        }
+    } else {
+        x = mmap(NULL, bytes + offset, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (x != MAP_FAILED && fread((char*)x + offset, 1, bytes, file) != bytes) {
+            munmap(x, bytes + offset);
+            if (!ferror(file)) { errno = EINVAL; } // the stream ended early
+            return NULL;
+        }
+    }
     if (x == MAP_FAILED) { return NULL; }
 
-    // Make the matrix itself
+    // Make the matrix itself, converting it if needed
     uint8_t* data = (uint8_t*)(((char*)x) + offset);
+    if (!cells) {
+        uint8_t* grid = (uint8_t*)mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (grid != MAP_FAILED) {
+            // a row-major file mapping is read once front to back, a transpose jumps around it
+            if (mappable && !dtype.fortran_order) { madvise(x, bytes + offset, MADV_SEQUENTIAL); }
+            __convert(data, grid, sh[0], sh[1], &dtype);
+        }
+        munmap(x, bytes + offset);
+        if (grid == MAP_FAILED) { return NULL; }
+        data = grid;
+    }
     *m = sh[0];
     *n = sh[1];
     return data;
 }
 
 /**
- * Same as matrix_from_npy() but takes a file path instead.
+ * Same as matrix_from_npy() but takes a file path instead. The path "-"
+ * reads from stdin.
  */
 uint8_t* grid_from_npy_path(const char* path, size_t *m, size_t *n) {
+    if (strcmp(path, NPY_STDIO_PATH) == 0) { return grid_from_npy(stdin, m, n); }
     FILE* f = fopen(path, "r+b");
+    if (!f && errno == EACCES) { f = fopen(path, "rb"); } // only mapped privately
     if (!f) { return NULL; }
     uint8_t* grid = grid_from_npy(f, m, n);
     fclose(f);
     return grid;
 }
 
+/**
+ * Loads a small NPY file into a caller-provided buffer with a single
+ * pread(), without mmap() or any allocation. The grid points into the
+ * buffer. This will return NULL and set errno to EFBIG if the file does not
+ * fit the buffer or is not a row-major uint8 or bool array, so the caller
+ * can fall back to grid_from_npy_path().
+ */
+uint8_t* grid_from_npy_pread(const char* path, uint8_t* buf, size_t size, size_t *m, size_t *n) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { return NULL; }
+    ssize_t count = pread(fd, buf, size, 0);
+    close(fd);
+    if (count < 0) { return NULL; }
+    if ((size_t)count == size) { errno = EFBIG; return NULL; } // there may be more
+
+    size_t sh[2], offset;
+    struct __npy_dtype dtype;
+    if (!__npy_parse_header((char*)buf, count, sh, &offset, &dtype)) { return NULL; }
+    if (offset + sh[0]*sh[1]*dtype.itemsize > (size_t)count) { errno = EINVAL; return NULL; }
+    if (!__is_cells(&dtype)) { errno = EFBIG; return NULL; } // has to be converted to new memory
+    *m = sh[0];
+    *n = sh[1];
+    return buf + offset;
+}
+
 // /**
 //  * Saves a matrix to a CSV file.
 //  * 
@@ -149,35 +367,176 @@ uint8_t* grid_from_npy_path(const char* path, size_t *m, size_t *n) {
 // }
 
 /**
- * Saves a matrix to a NPY file. This is a file format used by the numpy
- * library. This will return false if the data cannot be written.
+ * Writes the header of a NPY file holding an array with the given numpy
+ * type descriptor (like '<u1') and shape of up to 4 dimensions. The data has
+ * to be written right after it. This will return false if the header cannot
+ * be written.
  */
-bool grid_to_npy(FILE* file, const uint8_t* grid, size_t m, size_t n, size_t p) {
+bool npy_write_header(FILE* file, const char* descr, const size_t* shape, size_t ndim) {
     // create the header
-    char header[128];
-    size_t len = snprintf(header, sizeof(header), "\x93NUMPY\x01   "
-        "{'descr': '<u1', 'fortran_order': False, 'shape': (%zu, %zu, %zu), }",
-        m, n, p);
-    if (len < 0) { return false; }
+    char header[128], dims[96] = "";
+    if (ndim < 1 || ndim > 4) { return false; }
+    for (size_t i = 0, off = 0; i < ndim; i++) {
+        off += snprintf(dims + off, sizeof(dims) - off, ndim == 1 ? "%zu," : i ? ", %zu" : "%zu", shape[i]);
+    }
+    int len = snprintf(header, sizeof(header), "\x93NUMPY\x01   "
+        "{'descr': '%s', 'fortran_order': False, 'shape': (%s), }", descr, dims);
+    if (len < 0 || len >= sizeof(header)) { return false; }
     header[7] = 0; // have to after the string is written
     *(unsigned short*)&header[8] = sizeof(header) - 10;
     memset(header + len, ' ', sizeof(header)-len-1);
     header[sizeof(header)-1] = '\n';
+    return fwrite(header, 1, sizeof(header), file) == sizeof(header);
+}
+
+/**
+ * Writes the header of a NPY file holding an m by n by p array of bytes. The
+ * data has to be written right after it. This will return false if the
+ * header cannot be written.
+ */
+bool grid_to_npy_header(FILE* file, size_t m, size_t n, size_t p) {
+    size_t shape[3] = {m, n, p};
+    return npy_write_header(file, "<u1", shape, 3);
+}
 
+/**
+ * Saves a matrix to a NPY file. This is a file format used by the numpy
+ * library. This will return false if the data cannot be written.
+ */
+bool grid_to_npy(FILE* file, const uint8_t* grid, size_t m, size_t n, size_t p) {
     // write the header and the data
-    bool head = fwrite(header, 1, sizeof(header), file) == sizeof(header);
-    if (!head) return false;
-    
-    return fwrite(grid, sizeof(uint8_t), n*m*p, file) == n*m;
+    if (!grid_to_npy_header(file, m, n, p)) { return false; }
+    return fwrite(grid, sizeof(uint8_t), n*m*p, file) == n*m*p;
 }
 
+// The original stdout once reserve_stdout_for_data() is called
+static int __data_fd = STDOUT_FILENO;
+
 /**
- * Same as matrix_to_npy() but takes a file path instead.
+ * Keeps stdout for the data written to the path "-" and sends everything
+ * else printed to stdout to stderr instead, so messages cannot end up in the
+ * middle of a NPY stream. Call it before printing anything. Returns false if
+ * the file descriptors cannot be duplicated.
+ */
+bool reserve_stdout_for_data() {
+    fflush(stdout);
+    int fd = dup(STDOUT_FILENO);
+    if (fd < 0) { return false; }
+    if (dup2(STDERR_FILENO, STDOUT_FILENO) < 0) { close(fd); return false; }
+    __data_fd = fd;
+    return true;
+}
+
+/**
+ * Opens a file to write a NPY file to. The path "-" writes to stdout (see
+ * reserve_stdout_for_data()). The file is closed with fclose() either way.
+ */
+FILE* npy_open_output(const char* path) {
+    if (strcmp(path, NPY_STDIO_PATH) != 0) { return fopen(path, "wb"); }
+    int fd = dup(__data_fd);
+    if (fd < 0) { return NULL; }
+    FILE* f = fdopen(fd, "wb");
+    if (!f) { close(fd); }
+    return f;
+}
+
+/**
+ * Same as matrix_to_npy() but takes a file path instead. The path "-"
+ * writes to stdout.
  */
 bool grid_to_npy_path(const char* path, const uint8_t* grid, size_t m, size_t n, size_t p) {
+    FILE* f = npy_open_output(path);
+    if (!f) { return false; }
+    bool ok = grid_to_npy(f, grid, m, n, p);
+    return fclose(f) == 0 && ok;
+}
+/**
+ * Allocates memory for grids directly from the OS, page-aligned and never
+ * shared with other allocations. Returns NULL if it cannot be allocated.
+ */
+uint8_t* grid_alloc(size_t size) {
+    void* x = mmap(NULL, size ? size : 1, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    return x == MAP_FAILED ? NULL : (uint8_t*)x;
+}
+
+/**
+ * Frees memory from grid_alloc().
+ */
+void grid_free(uint8_t* grid, size_t size) {
+    if (grid) { munmap(grid, size ? size : 1); }
+}
+
+#if defined(linux)
+/**
+ * Moves the pages of a buffer into a pipe with vmsplice() instead of copying
+ * them. The pipe only references the pages, they must not change until the
+ * reader has consumed them. Returns the number of bytes moved, which is less
+ * than size if the pipe does not support it.
+ */
+static size_t __vmsplice_all(int fd, const uint8_t* data, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        struct iovec iov = { (void*)(data + done), size - done };
+        ssize_t count = vmsplice(fd, &iov, 1, 0);
+        if (count < 0 && errno == EINTR) { continue; }
+        if (count <= 0) { break; }
+        done += count;
+    }
+    return done;
+}
+#endif
+
+/**
+ * Saves a grid from grid_alloc() to a NPY file and frees it. The allocation
+ * can be larger than the grid (like a history cut short), all allocated
+ * bytes of it are freed. When the file is a pipe (like stdout in a shell
+ * pipeline) the pages are handed to the pipe with vmsplice() without
+ * copying them, which is why the grid cannot be used afterwards. The path
+ * "-" writes to stdout. This will return false if the data cannot be
+ * written.
+ */
+bool grid_to_npy_path_splice(const char* path, uint8_t* grid, size_t allocated, size_t m, size_t n, size_t p) {
+    FILE* f = npy_open_output(path);
+    if (!f) { grid_free(grid, allocated); return false; }
+    size_t size = m*n*p, done = 0;
+    bool ok = grid_to_npy_header(f, m, n, p) && fflush(f) == 0;
+#if defined(linux)
+    struct stat st;
+    if (ok && fstat(fileno(f), &st) == 0 && S_ISFIFO(st.st_mode)) {
+        done = __vmsplice_all(fileno(f), grid, size);
+    }
+#endif
+    ok = ok && fwrite(grid + done, 1, size - done, f) == size - done;
+    ok = fclose(f) == 0 && ok;
+    grid_free(grid, allocated); // the pipe keeps its own references to the pages
+    return ok;
+}
+
+/**
+ * Saves an array of any numpy type descriptor (like '<u2') and shape to a
+ * NPY file. This will return false if the data cannot be written.
+ */
+bool array_to_npy_path(const char* path, const void* data, const char* descr,
+                       size_t itemsize, const size_t* shape, size_t ndim) {
     FILE* f = fopen(path, "wb");
     if (!f) { return false; }
-    grid_to_npy(f, grid, m, n, p);
-    fclose(f);
-    return true;
-}
\ No newline at end of file
+    size_t count = 1;
+    for (size_t i = 0; i < ndim; i++) { count *= shape[i]; }
+    bool ok = npy_write_header(f, descr, shape, ndim) &&
+              fwrite(data, itemsize, count, f) == count;
+    return fclose(f) == 0 && ok;
+}
+
+/**
+ * Makes the path of a file that goes next to an output file, by replacing
+ * the .npy extension of the output file with the given suffix. The path is
+ * allocated with malloc().
+ */
+char* sibling_path(const char* output_file, const char* suffix) {
+    size_t len = strlen(output_file);
+    if (len > 4 && strcmp(output_file + len - 4, ".npy") == 0) { len -= 4; }
+    char* path = (char*)malloc(len + strlen(suffix) + 1);
+    memcpy(path, output_file, len);
+    strcpy(path + len, suffix);
+    return path;
+}
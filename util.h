@@ -51,14 +51,95 @@ size_t get_num_logical_cores();
  */
 size_t get_num_cores_affinity();
 
+/**
+ * Resources used by this process, as reported by getrusage() and
+ * /proc/self/status. Sizes are in bytes. Fields the OS does not report are 0.
+ */
+struct resource_usage {
+    size_t peak_rss;        // high-water mark of the resident set
+    size_t rss;             // current resident set
+    size_t huge_pages;      // transparent and hugetlbfs huge pages in use
+    long minor_faults;      // page faults serviced without I/O
+    long major_faults;      // page faults that required I/O
+    long vol_ctx_switches;  // waits on a resource (I/O, locks, ...)
+    long invol_ctx_switches; // preempted by the scheduler
+};
+
+/**
+ * Take a snapshot of the resources used by this process so far.
+ */
+void get_resource_usage(struct resource_usage* usage);
+
+/**
+ * Prints the resources used during a phase of the run. Faults and context
+ * switches are the counts between the two snapshots, the memory sizes are
+ * taken from the end snapshot.
+ */
+void print_resource_usage(const char* phase, const struct resource_usage* start,
+                          const struct resource_usage* end);
+
+/**
+ * The path that reads a NPY file from stdin or writes it to stdout.
+ */
+#define NPY_STDIO_PATH "-"
+
 uint8_t* grid_from_npy(FILE* file, size_t* m, size_t* n);
 
 uint8_t* grid_from_npy_path(const char* path, size_t* m, size_t* n);
 
+/**
+ * Loads a small NPY file into a caller-provided buffer with a single
+ * pread(). Sets errno to EFBIG if the file does not fit the buffer or has
+ * to be converted.
+ */
+uint8_t* grid_from_npy_pread(const char* path, uint8_t* buf, size_t size, size_t* m, size_t* n);
+
+bool npy_write_header(FILE* file, const char* descr, const size_t* shape, size_t ndim);
+
+bool grid_to_npy_header(FILE* file, size_t m, size_t n, size_t p);
+
 bool grid_to_npy(FILE* file, const uint8_t* grid, size_t m, size_t n, size_t p);
 
 bool grid_to_npy_path(const char* path, const uint8_t* grid, size_t m, size_t n, size_t p);
 
+/**
+ * Keeps stdout for the data written to the path "-" and sends everything
+ * else printed to stdout to stderr instead. Call it before printing anything.
+ */
+bool reserve_stdout_for_data();
+
+/**
+ * Opens a file to write a NPY file to, "-" is stdout.
+ */
+FILE* npy_open_output(const char* path);
+
+/**
+ * Allocates memory for grids directly from the OS, page-aligned and never
+ * shared with other allocations.
+ */
+uint8_t* grid_alloc(size_t size);
+
+/**
+ * Frees memory from grid_alloc().
+ */
+void grid_free(uint8_t* grid, size_t size);
+
+/**
+ * Saves a grid from grid_alloc() of allocated bytes to a NPY file and frees
+ * it. Pipes get the pages with vmsplice() instead of a copy.
+ */
+bool grid_to_npy_path_splice(const char* path, uint8_t* grid, size_t allocated, size_t m, size_t n, size_t p);
+
+bool array_to_npy_path(const char* path, const void* data, const char* descr,
+                       size_t itemsize, const size_t* shape, size_t ndim);
+
+/**
+ * Makes the path of a file that goes next to an output file, by replacing
+ * the .npy extension of the output file with the given suffix. The path is
+ * allocated with malloc().
+ */
+char* sibling_path(const char* output_file, const char* suffix);
+
 #ifdef __cplusplus
 }
 #endif
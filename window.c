@@ -0,0 +1,183 @@
+/**
+ * Output selection, see window.h.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "window.h"
+
+/**
+ * Initializes a window that keeps everything.
+ */
+void window_defaults(struct output_window* w) {
+    memset(w, 0, sizeof(*w));
+    w->factor = 1;
+    w->sampling = SAMPLE_ALL;
+}
+
+/**
+ * Parses a crop given as row,col,rows,cols. Returns false if it is invalid.
+ */
+bool window_parse_crop(struct output_window* w, const char* crop) {
+    return sscanf(crop, "%zu,%zu,%zu,%zu", &w->row, &w->col, &w->rows, &w->cols) == 4;
+}
+
+static int __compare_sizes(const void* a, const void* b) {
+    size_t x = *(const size_t*)a, y = *(const size_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Parses a generation schedule: every:k, list:g1,g2,... or log[:base].
+ * Returns false if it is invalid.
+ */
+bool window_parse_generations(struct output_window* w, const char* schedule) {
+    if (strncmp(schedule, "every:", 6) == 0) {
+        w->sampling = SAMPLE_EVERY;
+        w->every = strtoull(schedule + 6, NULL, 10);
+        return w->every > 0;
+    }
+    if (strcmp(schedule, "log") == 0 || strncmp(schedule, "log:", 4) == 0) {
+        w->sampling = SAMPLE_LOG;
+        w->log_base = schedule[3] ? atof(schedule + 4) : 2.0;
+        return w->log_base > 1.0;
+    }
+    if (strncmp(schedule, "list:", 5) == 0) {
+        w->sampling = SAMPLE_LIST;
+        const char* s = schedule + 5;
+        free(w->list);
+        w->list = NULL;
+        w->n_list = 0;
+        while (*s) {
+            char* end;
+            size_t g = strtoull(s, &end, 10);
+            if (end == s || (*end && *end != ',')) { return false; }
+            size_t* list = (size_t*)realloc(w->list, (w->n_list + 1) * sizeof(size_t));
+            if (!list) { return false; }
+            w->list = list;
+            w->list[w->n_list++] = g;
+            s = *end ? end + 1 : end;
+        }
+        qsort(w->list, w->n_list, sizeof(size_t), __compare_sizes);
+        return w->n_list > 0;
+    }
+    return false;
+}
+
+/**
+ * Sets up a window for an m by n grid run for the given number of
+ * generations, clamping the crop to the grid. Returns false if the crop is
+ * outside of the grid or the schedule cannot be allocated.
+ */
+bool window_init(struct output_window* w, size_t m, size_t n, size_t iterations) {
+    w->m = m;
+    w->n = n;
+    if (w->row >= m || w->col >= n || w->factor == 0) { errno = EINVAL; return false; }
+    if (w->rows == 0 || w->row + w->rows > m) { w->rows = m - w->row; }
+    if (w->cols == 0 || w->col + w->cols > n) { w->cols = n - w->col; }
+    w->out_m = (w->rows + w->factor - 1) / w->factor;
+    w->out_n = (w->cols + w->factor - 1) / w->factor;
+
+    // A logarithmic schedule is made into the list of its generations
+    if (w->sampling == SAMPLE_LOG) {
+        free(w->list);
+        w->list = (size_t*)malloc(2 * sizeof(size_t));
+        if (!w->list) { return false; }
+        w->list[0] = 0;
+        w->n_list = 1;
+        for (double g = 1; g <= (double)iterations; g *= w->log_base) {
+            size_t generation = (size_t)g;
+            if (generation == w->list[w->n_list - 1]) { continue; }
+            size_t* list = (size_t*)realloc(w->list, (w->n_list + 1) * sizeof(size_t));
+            if (!list) { return false; }
+            w->list = list;
+            w->list[w->n_list++] = generation;
+        }
+    }
+    return true;
+}
+
+/**
+ * Frees the schedule of a window.
+ */
+void window_free(struct output_window* w) {
+    free(w->list);
+    w->list = NULL;
+    w->n_list = 0;
+}
+
+/**
+ * Checks if a window leaves every cell of a frame as is.
+ */
+bool window_is_full(const struct output_window* w) {
+    return w->rows == w->m && w->cols == w->n && w->factor == 1;
+}
+
+/**
+ * Checks if a generation is output.
+ */
+bool window_selects(const struct output_window* w, size_t generation) {
+    switch (w->sampling) {
+        case SAMPLE_EVERY: return generation % w->every == 0;
+        case SAMPLE_LIST:
+        case SAMPLE_LOG: return bsearch(&generation, w->list, w->n_list, sizeof(size_t), __compare_sizes) != NULL;
+        default: return true;
+    }
+}
+
+/**
+ * Get the number of generations output from first to last (inclusive).
+ */
+size_t window_frames(const struct output_window* w, size_t first, size_t last) {
+    if (first > last) { return 0; }
+    switch (w->sampling) {
+        case SAMPLE_EVERY: return last / w->every - (first ? (first - 1) / w->every + 1 : 0) + 1;
+        case SAMPLE_LIST:
+        case SAMPLE_LOG: {
+            size_t count = 0;
+            for (size_t i = 0; i < w->n_list; i++) {
+                bool duplicate = i > 0 && w->list[i] == w->list[i - 1];
+                count += !duplicate && w->list[i] >= first && w->list[i] <= last;
+            }
+            return count;
+        }
+        default: return last - first + 1;
+    }
+}
+
+/**
+ * Reduces a grid to an output frame of out_m by out_n cells. Returns the
+ * grid itself if the window keeps every cell, otherwise the frame written
+ * into out.
+ */
+const uint8_t* window_apply(const struct output_window* w, const uint8_t* grid, uint8_t* out) {
+    if (window_is_full(w)) { return grid; }
+    size_t f = w->factor;
+    for (size_t i = 0; i < w->out_m; i++) {
+        uint8_t* dst = out + i * w->out_n;
+        const uint8_t* src = grid + (w->row + i * f) * w->n + w->col;
+        if (f == 1) {
+            memcpy(dst, src, w->out_n);
+        } else if (!w->max_pool) {
+            for (size_t j = 0; j < w->out_n; j++) { dst[j] = src[j * f]; }
+        } else {
+            // the rows of the block are ORed together, then the columns of each block
+            size_t block_rows = w->rows - i * f < f ? w->rows - i * f : f;
+            memset(dst, 0, w->out_n);
+            for (size_t r = 0; r < block_rows; r++, src += w->n) {
+                for (size_t j = 0; j < w->out_n; j++) {
+                    size_t width = w->cols - j * f < f ? w->cols - j * f : f;
+                    uint8_t alive = 0;
+                    for (size_t k = 0; k < width; k++) { alive |= src[j * f + k]; }
+                    dst[j] |= alive;
+                }
+            }
+        }
+    }
+    return out;
+}
@@ -0,0 +1,95 @@
+/**
+ * Output selection: which part of each generation and which generations
+ * leave the engine, so the memory and disk a run uses scale with what is
+ * asked for instead of the full (generations, m, n) history.
+ *
+ *   crop        a rectangle of the grid, -w row,col,rows,cols
+ *   stride      every k-th cell of every k-th row of the crop, -s k
+ *   max-pool    k by k blocks of the crop that are alive if any cell is, -x k
+ *   generations every:k, list:g1,g2,... or log[:base] (0, 1, then powers
+ *               of the base, 2 by default), -g schedule
+ *
+ * Frames are reduced right after a generation is computed, before they are
+ * copied, buffered, compressed or written.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum window_sampling { SAMPLE_ALL, SAMPLE_EVERY, SAMPLE_LIST, SAMPLE_LOG };
+
+struct output_window {
+    size_t row, col, rows, cols; // the crop, 0 rows or cols go to the edge of the grid
+    size_t factor;               // stride or pool factor, 1 keeps every cell
+    bool max_pool;
+    enum window_sampling sampling;
+    size_t every;
+    double log_base;
+    size_t* list;                // sorted generations for SAMPLE_LIST (and SAMPLE_LOG once set up)
+    size_t n_list;
+
+    // set up by window_init()
+    size_t m, n;                 // of the grid
+    size_t out_m, out_n;         // of each output frame
+};
+
+/**
+ * Initializes a window that keeps everything.
+ */
+void window_defaults(struct output_window* window);
+
+/**
+ * Parses a crop given as row,col,rows,cols. Returns false if it is invalid.
+ */
+bool window_parse_crop(struct output_window* window, const char* crop);
+
+/**
+ * Parses a generation schedule: every:k, list:g1,g2,... or log[:base].
+ * Returns false if it is invalid.
+ */
+bool window_parse_generations(struct output_window* window, const char* schedule);
+
+/**
+ * Sets up a window for an m by n grid run for the given number of
+ * generations, clamping the crop to the grid. Returns false if the crop is
+ * outside of the grid or the schedule cannot be allocated.
+ */
+bool window_init(struct output_window* window, size_t m, size_t n, size_t iterations);
+
+/**
+ * Frees the schedule of a window.
+ */
+void window_free(struct output_window* window);
+
+/**
+ * Checks if a window leaves every cell of a frame as is.
+ */
+bool window_is_full(const struct output_window* window);
+
+/**
+ * Checks if a generation is output.
+ */
+bool window_selects(const struct output_window* window, size_t generation);
+
+/**
+ * Get the number of generations output from first to last (inclusive).
+ */
+size_t window_frames(const struct output_window* window, size_t first, size_t last);
+
+/**
+ * Reduces a grid to an output frame of out_m by out_n cells. Returns the
+ * grid itself if the window keeps every cell, otherwise the frame written
+ * into out.
+ */
+const uint8_t* window_apply(const struct output_window* window, const uint8_t* grid, uint8_t* out);
+
+#ifdef __cplusplus
+}
+#endif